@@ -0,0 +1,285 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Debugger.hpp"
+
+// Compact binary instruction trace.
+//
+// Every executed instruction is one fixed 12-byte record holding the CPU
+// state before it ran, the cycle delta to the previous record and the first
+// data write it made (stack pushes are not recorded). Records are grouped in chunks of kChunkRecords; the
+// directory at the end of the file keeps, for each chunk, its cycle range and
+// 64K-bit maps of the PCs executed and addresses written, so queries only
+// open the chunks that can match.
+//
+// All fields are little endian, which is what every supported host is.
+
+struct TraceRecord {
+    uint8_t pcLo, pcHi;
+    uint8_t writeLo, writeHi;
+    uint8_t opcode;
+    uint8_t a, x, y, sp, p;
+    uint8_t delta;      // bit 7: the instruction wrote, bits 0-6: cycles since the previous record
+    uint8_t writeValue;
+
+    uint16_t pc() const { return static_cast<uint16_t>(pcLo | pcHi << 8); }
+    uint16_t writeAddress() const { return static_cast<uint16_t>(writeLo | writeHi << 8); }
+    bool wrote() const { return (delta & 0x80) != 0; }
+    uint8_t cycleDelta() const { return delta & 0x7F; }
+};
+static_assert(sizeof(TraceRecord) == 12);
+
+struct TraceChunk {
+    uint64_t offset;
+    uint64_t firstCycle;
+    uint64_t lastCycle;
+    uint64_t firstInstruction;
+    uint32_t count;
+    uint32_t reserved;
+    std::array<uint64_t, 1024> pcBits;
+    std::array<uint64_t, 1024> writeBits;
+
+    static bool test(const std::array<uint64_t, 1024> &bits, uint16_t address) {
+        return (bits[address >> 6] >> (address & 63)) & 1;
+    }
+};
+
+struct TraceHeader {
+    char magic[8];
+    uint32_t recordSize;
+    uint32_t chunkRecords;
+    uint64_t chunkCount;
+    uint64_t directoryOffset;
+};
+
+constexpr char kTraceMagic[8] = {'N', 'E', 'S', 'T', 'R', 'C', '1', '\0'};
+constexpr uint32_t kChunkRecords = 1 << 16;
+
+class BinaryTraceWriter {
+  public:
+    explicit BinaryTraceWriter(const char *filename) {
+        file = std::fopen(filename, "wb");
+        if (!file)
+            throw std::runtime_error("Failed to create the trace file.");
+        TraceHeader header{};
+        std::fwrite(&header, sizeof(header), 1, file); // Rewritten by close()
+        records.reserve(kChunkRecords);
+        startChunk();
+    }
+
+    ~BinaryTraceWriter() { close(); }
+
+    BinaryTraceWriter(const BinaryTraceWriter &) = delete;
+    BinaryTraceWriter &operator=(const BinaryTraceWriter &) = delete;
+
+    // Called before an instruction executes.
+    void begin(const CpuRegisters &r) {
+        current = {};
+        current.pcLo = static_cast<uint8_t>(r.pc);
+        current.pcHi = static_cast<uint8_t>(r.pc >> 8);
+        current.a = r.a;
+        current.x = r.x;
+        current.y = r.y;
+        current.sp = r.sp;
+        current.p = r.p;
+        // An out-of-range delta would corrupt every later cycle in the
+        // chunk, so it starts a new chunk instead.
+        if (!records.empty() && r.cycles - lastCycle > 0x7F)
+            flushChunk();
+        if (records.empty()) {
+            chunk.firstCycle = r.cycles;
+            current.delta = 0;
+        } else {
+            current.delta = static_cast<uint8_t>(r.cycles - lastCycle);
+        }
+        lastCycle = r.cycles;
+    }
+
+    void noteWrite(uint16_t address, uint8_t value) {
+        if (current.wrote())
+            return;
+        current.delta |= 0x80;
+        current.writeLo = static_cast<uint8_t>(address);
+        current.writeHi = static_cast<uint8_t>(address >> 8);
+        current.writeValue = value;
+    }
+
+    void end(uint8_t opcode) {
+        current.opcode = opcode;
+        uint16_t pc = current.pc();
+        chunk.pcBits[pc >> 6] |= 1ull << (pc & 63);
+        if (current.wrote()) {
+            uint16_t address = current.writeAddress();
+            chunk.writeBits[address >> 6] |= 1ull << (address & 63);
+        }
+        chunk.lastCycle = lastCycle;
+        records.push_back(current);
+        if (records.size() == kChunkRecords)
+            flushChunk();
+    }
+
+    void close() {
+        if (!file)
+            return;
+        flushChunk();
+        // The directory is read in place, so keep it 8-byte aligned.
+        while (std::ftell(file) % 8 != 0)
+            std::fputc(0, file);
+
+        TraceHeader header{};
+        std::memcpy(header.magic, kTraceMagic, sizeof(kTraceMagic));
+        header.recordSize = sizeof(TraceRecord);
+        header.chunkRecords = kChunkRecords;
+        header.chunkCount = directory.size();
+        header.directoryOffset = static_cast<uint64_t>(std::ftell(file));
+        std::fwrite(directory.data(), sizeof(TraceChunk), directory.size(), file);
+        std::fseek(file, 0, SEEK_SET);
+        std::fwrite(&header, sizeof(header), 1, file);
+        std::fclose(file);
+        file = nullptr;
+    }
+
+  private:
+    void startChunk() {
+        chunk = {};
+        chunk.offset = static_cast<uint64_t>(std::ftell(file));
+        chunk.firstInstruction = instructions;
+    }
+
+    void flushChunk() {
+        if (records.empty())
+            return;
+        std::fwrite(records.data(), sizeof(TraceRecord), records.size(), file);
+        chunk.count = static_cast<uint32_t>(records.size());
+        instructions += records.size();
+        directory.push_back(chunk);
+        records.clear();
+        startChunk();
+    }
+
+    std::FILE *file = nullptr;
+    std::vector<TraceRecord> records;
+    std::vector<TraceChunk> directory;
+    TraceChunk chunk{};
+    TraceRecord current{};
+    uint64_t lastCycle = 0;
+    uint64_t instructions = 0;
+};
+
+// Read-only view over a trace held in memory (typically mmapped).
+class BinaryTraceReader {
+  public:
+    struct Entry {
+        uint64_t index;
+        uint64_t cycle;
+        const TraceRecord *record;
+    };
+
+    BinaryTraceReader(const uint8_t *data, size_t size) : data(data), size(size) {
+        if (size < sizeof(TraceHeader))
+            throw std::runtime_error("The trace file is too small.");
+        std::memcpy(&header, data, sizeof(header));
+        if (std::memcmp(header.magic, kTraceMagic, sizeof(kTraceMagic)) != 0 ||
+            header.recordSize != sizeof(TraceRecord))
+            throw std::runtime_error("Not a trace file.");
+        if (header.directoryOffset > size ||
+            header.chunkCount > (size - header.directoryOffset) / sizeof(TraceChunk))
+            throw std::runtime_error("The trace file is truncated.");
+        // Queries walk the records of a chunk without further checks.
+        for (uint64_t i = 0; i < header.chunkCount; i++) {
+            const TraceChunk &c = chunk(i);
+            if (c.offset < sizeof(TraceHeader) || c.offset > size ||
+                c.count > (size - c.offset) / sizeof(TraceRecord))
+                throw std::runtime_error("The trace file is corrupt.");
+        }
+    }
+
+    uint64_t chunkCount() const { return header.chunkCount; }
+
+    const TraceChunk &chunk(uint64_t i) const {
+        return *reinterpret_cast<const TraceChunk *>(data + header.directoryOffset +
+                                                     i * sizeof(TraceChunk));
+    }
+
+    uint64_t instructionCount() const {
+        if (header.chunkCount == 0)
+            return 0;
+        const TraceChunk &last = chunk(header.chunkCount - 1);
+        return last.firstInstruction + last.count;
+    }
+
+    // Calls f(entry) for every record of a chunk, with absolute cycles.
+    // Stops early when f returns false; returns false in that case.
+    template <class F> bool forEach(const TraceChunk &c, F &&f) const {
+        const auto *records = reinterpret_cast<const TraceRecord *>(data + c.offset);
+        uint64_t cycle = c.firstCycle;
+        for (uint32_t i = 0; i < c.count; i++) {
+            cycle += records[i].cycleDelta();
+            if (!f(Entry{c.firstInstruction + i, cycle, &records[i]}))
+                return false;
+        }
+        return true;
+    }
+
+    template <class F> void executionsOf(uint16_t pc, F &&f) const {
+        for (uint64_t i = 0; i < header.chunkCount; i++) {
+            const TraceChunk &c = chunk(i);
+            if (!TraceChunk::test(c.pcBits, pc))
+                continue;
+            forEach(c, [&](const Entry &e) {
+                if (e.record->pc() == pc)
+                    f(e);
+                return true;
+            });
+        }
+    }
+
+    template <class F> void betweenCycles(uint64_t from, uint64_t to, F &&f) const {
+        for (uint64_t i = 0; i < header.chunkCount; i++) {
+            const TraceChunk &c = chunk(i);
+            if (c.lastCycle < from)
+                continue;
+            if (c.firstCycle > to)
+                break;
+            if (!forEach(c, [&](const Entry &e) {
+                    if (e.cycle > to)
+                        return false;
+                    if (e.cycle >= from)
+                        f(e);
+                    return true;
+                }))
+                break;
+        }
+    }
+
+    bool firstWriteTo(uint16_t address, Entry &out) const {
+        for (uint64_t i = 0; i < header.chunkCount; i++) {
+            const TraceChunk &c = chunk(i);
+            if (!TraceChunk::test(c.writeBits, address))
+                continue;
+            bool found = false;
+            forEach(c, [&](const Entry &e) {
+                if (e.record->wrote() && e.record->writeAddress() == address) {
+                    out = e;
+                    found = true;
+                    return false;
+                }
+                return true;
+            });
+            if (found)
+                return true;
+        }
+        return false;
+    }
+
+  private:
+    const uint8_t *data;
+    size_t size;
+    TraceHeader header{};
+};
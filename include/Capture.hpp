@@ -0,0 +1,167 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Ppu.hpp"
+
+// Records frames to a file on a writer thread.
+//
+// The emulation thread copies each finished frame (the 60 KiB of colour
+// indices) into the next of a fixed ring of preallocated slots and moves on.
+// The writer thread converts the frame and writes it. If every slot is still
+// waiting to be written, the frame is dropped and counted rather than
+// stalling emulation.
+//
+// Y4M is 4:4:4 at the exact NTSC rate, which ffmpeg and x264 read directly.
+// Raw output is bare RGB24 frames, for
+// `ffmpeg -f rawvideo -pix_fmt rgb24 -s 256x240 -r 60.0988 -i <file>`.
+// A named pipe as the path streams straight into the encoder.
+class FrameCapture {
+  public:
+    enum class Format { Y4M, RawRgb };
+
+    struct Stats {
+        uint64_t written = 0;
+        uint64_t dropped = 0;
+        bool failed = false; // The output stopped accepting data
+    };
+
+    static constexpr size_t kFrameSize = static_cast<size_t>(Ppu::kWidth) * Ppu::kHeight;
+
+    // .y4m files get Y4M, anything else raw RGB.
+    static Format formatFor(const std::string &path) {
+        return path.size() >= 4 && path.compare(path.size() - 4, 4, ".y4m") == 0 ? Format::Y4M : Format::RawRgb;
+    }
+
+    FrameCapture(const std::string &path, Format format, size_t slotCount = 8)
+        : format(format), slots(slotCount), frames(slotCount * kFrameSize), line(kFrameSize * 3) {
+        out = std::fopen(path.c_str(), "wb");
+        if (!out)
+            throw std::runtime_error("Failed to open the capture file.");
+        if (format == Format::Y4M) {
+            // 8:7 is the NES pixel aspect ratio.
+            std::fputs("YUV4MPEG2 W256 H240 F39375000:655171 Ip A8:7 C444\n", out);
+        }
+        writer = std::thread([this] { writeLoop(); });
+    }
+
+    ~FrameCapture() { stop(); }
+
+    FrameCapture(const FrameCapture &) = delete;
+    FrameCapture &operator=(const FrameCapture &) = delete;
+
+    // Called by the emulation thread once per frame. Never blocks; returns
+    // false if the frame was dropped.
+    bool submit(const uint8_t *indices) {
+        const uint64_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == slots) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        std::memcpy(&frames[(t % slots) * kFrameSize], indices, kFrameSize);
+        tail.store(t + 1, std::memory_order_release);
+        wakeups.fetch_add(1, std::memory_order_release);
+        wakeups.notify_one();
+        return true;
+    }
+
+    // Writes the frames still queued and closes the file.
+    void stop() {
+        if (!writer.joinable())
+            return;
+        stopping.store(true, std::memory_order_release);
+        wakeups.fetch_add(1, std::memory_order_release);
+        wakeups.notify_one();
+        writer.join();
+        std::fclose(out);
+    }
+
+    Stats statistics() const {
+        Stats s;
+        s.written = written.load(std::memory_order_relaxed);
+        s.dropped = dropped.load(std::memory_order_relaxed);
+        s.failed = failed.load(std::memory_order_relaxed);
+        return s;
+    }
+
+  private:
+    void writeLoop() {
+        for (;;) {
+            const uint32_t seen = wakeups.load(std::memory_order_acquire);
+            const uint64_t h = head.load(std::memory_order_relaxed);
+            if (h == tail.load(std::memory_order_acquire)) {
+                if (stopping.load(std::memory_order_acquire))
+                    break;
+                wakeups.wait(seen, std::memory_order_acquire);
+                continue;
+            }
+            const uint8_t *frame = &frames[(h % slots) * kFrameSize];
+            if (failed.load(std::memory_order_relaxed)) {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+            } else if (writeFrame(frame)) {
+                written.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                failed.store(true, std::memory_order_relaxed);
+                dropped.fetch_add(1, std::memory_order_relaxed);
+            }
+            head.store(h + 1, std::memory_order_release);
+        }
+        std::fflush(out);
+    }
+
+    bool writeFrame(const uint8_t *frame) {
+        if (format == Format::Y4M) {
+            // Planar Y, then U, then V.
+            for (size_t i = 0; i < kFrameSize; i++) {
+                const std::array<uint8_t, 3> &yuv = kYuv[frame[i] & 0x3F];
+                line[i] = yuv[0];
+                line[kFrameSize + i] = yuv[1];
+                line[2 * kFrameSize + i] = yuv[2];
+            }
+            return std::fputs("FRAME\n", out) >= 0 && std::fwrite(line.data(), 1, line.size(), out) == line.size();
+        }
+        for (size_t i = 0; i < kFrameSize; i++) {
+            const uint32_t rgb = kNesPalette[frame[i] & 0x3F];
+            line[3 * i] = static_cast<uint8_t>(rgb >> 16);
+            line[3 * i + 1] = static_cast<uint8_t>(rgb >> 8);
+            line[3 * i + 2] = static_cast<uint8_t>(rgb);
+        }
+        return std::fwrite(line.data(), 1, line.size(), out) == line.size();
+    }
+
+    // The palette in limited-range BT.601 YCbCr.
+    static constexpr std::array<std::array<uint8_t, 3>, 64> kYuv = [] {
+        std::array<std::array<uint8_t, 3>, 64> table{};
+        for (int i = 0; i < 64; i++) {
+            const int r = static_cast<int>(kNesPalette[i] >> 16 & 0xFF);
+            const int g = static_cast<int>(kNesPalette[i] >> 8 & 0xFF);
+            const int b = static_cast<int>(kNesPalette[i] & 0xFF);
+            table[i][0] = static_cast<uint8_t>(16 + ((66 * r + 129 * g + 25 * b + 128) >> 8));
+            table[i][1] = static_cast<uint8_t>(128 + ((-38 * r - 74 * g + 112 * b + 128) >> 8));
+            table[i][2] = static_cast<uint8_t>(128 + ((112 * r - 94 * g - 18 * b + 128) >> 8));
+        }
+        return table;
+    }();
+
+    Format format;
+    std::FILE *out = nullptr;
+    const size_t slots;
+    std::vector<uint8_t> frames; // slots * kFrameSize colour indices
+    std::vector<uint8_t> line;   // The converted frame, writer thread only
+
+    std::atomic<uint64_t> head{0}; // Next slot to write
+    std::atomic<uint64_t> tail{0}; // Next slot to fill
+    std::atomic<uint32_t> wakeups{0};
+    std::atomic<bool> stopping{false};
+    std::atomic<uint64_t> written{0};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<bool> failed{false};
+    std::thread writer;
+};
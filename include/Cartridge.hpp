@@ -0,0 +1,80 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <fcntl.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "Hash.hpp"
+#include "RomHeader.hpp"
+
+// A ROM image read, validated and split into PRG and CHR, ready to be
+// inserted into an Emulator. Building one touches no emulator state, so it
+// can run on a worker thread while a game keeps playing.
+struct Cartridge {
+    std::vector<uint8_t> header; // The 16 header bytes as found in the file
+    RomHeader info;
+    std::vector<uint8_t> prg;
+    uint32_t prgMask = 0x7FFF;
+    std::vector<uint8_t> chr; // Empty for CHR-RAM
+    uint64_t hash = 0;        // Of the whole image
+
+    // NROM layout: PRG mirrored over $8000-$FFFF, then 8 KiB of CHR.
+    // Images without an iNES header are taken as raw PRG.
+    static Cartridge fromImage(const uint8_t *data, size_t size) {
+        if (size < 16)
+            throw std::runtime_error("The ROM is too small.");
+
+        Cartridge cart;
+        cart.header.assign(data, data + 16);
+        cart.info = RomHeader::parse(data, size);
+        if (cart.info.valid && cart.info.mapper != 0)
+            throw std::runtime_error("Mapper " + std::to_string(cart.info.mapper) + " is not supported.");
+
+        size_t prgStart = 16 + (cart.info.valid && cart.info.trainer ? 512 : 0);
+        size_t prgSize = cart.info.valid ? cart.info.prgSize : size - 16;
+        if (prgStart + prgSize > size)
+            throw std::runtime_error("The ROM is truncated.");
+        cart.prg.assign(data + prgStart, data + prgStart + prgSize);
+        cart.prgMask = (prgSize & (prgSize - 1)) == 0 && prgSize != 0 ? static_cast<uint32_t>(prgSize - 1) : 0x7FFF;
+
+        size_t chrStart = prgStart + prgSize;
+        size_t chrSize = cart.info.valid ? std::min<size_t>(cart.info.chrSize, size - chrStart) : 0;
+        cart.chr.assign(data + chrStart, data + chrStart + chrSize);
+        cart.hash = fnv1a64(data, size);
+        return cart;
+    }
+
+    // Maps the file rather than reading it into a temporary buffer.
+    static Cartridge fromFile(const char *path) {
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("Failed to open the ROM.");
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {
+            ::close(fd);
+            throw std::runtime_error("Failed to read the ROM.");
+        }
+        const auto size = static_cast<size_t>(st.st_size);
+        if (size < 16) {
+            ::close(fd);
+            throw std::runtime_error("The ROM is too small.");
+        }
+        void *mapped = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED)
+            throw std::runtime_error("Failed to read the ROM.");
+        try {
+            Cartridge cart = fromImage(static_cast<const uint8_t *>(mapped), size);
+            ::munmap(mapped, size);
+            return cart;
+        } catch (...) {
+            ::munmap(mapped, size);
+            throw;
+        }
+    }
+};
@@ -0,0 +1,96 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Code/Data Logger: one flag byte per PRG-ROM byte, set from the instrumented
+// core's bus accesses, saved in the FCEUX .cdl layout (PRG flags, then one
+// byte per CHR-ROM byte).
+//
+// PRG flags, bit 0 to 6: executed as code, read as data, two bits for the
+// 8 KiB CPU window it was last accessed through ($8000, $A000, $C000,
+// $E000), jumped to through JMP ($nnnn), read through ($nn,X) or ($nn),Y,
+// played as DPCM samples. The PPU is not instrumented, so the CHR part is
+// written empty, and without an APU nothing is logged as DPCM.
+class CodeDataLogger {
+  public:
+    enum Flag : uint8_t {
+        Code = 0x01,
+        Data = 0x02,
+        IndirectCode = 0x10,
+        IndirectData = 0x20,
+        Pcm = 0x40,
+    };
+
+    // Clears the log and sizes it for a cartridge.
+    void reset(size_t prgSize, size_t chrSize) {
+        prg.assign(prgSize, 0);
+        chr.assign(chrSize, 0);
+    }
+
+    // `offset` is the PRG byte the bus address `addr` maps to.
+    void log(uint32_t offset, uint16_t addr, uint8_t flags) {
+        if (offset < prg.size())
+            prg[offset] |= static_cast<uint8_t>(flags | ((addr >> 13) & 3) << 2);
+    }
+
+    // An instruction of `length` bytes. Nearly every instruction has run
+    // before, which costs one compare.
+    void logCode(uint32_t offset, uint16_t addr, uint8_t length) {
+        const auto flags = static_cast<uint8_t>(Code | ((addr >> 13) & 3) << 2);
+        if (offset + length > prg.size())
+            return;
+        uint8_t *bytes = &prg[offset];
+        if ((bytes[0] & bytes[length - 1] & flags) == flags)
+            return;
+        for (uint8_t i = 0; i < length; i++)
+            bytes[i] |= flags;
+    }
+
+    // Combines the logs of several runs of the same ROM, e.g. parallel ones.
+    void merge(const CodeDataLogger &other) {
+        if (other.prg.size() != prg.size() || other.chr.size() != chr.size())
+            throw std::runtime_error("The code/data logs are for different ROMs.");
+        for (size_t i = 0; i < prg.size(); i++)
+            prg[i] |= other.prg[i];
+        for (size_t i = 0; i < chr.size(); i++)
+            chr[i] |= other.chr[i];
+    }
+
+    // Adds what an earlier run saved to `path`, if anything.
+    void mergeFile(const std::string &path) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in)
+            return;
+        std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        if (bytes.size() != prg.size() + chr.size())
+            throw std::runtime_error("The code/data log in " + path + " is for another ROM.");
+        for (size_t i = 0; i < prg.size(); i++)
+            prg[i] |= bytes[i];
+        for (size_t i = 0; i < chr.size(); i++)
+            chr[i] |= bytes[prg.size() + i];
+    }
+
+    void save(const std::string &path) const {
+        std::ofstream out(path, std::ios::binary);
+        out.write(reinterpret_cast<const char *>(prg.data()), static_cast<std::streamsize>(prg.size()));
+        out.write(reinterpret_cast<const char *>(chr.data()), static_cast<std::streamsize>(chr.size()));
+        if (!out)
+            throw std::runtime_error("Failed to write the code/data log.");
+    }
+
+    const std::vector<uint8_t> &prgFlags() const { return prg; }
+
+    // PRG bytes with any of `flags` set.
+    size_t count(uint8_t flags) const {
+        return static_cast<size_t>(std::count_if(prg.begin(), prg.end(), [flags](uint8_t f) { return (f & flags) != 0; }));
+    }
+
+  private:
+    std::vector<uint8_t> prg;
+    std::vector<uint8_t> chr;
+};
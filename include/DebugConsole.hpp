@@ -0,0 +1,166 @@
+#pragma once
+#include <format>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <string>
+
+#include "Emulator.hpp"
+
+// Line-based debugger front end on stdin/stdout, opened by the Debug button.
+class DebugConsole {
+  public:
+    DebugConsole(Emulator &emu, Debugger &debugger) : emu(emu), debugger(debugger) {}
+
+    void run() {
+        printRegisters();
+        std::string line;
+        while (std::cout << "(dbg) " << std::flush, std::getline(std::cin, line)) {
+            if (!execute(line))
+                break;
+        }
+    }
+
+    // Returns false when the console should close.
+    bool execute(const std::string &line) {
+        std::istringstream in(line);
+        std::string cmd;
+        in >> cmd;
+
+        if (cmd.empty()) {
+            return true;
+        } else if (cmd == "q" || cmd == "quit") {
+            return false;
+        } else if (cmd == "h" || cmd == "help") {
+            std::cout << "b <addr> [if <cond>]   execution breakpoint\n"
+                         "rw|ww|aw <addr> [if <cond>]   read/write/any watchpoint\n"
+                         "l   list, d <n>   delete\n"
+                         "s   step, n   step over, rc <cycle>   run to cycle\n"
+                         "c   continue, r   registers, q   back to the UI\n"
+                         "u [addr] [n]   disassemble n instructions (default: 16 from PC)\n"
+                         "conditions: A|X|Y|SP|P|[addr] ==|!=|<|<=|>|>= value\n";
+        } else if (cmd == "b" || cmd == "rw" || cmd == "ww" || cmd == "aw") {
+            addBreakpoint(cmd, in);
+        } else if (cmd == "l") {
+            const auto &bps = debugger.list();
+            for (size_t i = 0; i < bps.size(); i++) {
+                static const char *kinds[] = {"exec", "read", "write", "access"};
+                std::cout << std::format("{:>2}: {:<6} ${:04X}{}\n", i,
+                                         kinds[bps[i].access], bps[i].address,
+                                         bps[i].condition ? " (conditional)" : "");
+            }
+        } else if (cmd == "d") {
+            size_t index = 0;
+            if (!(in >> index) || !debugger.remove(index))
+                std::cout << "No such breakpoint." << std::endl;
+        } else if (cmd == "s") {
+            emu.stepInstruction();
+            report();
+        } else if (cmd == "n") {
+            emu.stepOver();
+            report();
+        } else if (cmd == "rc") {
+            uint64_t cycle = 0;
+            if (!(in >> cycle)) {
+                std::cout << "Usage: rc <cycle>" << std::endl;
+                return true;
+            }
+            emu.runToCycle(cycle);
+            report();
+        } else if (cmd == "c") {
+            emu.resume();
+            return false;
+        } else if (cmd == "r") {
+            printRegisters();
+        } else if (cmd == "u") {
+            disassemble(in);
+        } else {
+            std::cout << "Unknown command, try 'help'." << std::endl;
+        }
+        return true;
+    }
+
+  private:
+    void addBreakpoint(const std::string &cmd, std::istringstream &in) {
+        std::string where;
+        in >> where;
+        auto address = Debugger::parseNumber(where);
+        if (!address) {
+            std::cout << "Bad address." << std::endl;
+            return;
+        }
+
+        std::optional<Debugger::Condition> condition;
+        std::string word;
+        if (in >> word && word == "if") {
+            std::string rest;
+            std::getline(in, rest);
+            condition = Debugger::parseCondition(rest);
+            if (!condition) {
+                std::cout << "Bad condition." << std::endl;
+                return;
+            }
+        }
+
+        int index;
+        if (cmd == "b")
+            index = debugger.addBreakpoint(*address, condition);
+        else if (cmd == "rw")
+            index = debugger.addWatchpoint(*address, Debugger::Read, condition);
+        else if (cmd == "ww")
+            index = debugger.addWatchpoint(*address, Debugger::Write, condition);
+        else
+            index = debugger.addWatchpoint(*address, Debugger::Read | Debugger::Write,
+                                           condition);
+        std::cout << "Breakpoint " << index << " set." << std::endl;
+    }
+
+    void report() {
+        if (emu.isHalted())
+            std::cout << "CPU halted." << std::endl;
+        else if (emu.isPaused())
+            std::cout << "Stopped: " << debugger.stopReason() << std::endl;
+        printRegisters();
+    }
+
+    void printRegisters() {
+        CpuRegisters r = emu.registers();
+        std::cout << std::format("PC:{:04X} A:{:02X} X:{:02X} Y:{:02X} SP:{:02X} "
+                                 "P:{:02X} CYC:{}\n",
+                                 r.pc, r.a, r.x, r.y, r.sp, r.p, r.cycles);
+        const Disassembler::Line &line = emu.getDisassembler().decode(emu, r.pc);
+        std::cout << formatLine(line) << Disassembler::effectiveAddress(emu, line, r) << std::endl;
+    }
+
+    void disassemble(std::istringstream &in) {
+        uint16_t address = emu.registers().pc;
+        std::string where;
+        if (in >> where) {
+            auto parsed = Debugger::parseNumber(where);
+            if (!parsed) {
+                std::cout << "Bad address." << std::endl;
+                return;
+            }
+            address = *parsed;
+        }
+        int count;
+        if (!(in >> count))
+            count = 16;
+        for (int i = 0; i < count; i++) {
+            const Disassembler::Line &line = emu.getDisassembler().decode(emu, address);
+            std::cout << formatLine(line) << '\n';
+            address = static_cast<uint16_t>(address + line.length);
+        }
+        std::cout << std::flush;
+    }
+
+    static std::string formatLine(const Disassembler::Line &line) {
+        std::string bytes;
+        for (int i = 0; i < 3; i++)
+            bytes += i < line.length ? std::format("{:02X} ", line.bytes[i]) : "   ";
+        return std::format("{:04X}  {} {}", line.address, bytes, line.text);
+    }
+
+    Emulator &emu;
+    Debugger &debugger;
+};
@@ -0,0 +1,299 @@
+#pragma once
+#include <array>
+#include <cctype>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Snapshot of the CPU registers, used by break conditions and the console.
+struct CpuRegisters {
+    uint16_t pc;
+    uint8_t a;
+    uint8_t x;
+    uint8_t y;
+    uint8_t sp;
+    uint8_t p;
+    uint64_t cycles;
+};
+
+// Breakpoints and watchpoints. Only the instrumented core consults this
+// class; the plain core is selected whenever nothing here is armed.
+class Debugger {
+  public:
+    enum Access : uint8_t { Read = 1, Write = 2 };
+
+    // "A == $10", "X < 4", "[$0300] != 0"...
+    struct Condition {
+        enum class Operand : uint8_t { A, X, Y, SP, P, Memory };
+        enum class Op : uint8_t { Eq, Ne, Lt, Le, Gt, Ge };
+
+        Operand lhs = Operand::A;
+        uint16_t address = 0;
+        Op op = Op::Eq;
+        uint16_t value = 0;
+
+        template <class Bus> bool holds(const CpuRegisters &r, const Bus &bus) const {
+            uint16_t v = 0;
+            switch (lhs) {
+            case Operand::A: v = r.a; break;
+            case Operand::X: v = r.x; break;
+            case Operand::Y: v = r.y; break;
+            case Operand::SP: v = r.sp; break;
+            case Operand::P: v = r.p; break;
+            case Operand::Memory: v = bus.peek(address); break;
+            }
+            switch (op) {
+            case Op::Eq: return v == value;
+            case Op::Ne: return v != value;
+            case Op::Lt: return v < value;
+            case Op::Le: return v <= value;
+            case Op::Gt: return v > value;
+            case Op::Ge: return v >= value;
+            }
+            return false;
+        }
+    };
+
+    struct Breakpoint {
+        uint16_t address;
+        uint8_t access; // 0 for execution, otherwise Read | Write
+        std::optional<Condition> condition;
+    };
+
+    int addBreakpoint(uint16_t address, std::optional<Condition> condition = {}) {
+        return add({address, 0, condition});
+    }
+
+    int addWatchpoint(uint16_t address, uint8_t access,
+                      std::optional<Condition> condition = {}) {
+        return add({address, access, condition});
+    }
+
+    bool remove(size_t index) {
+        if (index >= breakpoints.size())
+            return false;
+        breakpoints.erase(breakpoints.begin() + static_cast<long>(index));
+        rebuild();
+        return true;
+    }
+
+    const std::vector<Breakpoint> &list() const { return breakpoints; }
+
+    // True when the instrumented core has to run: something is armed or a
+    // step command is pending.
+    bool active() const { return !breakpoints.empty() || stepMode != StepMode::None; }
+
+    /*
+     * Stepping commands. They are consumed by the instrumented core, which
+     * pauses the emulator once the target is reached.
+     */
+
+    void requestStep() { stepMode = StepMode::Instruction; }
+
+    void requestStepOver(uint16_t returnAddress, uint8_t sp) {
+        stepMode = StepMode::Over;
+        stepTarget = returnAddress;
+        stepStack = sp;
+    }
+
+    void requestRunToCycle(uint64_t cycle) {
+        stepMode = StepMode::Cycle;
+        targetCycle = cycle;
+    }
+
+    void clearStep() { stepMode = StepMode::None; }
+
+    // Called before an instruction executes; true means stop before it.
+    template <class Bus> bool checkExecution(const CpuRegisters &r, const Bus &bus) {
+        if (skipOnce) {
+            skipOnce = false;
+            return false;
+        }
+
+        switch (stepMode) {
+        case StepMode::None:
+        case StepMode::Instruction:
+            break;
+        case StepMode::Over:
+            if (r.pc == stepTarget && r.sp >= stepStack)
+                return stop("step over done");
+            break;
+        case StepMode::Cycle:
+            if (r.cycles >= targetCycle)
+                return stop("cycle reached");
+            break;
+        }
+
+        if (!(execBits[r.pc >> 6] & (1ull << (r.pc & 63))))
+            return false;
+        for (const Breakpoint &bp : breakpoints) {
+            if (bp.access == 0 && bp.address == r.pc &&
+                (!bp.condition || bp.condition->holds(r, bus)))
+                return stop("breakpoint");
+        }
+        return false;
+    }
+
+    // Called after an instruction executed; single-step stops here.
+    bool checkStepped() {
+        if (stepMode == StepMode::Instruction)
+            return stop("step");
+        return false;
+    }
+
+    // Only reached for accesses inside a trapped page.
+    bool trapped(uint16_t address, uint8_t access) const {
+        return (pageTraps[address >> 8] & access) != 0;
+    }
+
+    template <class Bus>
+    void checkAccess(uint16_t address, uint8_t access, const CpuRegisters &r,
+                     const Bus &bus) {
+        for (const Breakpoint &bp : breakpoints) {
+            if ((bp.access & access) && bp.address == address &&
+                (!bp.condition || bp.condition->holds(r, bus))) {
+                watchHit = true;
+                lastAddress = address;
+                reason = access == Write ? "write watchpoint" : "read watchpoint";
+            }
+        }
+    }
+
+    // Watchpoints let the instruction finish, then stop.
+    bool consumeWatchHit() {
+        bool hit = watchHit;
+        watchHit = false;
+        if (hit)
+            stepMode = StepMode::None;
+        return hit;
+    }
+
+    // Resuming from a breakpoint must not hit the same breakpoint again.
+    void resumed() { skipOnce = true; }
+
+    const std::string &stopReason() const { return reason; }
+    uint16_t stopAddress() const { return lastAddress; }
+
+    static std::optional<Condition> parseCondition(const std::string &text) {
+        std::string s;
+        for (char c : text) {
+            if (c != ' ' && c != '\t')
+                s += c;
+        }
+        if (s.empty())
+            return std::nullopt;
+
+        static const std::pair<const char *, Condition::Op> ops[] = {
+            {"==", Condition::Op::Eq}, {"!=", Condition::Op::Ne},
+            {"<=", Condition::Op::Le}, {">=", Condition::Op::Ge},
+            {"<", Condition::Op::Lt},  {">", Condition::Op::Gt},
+        };
+
+        Condition c;
+        size_t opPos = std::string::npos;
+        size_t opLen = 0;
+        for (const auto &[token, op] : ops) {
+            opPos = s.find(token);
+            if (opPos != std::string::npos) {
+                c.op = op;
+                opLen = std::char_traits<char>::length(token);
+                break;
+            }
+        }
+        if (opPos == std::string::npos)
+            return std::nullopt;
+
+        std::string lhs = s.substr(0, opPos);
+        std::string rhs = s.substr(opPos + opLen);
+        for (char &ch : lhs)
+            ch = static_cast<char>(std::toupper(static_cast<unsigned char>(ch)));
+
+        if (lhs == "A")
+            c.lhs = Condition::Operand::A;
+        else if (lhs == "X")
+            c.lhs = Condition::Operand::X;
+        else if (lhs == "Y")
+            c.lhs = Condition::Operand::Y;
+        else if (lhs == "SP" || lhs == "S")
+            c.lhs = Condition::Operand::SP;
+        else if (lhs == "P")
+            c.lhs = Condition::Operand::P;
+        else if (lhs.size() > 2 && lhs.front() == '[' && lhs.back() == ']') {
+            auto address = parseNumber(lhs.substr(1, lhs.size() - 2));
+            if (!address)
+                return std::nullopt;
+            c.lhs = Condition::Operand::Memory;
+            c.address = *address;
+        } else {
+            return std::nullopt;
+        }
+
+        auto value = parseNumber(rhs);
+        if (!value)
+            return std::nullopt;
+        c.value = *value;
+        return c;
+    }
+
+    // "$C000", "0xC000" and "49152" are all accepted.
+    static std::optional<uint16_t> parseNumber(const std::string &text) {
+        if (text.empty())
+            return std::nullopt;
+        bool hex = text[0] == '$';
+        std::string digits = hex ? text.substr(1) : text;
+        try {
+            size_t used = 0;
+            unsigned long v = std::stoul(digits, &used, hex ? 16 : 0);
+            if (used != digits.size() || v > 0xFFFF)
+                return std::nullopt;
+            return static_cast<uint16_t>(v);
+        } catch (const std::exception &) {
+            return std::nullopt;
+        }
+    }
+
+  private:
+    enum class StepMode : uint8_t { None, Instruction, Over, Cycle };
+
+    int add(const Breakpoint &bp) {
+        breakpoints.push_back(bp);
+        rebuild();
+        return static_cast<int>(breakpoints.size() - 1);
+    }
+
+    bool stop(const char *why) {
+        reason = why;
+        stepMode = StepMode::None;
+        return true;
+    }
+
+    // Execution breakpoints live in a 64K-bit map; watchpoints mark the whole
+    // 256-byte page as trapping so untouched pages never reach the list.
+    void rebuild() {
+        execBits.fill(0);
+        pageTraps.fill(0);
+        for (const Breakpoint &bp : breakpoints) {
+            if (bp.access == 0)
+                execBits[bp.address >> 6] |= 1ull << (bp.address & 63);
+            else
+                pageTraps[bp.address >> 8] |= bp.access;
+        }
+    }
+
+    std::vector<Breakpoint> breakpoints;
+    std::array<uint64_t, 0x10000 / 64> execBits{};
+    std::array<uint8_t, 0x100> pageTraps{};
+
+    StepMode stepMode = StepMode::None;
+    uint16_t stepTarget = 0;
+    uint8_t stepStack = 0;
+    uint64_t targetCycle = 0;
+
+    bool skipOnce = false;
+    bool watchHit = false;
+    uint16_t lastAddress = 0;
+    std::string reason;
+};
@@ -0,0 +1,156 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "Debugger.hpp"
+#include "Labels.hpp"
+#include "OpcodeTable.hpp"
+
+// 6502 disassembler for the trace and the debug console.
+//
+// Formatting is the costly part, so lines are kept in a direct-mapped cache
+// by address. A cached line is used only while the bytes it was made from
+// are still in memory, so code written to RAM or a bank switched in under
+// the address is picked up without any notification. Effective addresses
+// depend on the registers and are worked out on every call instead.
+class Disassembler {
+  public:
+    struct Line {
+        uint16_t address = 0;
+        uint8_t length = 0;
+        uint8_t bytes[3] = {};
+        std::string text; // "LDA $0300,X", with labels in place of addresses
+    };
+
+    // Names used for operands; the labels must outlive the disassembler.
+    void setLabels(const Labels *names) {
+        labels = names;
+        cache.clear();
+    }
+
+    // `bus` is anything with a side-effect free `uint8_t peek(uint16_t)`.
+    template <class Bus> const Line &decode(const Bus &bus, uint16_t address) {
+        if (cache.empty())
+            cache.resize(kCacheSize);
+        const uint8_t opcode = bus.peek(address);
+        const uint8_t length = instructionLength(kOpcodeModes[opcode]);
+        uint8_t bytes[3] = {opcode, 0, 0};
+        for (uint8_t i = 1; i < length; i++)
+            bytes[i] = bus.peek(static_cast<uint16_t>(address + i));
+
+        Line &line = cache[address & (kCacheSize - 1)];
+        if (line.length == length && line.address == address && line.bytes[0] == bytes[0] &&
+            line.bytes[1] == bytes[1] && line.bytes[2] == bytes[2]) {
+            hits++;
+            return line;
+        }
+        misses++;
+        line.address = address;
+        line.length = length;
+        for (int i = 0; i < 3; i++)
+            line.bytes[i] = bytes[i];
+        line.text = format(address, bytes);
+        return line;
+    }
+
+    // " @ $0305 = #$12" for the operand of the instruction at the current PC:
+    // the address it accesses (when indexed or indirect) and the value there.
+    template <class Bus> static std::string effectiveAddress(const Bus &bus, const Line &line, const CpuRegisters &r) {
+        const uint16_t operand = static_cast<uint16_t>(line.bytes[1] | line.bytes[2] << 8);
+        const AddressingMode mode = kOpcodeModes[line.bytes[0]];
+        uint16_t target;
+        bool indexed = true;
+        switch (mode) {
+        case AddressingMode::ZeroPage: target = line.bytes[1]; indexed = false; break;
+        case AddressingMode::ZeroPageX: target = static_cast<uint8_t>(line.bytes[1] + r.x); break;
+        case AddressingMode::ZeroPageY: target = static_cast<uint8_t>(line.bytes[1] + r.y); break;
+        case AddressingMode::Absolute:
+            // JMP and JSR name their target; there is no data to show.
+            if (line.bytes[0] == 0x4C || line.bytes[0] == 0x20)
+                return {};
+            target = operand;
+            indexed = false;
+            break;
+        case AddressingMode::AbsoluteX: target = static_cast<uint16_t>(operand + r.x); break;
+        case AddressingMode::AbsoluteY: target = static_cast<uint16_t>(operand + r.y); break;
+        case AddressingMode::IndexedIndirect: {
+            const auto pointer = static_cast<uint8_t>(line.bytes[1] + r.x);
+            target = static_cast<uint16_t>(bus.peek(pointer) | bus.peek(static_cast<uint8_t>(pointer + 1)) << 8);
+            break;
+        }
+        case AddressingMode::IndirectIndexed: {
+            const uint16_t base = static_cast<uint16_t>(bus.peek(line.bytes[1]) |
+                                                        bus.peek(static_cast<uint8_t>(line.bytes[1] + 1)) << 8);
+            target = static_cast<uint16_t>(base + r.y);
+            break;
+        }
+        case AddressingMode::Indirect: {
+            // The 6502 does not carry into the high byte of the pointer.
+            const auto high = static_cast<uint16_t>((operand & 0xFF00) | ((operand + 1) & 0x00FF));
+            target = static_cast<uint16_t>(bus.peek(operand) | bus.peek(high) << 8);
+            char buffer[16];
+            std::snprintf(buffer, sizeof(buffer), " -> $%04X", target);
+            return buffer;
+        }
+        default:
+            return {};
+        }
+        char buffer[32];
+        if (indexed)
+            std::snprintf(buffer, sizeof(buffer), " @ $%04X = #$%02X", target, bus.peek(target));
+        else
+            std::snprintf(buffer, sizeof(buffer), " = #$%02X", bus.peek(target));
+        return buffer;
+    }
+
+    uint64_t cacheHits() const { return hits; }
+    uint64_t cacheMisses() const { return misses; }
+
+  private:
+    static constexpr size_t kCacheSize = 4096;
+
+    std::string format(uint16_t address, const uint8_t *bytes) const {
+        const AddressingMode mode = kOpcodeModes[bytes[0]];
+        const uint16_t operand = static_cast<uint16_t>(bytes[1] | bytes[2] << 8);
+        std::string text = kOpcodeMnemonics[bytes[0]];
+        switch (mode) {
+        case AddressingMode::Implied: break;
+        case AddressingMode::Accumulator: text += " A"; break;
+        case AddressingMode::Immediate: text += " #" + hex(bytes[1], 2); break;
+        case AddressingMode::ZeroPage: text += " " + name(bytes[1], 2); break;
+        case AddressingMode::ZeroPageX: text += " " + name(bytes[1], 2) + ",X"; break;
+        case AddressingMode::ZeroPageY: text += " " + name(bytes[1], 2) + ",Y"; break;
+        case AddressingMode::Absolute: text += " " + name(operand, 4); break;
+        case AddressingMode::AbsoluteX: text += " " + name(operand, 4) + ",X"; break;
+        case AddressingMode::AbsoluteY: text += " " + name(operand, 4) + ",Y"; break;
+        case AddressingMode::Indirect: text += " (" + name(operand, 4) + ")"; break;
+        case AddressingMode::IndexedIndirect: text += " (" + name(bytes[1], 2) + ",X)"; break;
+        case AddressingMode::IndirectIndexed: text += " (" + name(bytes[1], 2) + "),Y"; break;
+        case AddressingMode::Relative:
+            text += " " + name(static_cast<uint16_t>(address + 2 + static_cast<int8_t>(bytes[1])), 4);
+            break;
+        }
+        return text;
+    }
+
+    std::string name(uint16_t address, int digits) const {
+        if (labels) {
+            if (const std::string *label = labels->find(address))
+                return *label;
+        }
+        return hex(address, digits);
+    }
+
+    static std::string hex(uint16_t value, int digits) {
+        char buffer[8];
+        std::snprintf(buffer, sizeof(buffer), "$%0*X", digits, value);
+        return buffer;
+    }
+
+    const Labels *labels = nullptr;
+    std::vector<Line> cache;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+};
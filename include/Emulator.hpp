@@ -1,4 +1,7 @@
 #pragma once
+#include <algorithm>
+#include <array>
+#include <chrono>
 #include <cmath>
 #include <cstdint>
 #include <cstdio>
@@ -10,7 +13,33 @@
 #include <sys/types.h>
 #include <vector>
 
-#include "Tracelogger.cpp"
+#include "BinaryTrace.hpp"
+#include "Cartridge.hpp"
+#include "CodeDataLogger.hpp"
+#include "Debugger.hpp"
+#include "FlatBus.hpp"
+#include "Disassembler.hpp"
+#include "Hash.hpp"
+#include "Input.hpp"
+#include "OpcodeTable.hpp"
+#include "RomHeader.hpp"
+#include "Ppu.hpp"
+#include "PpuPipeline.hpp"
+#include "Profiler.hpp"
+#include "Scheduler.hpp"
+
+// Instruction stepping runs each instruction as one step and adds its cycles
+// at the end. Cycle stepping advances the clock on every bus access and lets
+// due events land between them, so reads and writes happen on their own cycle.
+// It also makes the dummy accesses that can reach a device: the read from
+// the uncarried address of indexed absolute accesses, and the write of the
+// unchanged value by read-modify-writes. The other dummy reads (of the next
+// opcode byte, the stack and zero page) only ever reach ROM or RAM and are
+// left out.
+// Flat steps like Instruction, dummy accesses included, but on an attached
+// FlatBus instead of the NES memory map, for CPU conformance tests; the
+// emulator never runs in it.
+enum class Stepping : uint8_t { Instruction, Cycle, Flat };
 
 class Emulator {
   public:
@@ -23,23 +52,61 @@ class Emulator {
         RAM.assign(0x0800, 0);
     }
 
-    void reset(const char *rom_filename) {
-        std::ifstream file(rom_filename, std::ios::binary | std::ios::ate);
-        if (!file)
-            throw std::runtime_error("Failed to open the ROM.");
-
-        std::streamsize size = file.tellg();
-        file.seekg(0, std::ios::beg);
-
-        std::vector<uint8_t> buffer(static_cast<size_t>(size));
-        if (!file.read(reinterpret_cast<char *>(buffer.data()), size))
-            throw std::runtime_error("Failed to read the ROM.");
+    // Loads a ROM and powers the console on, without running it.
+    void loadROM(const char *rom_filename) { insert(Cartridge::fromFile(rom_filename)); }
+
+    void loadROM(const std::vector<uint8_t> &buffer) { insert(Cartridge::fromImage(buffer.data(), buffer.size())); }
+
+    // Swaps in a prepared cartridge and powers the console on. Only a few
+    // moves and an 8 KiB copy, so it fits between two frames.
+    void insert(Cartridge cart) {
+        INesHeader = std::move(cart.header);
+        ROM = std::move(cart.prg);
+        prgMask = cart.prgMask;
+        ppu.setCartridge(cart.chr.empty() ? nullptr : cart.chr.data(), cart.chr.size(), cart.info.verticalMirroring,
+                         cart.info.fourScreen);
+        romHash = cart.hash;
+        chrRomSize = cart.chr.size();
+        if (cdl)
+            cdl->reset(ROM.size(), chrRomSize);
+
+        powerOn();
+    }
 
-        std::vector<uint8_t> header(buffer.begin(), buffer.begin() + 16);
-        std::vector<uint8_t> rest(buffer.begin() + 16, buffer.end());
+    void reset(const char *rom_filename) {
+        loadROM(rom_filename);
+        run();
+    }
 
-        INesHeader = header;
-        ROM = rest;
+    void powerOn() {
+        RAM.assign(0x0800, 0);
+        A = 0;
+        X = 0;
+        Y = 0;
+        flag_Carry = false;
+        flag_Zero = false;
+        flag_Decimal = false;
+        flag_Overflow = false;
+        flag_Negative = false;
+        CpuHalted = false;
+        paused = false;
+        cycleCount = 0;
+        frameCount = 0;
+        frameEnded = false;
+        controllerShift[0] = controllerShift[1] = 0;
+        controllerStrobe = false;
+        ppu.reset();
+        if (pipeline)
+            pipeline->restart(ppu);
+        scanline = 0;
+        frameCounterMode = 0;
+        frameIrq = false;
+        nmiPending = false;
+
+        scheduler.clear();
+        scheduler.schedule(Scheduler::Event::VBlankStart, dotToCycle(kVBlankStartDot));
+        scheduler.schedule(Scheduler::Event::Scanline, dotToCycle(kLineRenderDot));
+        scheduler.schedule(Scheduler::Event::ApuFrameIrq, kFrameIrqPeriod - 1);
 
         uint8_t PCL = read(0xFFFC);
         uint8_t PCH = read(0xFFFD);
@@ -49,16 +116,19 @@ class Emulator {
         stackPointer = 0xFD;
 
         flag_InterruptDisable = true;
-
-        run();
+        loaded = true;
     }
 
-    uint8_t read(const uint16_t addr) const {
+    // Side-effect free view of the bus, for debuggers and hashing.
+    uint8_t peek(const uint16_t addr) const {
         if (addr <= 0x1FFF) {
             return RAM[addr & 0x07FF];
         }
+        if (addr <= 0x3FFF) {
+            return ppu.peekRegister(addr);
+        }
         if (addr >= 0x8000) {
-            const auto romIndex = static_cast<uint32_t>(addr - 0x8000);
+            const auto romIndex = static_cast<uint32_t>(addr - 0x8000) & prgMask;
             if (romIndex < ROM.size())
                 return ROM[romIndex];
             return 0;
@@ -66,65 +136,651 @@ class Emulator {
         return 0x0;
     }
 
-    void write(uint16_t addr, uint8_t value) { RAM[addr & 0x07FF] = value; }
+    uint8_t read(const uint16_t addr) {
+        if (addr == 0x4016 || addr == 0x4017) {
+            const int port = addr & 1;
+            if (controllerStrobe)
+                controllerShift[port] = controllerState[port];
+            // Bits 5-7 are open bus, usually the high byte of the address.
+            uint8_t value = static_cast<uint8_t>(0x40 | (controllerShift[port] & 1));
+            controllerShift[port] = static_cast<uint8_t>(0x80 | (controllerShift[port] >> 1));
+            return value;
+        }
+        if (addr >= 0x2000 && addr <= 0x3FFF) {
+            if (pipeline)
+                pipeline->push(PpuPipeline::Op::Read, addr);
+            return ppu.readRegister(addr);
+        }
+        if (addr == 0x4015) {
+            uint8_t value = frameIrq ? 0x40 : 0;
+            frameIrq = false;
+            return value;
+        }
+        return peek(addr);
+    }
+
+    void write(uint16_t addr, uint8_t value) {
+        if (addr <= 0x1FFF) {
+            RAM[addr & 0x07FF] = value;
+        } else if (addr == 0x4016) {
+            controllerStrobe = (value & 1) != 0;
+            if (controllerStrobe && input) {
+                uint16_t buttons = input->latch();
+                controllerState[0] = static_cast<uint8_t>(buttons);
+                controllerState[1] = static_cast<uint8_t>(buttons >> 8);
+            }
+            if (controllerStrobe) {
+                controllerShift[0] = controllerState[0];
+                controllerShift[1] = controllerState[1];
+            }
+        } else if (addr <= 0x3FFF) {
+            // Enabling NMI during VBlank raises one right away.
+            bool nmiWasEnabled = ppu.nmiEnabled();
+            ppu.writeRegister(addr, value);
+            if (pipeline)
+                pipeline->push(PpuPipeline::Op::Write, addr, value);
+            if ((addr & 7) == 0 && !nmiWasEnabled && ppu.nmiEnabled() && ppu.inVBlank())
+                raiseNmi();
+        } else if (addr == 0x4014) {
+            // OAM DMA: 256 bytes from the page, the CPU stalls meanwhile.
+            const auto page = static_cast<uint16_t>(value << 8);
+            for (int i = 0; i < 256; i++) {
+                const uint8_t byte = peek(static_cast<uint16_t>(page | i));
+                ppu.writeOam(byte);
+                if (pipeline)
+                    pipeline->push(PpuPipeline::Op::Oam, 0, byte);
+            }
+            cycleCount += 513 + (cycleCount & 1);
+        } else if (addr == 0x4017) {
+            frameCounterMode = value;
+            if (value & 0x40)
+                frameIrq = false;
+            // Only the 4-step sequence raises the frame IRQ.
+            if (value & 0xC0)
+                scheduler.cancel(Scheduler::Event::ApuFrameIrq);
+            else
+                scheduler.schedule(Scheduler::Event::ApuFrameIrq, cycleCount + kFrameIrqPeriod - 1);
+        }
+    }
+
+    // Standard controller buttons, bit 0 to 7: A, B, Select, Start, Up,
+    // Down, Left, Right.
+    void setInput(uint8_t port1, uint8_t port2) {
+        controllerState[0] = port1;
+        controllerState[1] = port2;
+    }
+
+    uint8_t getInput(int port) const { return controllerState[port & 1]; }
+
+    // Live input, sampled whenever the game strobes the controllers. While
+    // attached it overrides setInput().
+    void attachInput(InputState *state) { input = state; }
+
+    // Memory for emulate_cpu<false, Stepping::Flat>().
+    void attachFlatBus(FlatBus *bus) { flatBus = bus; }
+
+    // Every CPU bus access. With cycle stepping, each one takes a cycle and
+    // events due by then are handled first.
+    template <Stepping Mode> void tick() {
+        if constexpr (Mode == Stepping::Cycle) {
+            if (cycleCount >= scheduler.nextDeadline())
+                handleDueEvents();
+            cycleCount++;
+        }
+    }
+
+    template <Stepping Mode> uint8_t cpuRead(uint16_t addr) {
+        tick<Mode>();
+        if constexpr (Mode == Stepping::Flat)
+            return flatBus->read(addr);
+        else
+            return read(addr);
+    }
+
+    template <Stepping Mode> void cpuWrite(uint16_t addr, uint8_t value) {
+        tick<Mode>();
+        if constexpr (Mode == Stepping::Flat)
+            flatBus->write(addr, value);
+        else
+            write(addr, value);
+    }
+
+    // Data accesses made by instructions. The plain core goes straight to
+    // read/write; the instrumented one also reports trapped pages.
+    template <bool Instrumented, Stepping Mode = Stepping::Instruction> uint8_t busRead(uint16_t addr) {
+        uint8_t value = cpuRead<Mode>(addr);
+        if constexpr (Instrumented) {
+            if (cdl && addr >= 0x8000)
+                cdl->log(prgOffset(addr), addr, cdlIndirect ? CodeDataLogger::Data | CodeDataLogger::IndirectData : CodeDataLogger::Data);
+            if (debugger && debugger->trapped(addr, Debugger::Read))
+                debugger->checkAccess(addr, Debugger::Read, registers(), *this);
+        }
+        return value;
+    }
 
-    void push(uint8_t value) {
-        write(static_cast<uint16_t>(0x100 + stackPointer), value);
+    // Read-modify-writes write their operand back unchanged on the cycle
+    // after reading it, then write the result.
+    template <bool Instrumented, Stepping Mode = Stepping::Instruction> uint8_t busReadModify(uint16_t addr) {
+        const uint8_t value = busRead<Instrumented, Mode>(addr);
+        if constexpr (Mode != Stepping::Instruction)
+            cpuWrite<Mode>(addr, value);
+        return value;
+    }
+
+    template <bool Instrumented, Stepping Mode = Stepping::Instruction> void busWrite(uint16_t addr, uint8_t value) {
+        // Stores and read-modify-writes always write on their last cycle;
+        // the internal cycles before it have no bus access of their own here.
+        if constexpr (Mode == Stepping::Cycle) {
+            if (cycleCount < lastInstructionCycle)
+                cycleCount = lastInstructionCycle;
+        }
+        cpuWrite<Mode>(addr, value);
+        if constexpr (Instrumented) {
+            if (traceWriter)
+                traceWriter->noteWrite(addr, value);
+            if (debugger && debugger->trapped(addr, Debugger::Write))
+                debugger->checkAccess(addr, Debugger::Write, registers(), *this);
+        }
+    }
+
+    template <Stepping Mode = Stepping::Instruction> void push(uint8_t value) {
+        cpuWrite<Mode>(static_cast<uint16_t>(0x100 + stackPointer), value);
         stackPointer--;
     }
 
-    uint8_t pull() {
+    template <Stepping Mode = Stepping::Instruction> uint8_t pull() {
         stackPointer++;
-        return read(static_cast<uint16_t>(0x100 + stackPointer));
+        return cpuRead<Mode>(static_cast<uint16_t>(0x100 + stackPointer));
     }
 
     void run() {
-        while (!CpuHalted) {
-            emulate_cpu();
+        paused = false;
+        while (!CpuHalted && !paused) {
+            runFrame();
         }
-        return;
     }
 
-    void readAbsolute(uint16_t *addr) {
-        *addr = read(ProgramCounter);
+    // Runs until the end of the current video frame, a debugger stop or a
+    // halt. An NTSC frame is 341 * 262 PPU dots, three dots per CPU cycle.
+    // Without `picture` the frame buffer is left as it was: the PPU goes
+    // through each line without drawing it, which keeps VBlank, sprite 0 hit
+    // and scrolling exact. For frames that are skipped, not shown.
+    void runFrame(bool picture = true) {
+        drawPicture = picture;
+        scheduler.schedule(Scheduler::Event::FrameEnd, dotToCycle((frameCount + 1) * kDotsPerFrame));
+        paused = false;
+        while (!CpuHalted && !paused) {
+            // The instrumented core is only selected when something is
+            // attached, so the plain loop carries no profiling or debugging
+            // branches at all.
+            if (instrumented())
+                runSlice<true>(scheduler.nextDeadline());
+            else
+                runSlice<false>(scheduler.nextDeadline());
+            if (CpuHalted || paused)
+                break;
+            if (dispatchEvents())
+                break;
+        }
+        // The frame buffer is read once this returns.
+        if (pipeline)
+            pipeline->sync();
+    }
+
+    template <bool Instrumented> void runSlice(uint64_t deadline) {
+        if (stepping == Stepping::Cycle)
+            runUntil<Instrumented, Stepping::Cycle>(deadline);
+        else
+            runUntil<Instrumented, Stepping::Instruction>(deadline);
+    }
+
+    // Executes instructions until the cycle counter reaches the deadline.
+    // Nothing else is checked in between: devices that need the CPU's
+    // attention schedule an event instead.
+    template <bool Instrumented, Stepping Mode> void runUntil(uint64_t deadline) {
+        while (cycleCount < deadline && !CpuHalted) {
+            const uint16_t pc = ProgramCounter;
+            emulate_cpu<Instrumented, Mode>();
+            if constexpr (Instrumented) {
+                if (paused)
+                    return;
+            }
+            if constexpr (Mode == Stepping::Instruction) {
+                // Only a jump back onto itself or over one 2-3 byte
+                // instruction can close an idle loop.
+                const auto back = static_cast<uint16_t>(pc - ProgramCounter);
+                if ((back == 0 || back == 2 || back == 3) && idleSkip && !tracing)
+                    skipIdleLoop<Instrumented>(pc, deadline);
+            }
+        }
+    }
+
+    // Called after the instruction at `jump` went back to ProgramCounter.
+    // If that closes a loop that can only end through an interrupt (JMP *, a
+    // branch to itself, or a load from RAM or $2002 and a branch back to it),
+    // every pass until the deadline is the same as the last one, so they are
+    // skipped by advancing the clock. One pass runs for real first, so flags
+    // and the $2002 read side effects are settled; the loop is only skipped
+    // if the next pass would read the same value again. Nothing outside the
+    // CPU changes before the deadline, so the results are identical.
+    template <bool Instrumented> void skipIdleLoop(uint16_t jump, uint64_t deadline) {
+        if constexpr (Instrumented) {
+            if (traceWriter || (debugger && debugger->active()))
+                return;
+        }
+        const uint16_t start = ProgramCounter;
+        const uint8_t jumpOpcode = peek(jump);
+        if (jumpOpcode != 0x4C && (jumpOpcode & 0x1F) != 0x10)
+            return;
+        uint16_t source = 0;
+        if (start != jump) {
+            if ((jumpOpcode & 0x1F) != 0x10)
+                return;
+            switch (peek(start)) {
+            case 0xA5: case 0xA6: case 0xA4: case 0x24: // LDA/LDX/LDY/BIT zero page
+                if (jump - start != 2)
+                    return;
+                source = peek(static_cast<uint16_t>(start + 1));
+                break;
+            case 0xAD: case 0xAE: case 0xAC: case 0x2C: // LDA/LDX/LDY/BIT absolute
+                if (jump - start != 3)
+                    return;
+                source = static_cast<uint16_t>(peek(static_cast<uint16_t>(start + 1)) |
+                                               peek(static_cast<uint16_t>(start + 2)) << 8);
+                if (source >= 0x2000 && (source & 0xE007) != 0x2002)
+                    return;
+                break;
+            default:
+                return;
+            }
+        }
+        // Room for the real pass and at least one more.
+        if (cycleCount + 16 > deadline)
+            return;
+
+        const uint8_t value = peek(source);
+        const uint64_t passStart = cycleCount;
+        uint64_t loadCycles = 0;
+        if (start != jump) {
+            emulate_cpu<Instrumented, Stepping::Instruction>();
+            loadCycles = cycleCount - passStart;
+        }
+        emulate_cpu<Instrumented, Stepping::Instruction>();
+        if (ProgramCounter != start || (start != jump && peek(source) != value))
+            return;
+
+        const uint64_t pass = cycleCount - passStart;
+        const uint64_t passes = (deadline - cycleCount) / pass;
+        if (passes == 0)
+            return;
+        cycleCount += passes * pass;
+        idleStats.loops++;
+        idleStats.cycles += passes * pass;
+        if constexpr (Instrumented) {
+            if (profiler) {
+                if (start != jump) {
+                    profiler->beginInstruction(start);
+                    profiler->endInstruction(static_cast<int>(passes * loadCycles));
+                }
+                profiler->beginInstruction(jump);
+                profiler->endInstruction(static_cast<int>(passes * (pass - loadCycles)));
+                profiler->onIdleSkip(passes * pass);
+            }
+        }
+    }
+
+    // Handles every event due by now, then takes a pending interrupt.
+    // Returns true once the frame is over.
+    bool dispatchEvents() {
+        handleDueEvents();
+
+        if (nmiPending) {
+            nmiPending = false;
+            interrupt(0xFFFA);
+        } else if (frameIrq && !flag_InterruptDisable) {
+            interrupt(0xFFFE);
+        }
+
+        bool frameOver = frameEnded;
+        frameEnded = false;
+        return frameOver;
+    }
+
+    // Applies the effect of due events. Cycle stepping also calls this in
+    // the middle of an instruction, so interrupts are left to dispatchEvents.
+    void handleDueEvents() {
+        Scheduler::Event event;
+        uint64_t due;
+        while (scheduler.popDue(cycleCount, event, due)) {
+            switch (event) {
+            case Scheduler::Event::FrameEnd:
+                frameCount++;
+                frameEnded = true;
+                break;
+            case Scheduler::Event::VBlankStart:
+                ppu.startVBlank();
+                if (pipeline)
+                    pipeline->push(PpuPipeline::Op::VBlank);
+                if (ppu.nmiEnabled())
+                    raiseNmi();
+                scheduler.schedule(Scheduler::Event::VBlankEnd,
+                                   dotToCycle(frameStartDot() + kVBlankEndDot));
+                break;
+            case Scheduler::Event::VBlankEnd:
+                ppu.startFrame();
+                if (pipeline)
+                    pipeline->push(PpuPipeline::Op::Frame);
+                scheduler.schedule(Scheduler::Event::VBlankStart,
+                                   dotToCycle(frameStartDot() + kDotsPerFrame + kVBlankStartDot));
+                break;
+            case Scheduler::Event::Scanline:
+                if (ppuTiming) {
+                    const auto begin = std::chrono::steady_clock::now();
+                    drawScanline();
+                    ppuTime += std::chrono::steady_clock::now() - begin;
+                } else {
+                    drawScanline();
+                }
+                // After the last visible line, the next one is in the next frame.
+                if (++scanline == Ppu::kHeight) {
+                    scanline = 0;
+                    scheduler.schedule(Scheduler::Event::Scanline,
+                                       dotToCycle(frameStartDot() + kDotsPerFrame + kLineRenderDot));
+                } else {
+                    scheduler.schedule(Scheduler::Event::Scanline,
+                                       dotToCycle(frameStartDot() + scanline * 341 + kLineRenderDot));
+                }
+                break;
+            case Scheduler::Event::ApuFrameIrq:
+                frameIrq = true;
+                scheduler.schedule(Scheduler::Event::ApuFrameIrq, due + kFrameIrqPeriod);
+                break;
+            case Scheduler::Event::IrqPoll:
+            case Scheduler::Event::Count:
+                break;
+            }
+        }
+    }
+
+    void drawScanline() {
+        if (pipeline) {
+            ppu.advanceScanline(scanline);
+            pipeline->push(drawPicture ? PpuPipeline::Op::Scanline : PpuPipeline::Op::Advance,
+                           static_cast<uint16_t>(scanline));
+        } else if (drawPicture) {
+            ppu.renderScanline(scanline, &frameBuffer[static_cast<size_t>(scanline) * Ppu::kWidth]);
+        } else {
+            ppu.advanceScanline(scanline);
+        }
+    }
+
+    // NMI and IRQ entry: like BRK, but the pushed status has B clear.
+    void interrupt(uint16_t vector) {
+        push(static_cast<uint8_t>(ProgramCounter >> 8));
+        push(static_cast<uint8_t>(ProgramCounter));
+        push(static_cast<uint8_t>(statusByte() & ~0x10));
+        flag_InterruptDisable = true;
+        ProgramCounter = static_cast<uint16_t>(read(vector) | read(static_cast<uint16_t>(vector + 1)) << 8);
+        cycleCount += 7;
+        if (profiler)
+            profiler->onInterrupt(ProgramCounter);
+    }
+
+    // Fingerprint of everything that determines future execution.
+    uint64_t stateHash() const {
+        CpuRegisters r = registers();
+        uint64_t hash = fnv1a64(&r.pc, sizeof(r.pc));
+        const uint8_t regs[] = {r.a, r.x, r.y, r.sp, r.p};
+        hash = fnv1a64(regs, sizeof(regs), hash);
+        hash = fnv1a64(&cycleCount, sizeof(cycleCount), hash);
+        const uint8_t io[] = {frameCounterMode, frameIrq, nmiPending, static_cast<uint8_t>(scanline)};
+        hash = fnv1a64(io, sizeof(io), hash);
+        hash = ppu.hash(hash);
+        return fnv1a64(RAM.data(), RAM.size(), hash);
+    }
+
+    // Everything that changes while the game runs. The ROM is not part of
+    // it, so a state only makes sense with the ROM it was saved with.
+    struct State {
+        CpuRegisters cpu;
+        bool halted;
+        uint64_t frameCount;
+        std::array<uint8_t, 0x0800> ram;
+        uint8_t controllerState[2];
+        uint8_t controllerShift[2];
+        bool controllerStrobe;
+        Ppu::State ppu;
+        int scanline;
+        uint8_t frameCounterMode;
+        bool frameIrq;
+        bool nmiPending;
+        Scheduler scheduler;
+    };
+
+    void saveState(State &s) const {
+        s.cpu = registers();
+        s.halted = CpuHalted;
+        s.frameCount = frameCount;
+        std::copy(RAM.begin(), RAM.end(), s.ram.begin());
+        for (int i = 0; i < 2; i++) {
+            s.controllerState[i] = controllerState[i];
+            s.controllerShift[i] = controllerShift[i];
+        }
+        s.controllerStrobe = controllerStrobe;
+        ppu.save(s.ppu);
+        s.scanline = scanline;
+        s.frameCounterMode = frameCounterMode;
+        s.frameIrq = frameIrq;
+        s.nmiPending = nmiPending;
+        s.scheduler = scheduler;
+    }
+
+    void loadState(const State &s) {
+        setRegisters(s.cpu);
+        CpuHalted = s.halted;
+        frameCount = s.frameCount;
+        frameEnded = false;
+        std::copy(s.ram.begin(), s.ram.end(), RAM.begin());
+        for (int i = 0; i < 2; i++) {
+            controllerState[i] = s.controllerState[i];
+            controllerShift[i] = s.controllerShift[i];
+        }
+        controllerStrobe = s.controllerStrobe;
+        ppu.load(s.ppu);
+        if (pipeline)
+            pipeline->restart(ppu);
+        scanline = s.scanline;
+        frameCounterMode = s.frameCounterMode;
+        frameIrq = s.frameIrq;
+        nmiPending = s.nmiPending;
+        scheduler = s.scheduler;
+    }
+
+    uint64_t getRomHash() const { return romHash; }
+
+    // Last frame drawn, Ppu::kWidth x Ppu::kHeight NES colour indices.
+    const uint8_t *getFrameBuffer() const { return frameBuffer.data(); }
+    uint64_t frameHash() const { return Xxh64::compute(frameBuffer.data(), frameBuffer.size()); }
+    uint64_t getFrameCount() const { return frameCount; }
+    // The 2 KiB of work RAM, for tools that read or poke game variables.
+    uint8_t *ramData() { return RAM.data(); }
+    bool isLoaded() const { return loaded; }
+
+    // The per-instruction trace is on by default; headless runs turn it off.
+    // Without it a halt on an unknown opcode is silent too: isHalted() says so.
+    void setTracing(bool enabled) { tracing = enabled; }
+
+    // Idle loops are skipped unless the text trace is on or the debugger or
+    // a binary trace is attached. The cycles skipped are counted here and,
+    // when a profiler is attached, there as well.
+    struct IdleSkipStats {
+        uint64_t loops = 0;
+        uint64_t cycles = 0;
+    };
+    void setIdleSkip(bool enabled) { idleSkip = enabled; }
+    const IdleSkipStats &idleSkipStatistics() const { return idleStats; }
+
+    void setStepping(Stepping mode) { stepping = mode; }
+    Stepping getStepping() const { return stepping; }
+
+    void attachProfiler(Profiler *p) { profiler = p; }
+    void attachTraceWriter(BinaryTraceWriter *w) { traceWriter = w; }
+
+    // Sized for the current cartridge now and whenever another is inserted.
+    void attachCodeDataLogger(CodeDataLogger *logger) {
+        cdl = logger;
+        if (cdl)
+            cdl->reset(ROM.size(), chrRomSize);
+    }
+
+    bool instrumented() const {
+        return profiler || traceWriter || cdl || (debugger && debugger->active());
+    }
+    void attachDebugger(Debugger *d) { debugger = d; }
+
+    // Host time spent on scanlines, for performance displays; off by default.
+    void setPpuTiming(bool enabled) { ppuTiming = enabled; }
+    uint64_t ppuNanoseconds() const {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(ppuTime).count());
+    }
+
+    // Draws the picture on the pipeline's thread from now on, into this
+    // emulator's frame buffer; nullptr goes back to drawing in runFrame().
+    void attachPpuPipeline(PpuPipeline *p) {
+        if (pipeline)
+            pipeline->stop();
+        pipeline = p;
+        if (pipeline)
+            pipeline->start(ppu, frameBuffer.data());
+    }
+
+    /*
+     * Debugger commands. Each one resumes execution and returns once the
+     * emulator paused again or the CPU halted.
+     */
+
+    // Leaves the debugger stop; the frame loop picks execution back up.
+    void resume() {
+        if (debugger)
+            debugger->resumed();
+        paused = false;
+    }
+
+    void stepInstruction() {
+        if (!debugger)
+            return;
+        debugger->requestStep();
+        resume();
+        run();
+    }
+
+    void stepOver() {
+        if (!debugger)
+            return;
+        if (peek(ProgramCounter) != 0x20) { // Only JSR has something to step over
+            stepInstruction();
+            return;
+        }
+        debugger->requestStepOver(static_cast<uint16_t>(ProgramCounter + 3),
+                                  static_cast<uint8_t>(stackPointer));
+        resume();
+        run();
+    }
+
+    void runToCycle(uint64_t cycle) {
+        if (!debugger)
+            return;
+        debugger->requestRunToCycle(cycle);
+        resume();
+        run();
+    }
+
+    bool isPaused() const { return paused; }
+    bool isHalted() const { return CpuHalted; }
+
+    uint8_t statusByte() const {
+        uint8_t p = 0x20;
+        p |= flag_Carry ? 0x01 : 0;
+        p |= flag_Zero ? 0x02 : 0;
+        p |= flag_InterruptDisable ? 0x04 : 0;
+        p |= flag_Decimal ? 0x08 : 0;
+        p |= flag_Overflow ? 0x40 : 0;
+        p |= flag_Negative ? 0x80 : 0;
+        return p;
+    }
+
+    CpuRegisters registers() const {
+        return {ProgramCounter, A, X, Y, static_cast<uint8_t>(stackPointer),
+                statusByte(), cycleCount};
+    }
+
+    void setRegisters(const CpuRegisters &r) {
+        ProgramCounter = r.pc;
+        A = r.a;
+        X = r.x;
+        Y = r.y;
+        stackPointer = r.sp;
+        flag_Carry = (r.p & 0x01) != 0;
+        flag_Zero = (r.p & 0x02) != 0;
+        flag_InterruptDisable = (r.p & 0x04) != 0;
+        flag_Decimal = (r.p & 0x08) != 0;
+        flag_Overflow = (r.p & 0x40) != 0;
+        flag_Negative = (r.p & 0x80) != 0;
+        cycleCount = r.cycles;
+    }
+
+    uint64_t getCycleCount() const { return cycleCount; }
+
+    template <Stepping Mode = Stepping::Instruction> void readAbsolute(uint16_t *addr) {
+        *addr = cpuRead<Mode>(ProgramCounter);
         ProgramCounter++;
-        *addr = static_cast<uint16_t>(read(ProgramCounter) << 8 | *addr);
+        *addr = static_cast<uint16_t>(cpuRead<Mode>(ProgramCounter) << 8 | *addr);
         ProgramCounter++;
     }
 
-    void readAbsoluteIndexed(uint16_t *addr, uint8_t reg) {
-        *addr = read(ProgramCounter);
+    // The index is added to the low byte while the CPU reads from the
+    // address before the carry. Loads only make that read when there is a
+    // carry to fix up; stores and read-modify-writes (`store`) always do.
+    template <Stepping Mode = Stepping::Instruction> void readAbsoluteIndexed(uint16_t *addr, uint8_t reg,
+                                                                              bool store = false) {
+        *addr = cpuRead<Mode>(ProgramCounter);
         ProgramCounter++;
-        *addr = static_cast<uint16_t>(read(ProgramCounter) << 8 | *addr);
+        *addr = static_cast<uint16_t>(cpuRead<Mode>(ProgramCounter) << 8 | *addr);
         ProgramCounter++;
+        const uint16_t base = *addr;
         *addr += reg;
+        if constexpr (Mode != Stepping::Instruction) {
+            const auto uncarried = static_cast<uint16_t>((base & 0xFF00) | (*addr & 0x00FF));
+            if (store || uncarried != *addr)
+                cpuRead<Mode>(uncarried);
+        }
     }
 
-    void readIndirectIndexed(uint16_t *addr, uint8_t reg) {
-        uint8_t zp = read(ProgramCounter);
+    template <Stepping Mode = Stepping::Instruction> void readIndirectIndexed(uint16_t *addr, uint8_t reg) {
+        uint8_t zp = cpuRead<Mode>(ProgramCounter);
         ProgramCounter++;
-        uint8_t lo = read(zp);
-        uint8_t hi = read(static_cast<uint8_t>(zp + 1));
+        uint8_t lo = cpuRead<Mode>(zp);
+        uint8_t hi = cpuRead<Mode>(static_cast<uint8_t>(zp + 1));
         *addr = static_cast<uint16_t>((static_cast<uint16_t>(hi) << 8) | lo);
         *addr = static_cast<uint16_t>(*addr + reg);
     }
 
-    void readIndexedIndirect(uint16_t *addr, uint8_t reg) {
-        *addr = static_cast<uint8_t>(read(ProgramCounter) + X);
+    template <Stepping Mode = Stepping::Instruction> void readIndexedIndirect(uint16_t *addr, uint8_t reg) {
+        *addr = static_cast<uint8_t>(cpuRead<Mode>(ProgramCounter) + X);
         ProgramCounter++;
         uint8_t temp = static_cast<uint8_t>(*addr);
-        *addr = read(temp);
+        *addr = cpuRead<Mode>(temp);
         temp++;
-        *addr = static_cast<uint16_t>(read(temp) << 8 | *addr);
+        *addr = static_cast<uint16_t>(cpuRead<Mode>(temp) << 8 | *addr);
     }
 
-    void readZeroPage(uint8_t *addr) {
-        *addr = read(ProgramCounter);
+    template <Stepping Mode = Stepping::Instruction> void readZeroPage(uint8_t *addr) {
+        *addr = cpuRead<Mode>(ProgramCounter);
         ProgramCounter++;
     }
 
-    void readZeroPageIndexed(uint8_t *addr, uint8_t reg) {
-        *addr = read(ProgramCounter);
+    template <Stepping Mode = Stepping::Instruction> void readZeroPageIndexed(uint8_t *addr, uint8_t reg) {
+        *addr = cpuRead<Mode>(ProgramCounter);
         ProgramCounter++;
         *addr += reg;
     }
@@ -134,7 +790,7 @@ class Emulator {
         flag_Negative = *reg > 127;
     }
 
-    void emulate_cpu() {
+    template <bool Instrumented = false, Stepping Mode = Stepping::Instruction> void emulate_cpu() {
         int cycles = 0;
 
         uint8_t addr;
@@ -145,8 +801,28 @@ class Emulator {
         int sum;
         bool oldCarry;
 
-        uint8_t opcode = read(ProgramCounter);
+        if constexpr (Instrumented) {
+            if (debugger && debugger->checkExecution(registers(), *this)) {
+                paused = true;
+                return;
+            }
+            if (profiler)
+                profiler->beginInstruction(ProgramCounter);
+            if (traceWriter)
+                traceWriter->begin(registers());
+        }
+
+        const uint64_t firstCycle = cycleCount;
+        const uint16_t instructionAddress = ProgramCounter;
+        uint8_t opcode = cpuRead<Mode>(ProgramCounter);
         ProgramCounter++;
+        cycles = kCoreCycles[opcode];
+        if constexpr (Mode == Stepping::Cycle)
+            lastInstructionCycle = firstCycle + kOpcodeCycles[opcode] - 1;
+        if constexpr (Instrumented) {
+            if (cdl)
+                logInstruction(static_cast<uint16_t>(ProgramCounter - 1), opcode);
+        }
 
         switch (opcode) {
         case 0x02: // HTL - Unofficial Instruction
@@ -154,7 +830,6 @@ class Emulator {
             break;
 
         case 0xEA: // NOP
-            cycles = 2;
             break;
 
             /*
@@ -162,104 +837,88 @@ class Emulator {
              */
 
         case 0xA9: // LDA Immediate
-            A = read(ProgramCounter);
+            A = cpuRead<Mode>(ProgramCounter);
             flagZN(&A);
             ProgramCounter++;
-            cycles = 2;
             break;
         case 0xA5: // LDA Zero Page
-            addr = read(ProgramCounter);
+            addr = cpuRead<Mode>(ProgramCounter);
             ProgramCounter++;
-            A = read(addr);
+            A = busRead<Instrumented, Mode>(addr);
             flagZN(&A);
-            cycles = 3;
             break;
         case 0xB5: // LDA Zero Page,X
-            readZeroPageIndexed(&addr, X);
-            A = read(addr);
+            readZeroPageIndexed<Mode>(&addr, X);
+            A = busRead<Instrumented, Mode>(addr);
             flagZN(&A);
-            cycles = 4;
             break;
         case 0xAD: // LDA Absolute
-            readAbsolute(&addr_abs);
-            A = read(addr_abs);
+            readAbsolute<Mode>(&addr_abs);
+            A = busRead<Instrumented, Mode>(addr_abs);
             flagZN(&A);
-            cycles = 4;
             break;
         case 0xBD: // LDA Absolute,X
-            readAbsoluteIndexed(&addr_abs, X);
-            A = read(addr_abs);
+            readAbsoluteIndexed<Mode>(&addr_abs, X);
+            A = busRead<Instrumented, Mode>(addr_abs);
             flagZN(&A);
-            cycles = 4;
             break;
         case 0xB9: // LDA Absolute,Y
-            readAbsoluteIndexed(&addr_abs, Y);
-            A = read(addr_abs);
+            readAbsoluteIndexed<Mode>(&addr_abs, Y);
+            A = busRead<Instrumented, Mode>(addr_abs);
             flagZN(&A);
-            cycles = 4;
             break;
 
         case 0xA2: // LDX Immediate
-            X = read(ProgramCounter);
+            X = cpuRead<Mode>(ProgramCounter);
             flagZN(&X);
             ProgramCounter++;
-            cycles = 2;
             break;
         case 0xA6: // LDX Zero Page
-            addr = read(ProgramCounter);
+            addr = cpuRead<Mode>(ProgramCounter);
             ProgramCounter++;
-            X = read(addr);
+            X = busRead<Instrumented, Mode>(addr);
             flagZN(&X);
-            cycles = 3;
             break;
         case 0xB6: // LDX Zero Page,Y
-            readZeroPageIndexed(&addr, Y);
-            X = read(addr);
+            readZeroPageIndexed<Mode>(&addr, Y);
+            X = busRead<Instrumented, Mode>(addr);
             flagZN(&X);
-            cycles = 4;
             break;
         case 0xAE: // LDX Absolute
-            readAbsolute(&addr_abs);
-            X = read(addr_abs);
+            readAbsolute<Mode>(&addr_abs);
+            X = busRead<Instrumented, Mode>(addr_abs);
             flagZN(&X);
-            cycles = 4;
             break;
         case 0xBE: // LDX Absolute,Y
-            readAbsoluteIndexed(&addr_abs, Y);
-            X = read(addr_abs);
+            readAbsoluteIndexed<Mode>(&addr_abs, Y);
+            X = busRead<Instrumented, Mode>(addr_abs);
             flagZN(&X);
-            cycles = 4;
             break;
 
         case 0xA0: // LDY Immediate
-            Y = read(ProgramCounter);
+            Y = cpuRead<Mode>(ProgramCounter);
             flagZN(&Y);
             ProgramCounter++;
-            cycles = 2;
             break;
         case 0xA4: // LDY Zero Page
-            readZeroPage(&addr);
-            Y = read(addr);
+            readZeroPage<Mode>(&addr);
+            Y = busRead<Instrumented, Mode>(addr);
             flagZN(&Y);
-            cycles = 3;
             break;
         case 0xB4: // LDY Zero Page,X
-            readZeroPageIndexed(&addr, X);
-            Y = read(addr);
+            readZeroPageIndexed<Mode>(&addr, X);
+            Y = busRead<Instrumented, Mode>(addr);
             flagZN(&Y);
-            cycles = 4;
             break;
         case 0xAC: // LDY Absolute
-            readAbsolute(&addr_abs);
-            Y = read(addr_abs);
+            readAbsolute<Mode>(&addr_abs);
+            Y = busRead<Instrumented, Mode>(addr_abs);
             flagZN(&Y);
-            cycles = 4;
             break;
         case 0xBC: // LDY Absolute,X
-            readAbsoluteIndexed(&addr_abs, X);
-            Y = read(addr_abs);
+            readAbsoluteIndexed<Mode>(&addr_abs, X);
+            Y = busRead<Instrumented, Mode>(addr_abs);
             flagZN(&Y);
-            cycles = 4;
             break;
 
             /*
@@ -267,167 +926,140 @@ class Emulator {
              */
 
         case 0x85: // STA Zero Page
-            readZeroPage(&addr);
-            write(addr, A);
-            cycles = 3;
+            readZeroPage<Mode>(&addr);
+            busWrite<Instrumented, Mode>(addr, A);
             break;
         case 0x95: // STA Zero Page,X
-            readZeroPageIndexed(&addr, X);
-            write(addr, A);
-            cycles = 4;
+            readZeroPageIndexed<Mode>(&addr, X);
+            busWrite<Instrumented, Mode>(addr, A);
             break;
         case 0x8D: // STA Absolute
-            readAbsolute(&addr_abs);
-            write(addr_abs, A);
-            cycles = 4;
+            readAbsolute<Mode>(&addr_abs);
+            busWrite<Instrumented, Mode>(addr_abs, A);
             break;
         case 0x9D: // STA Absolute,X
-            readAbsoluteIndexed(&addr_abs, X);
-            write(addr_abs, A);
-            cycles = 4;
+            readAbsoluteIndexed<Mode>(&addr_abs, X, true);
+            busWrite<Instrumented, Mode>(addr_abs, A);
             break;
         case 0x99: // STA Absolute,Y
-            readAbsoluteIndexed(&addr_abs, Y);
-            write(addr_abs, A);
-            cycles = 4;
+            readAbsoluteIndexed<Mode>(&addr_abs, Y, true);
+            busWrite<Instrumented, Mode>(addr_abs, A);
             break;
 
         case 0x86: // STX Zero Page
-            readZeroPage(&addr);
-            write(addr, X);
-            cycles = 3;
+            readZeroPage<Mode>(&addr);
+            busWrite<Instrumented, Mode>(addr, X);
             break;
         case 0x96: // STX Zero Page,Y
-            readZeroPageIndexed(&addr, Y);
-            write(addr, X);
-            cycles = 4;
+            readZeroPageIndexed<Mode>(&addr, Y);
+            busWrite<Instrumented, Mode>(addr, X);
             break;
         case 0x8E: // STX Absolute
-            readAbsolute(&addr_abs);
-            write(addr_abs, X);
-            cycles = 4;
+            readAbsolute<Mode>(&addr_abs);
+            busWrite<Instrumented, Mode>(addr_abs, X);
             break;
 
         case 0x84: // STY Zero Page
-            readZeroPage(&addr);
-            write(addr, Y);
-            cycles = 3;
+            readZeroPage<Mode>(&addr);
+            busWrite<Instrumented, Mode>(addr, Y);
             break;
         case 0x94: // STY Zero Page,X
-            readZeroPageIndexed(&addr, X);
-            write(addr, Y);
-            cycles = 4;
+            readZeroPageIndexed<Mode>(&addr, X);
+            busWrite<Instrumented, Mode>(addr, Y);
             break;
         case 0x8C: // STY Absolute
-            readAbsolute(&addr_abs);
-            write(addr_abs, Y);
-            cycles = 4;
+            readAbsolute<Mode>(&addr_abs);
+            busWrite<Instrumented, Mode>(addr_abs, Y);
             break;
 
         /*
          * Branch Instructions
          */
         case 0x10: // BPL (Branch on PLus)
-            addr = read(ProgramCounter);
+            addr = cpuRead<Mode>(ProgramCounter);
             ProgramCounter++;
             if (!flag_Negative) {
                 auto signedVal = static_cast<int8_t>(addr);
                 ProgramCounter =
                     static_cast<uint16_t>(ProgramCounter + signedVal);
-                cycles = 3;
-            } else {
-                cycles = 2;
+                cycles++;
             }
             break;
 
         case 0x30: // BMI (Branch on MInus)
-            addr = read(ProgramCounter);
+            addr = cpuRead<Mode>(ProgramCounter);
             ProgramCounter++;
             if (flag_Negative) {
                 auto signedVal = static_cast<int8_t>(addr);
                 ProgramCounter =
                     static_cast<uint16_t>(ProgramCounter + signedVal);
-                cycles = 3;
-            } else {
-                cycles = 2;
+                cycles++;
             }
             break;
 
         case 0x50: // BVC (Branch on oVerflow Clear)
-            addr = read(ProgramCounter);
+            addr = cpuRead<Mode>(ProgramCounter);
             ProgramCounter++;
             if (!flag_Overflow) {
                 auto signedVal = static_cast<int8_t>(addr);
                 ProgramCounter =
                     static_cast<uint16_t>(ProgramCounter + signedVal);
-                cycles = 3;
-            } else {
-                cycles = 2;
+                cycles++;
             }
             break;
 
         case 0x70: // BVS (Branch on oVerflow Set)
-            addr = read(ProgramCounter);
+            addr = cpuRead<Mode>(ProgramCounter);
             ProgramCounter++;
             if (flag_Overflow) {
                 auto signedVal = static_cast<int8_t>(addr);
                 ProgramCounter =
                     static_cast<uint16_t>(ProgramCounter + signedVal);
-                cycles = 3;
-            } else {
-                cycles = 2;
+                cycles++;
             }
             break;
 
         case 0x90: // BCC (Branch on Carry Clear)
-            addr = read(ProgramCounter);
+            addr = cpuRead<Mode>(ProgramCounter);
             ProgramCounter++;
             if (!flag_Carry) {
                 auto signedVal = static_cast<int8_t>(addr);
                 ProgramCounter =
                     static_cast<uint16_t>(ProgramCounter + signedVal);
-                cycles = 3;
-            } else {
-                cycles = 2;
+                cycles++;
             }
             break;
 
         case 0xB0: // BCS (Branch on Carry Set)
-            addr = read(ProgramCounter);
+            addr = cpuRead<Mode>(ProgramCounter);
             ProgramCounter++;
             if (flag_Carry) {
                 auto signedVal = static_cast<int8_t>(addr);
                 ProgramCounter =
                     static_cast<uint16_t>(ProgramCounter + signedVal);
-                cycles = 3;
-            } else {
-                cycles = 2;
+                cycles++;
             }
             break;
 
         case 0xD0: // BNE (Branch on Not Equal)
-            addr = read(ProgramCounter);
+            addr = cpuRead<Mode>(ProgramCounter);
             ProgramCounter++;
             if (!flag_Zero) {
                 auto signedVal = static_cast<int8_t>(addr);
                 ProgramCounter =
                     static_cast<uint16_t>(ProgramCounter + signedVal);
-                cycles = 3;
-            } else {
-                cycles = 2;
+                cycles++;
             }
             break;
 
         case 0xF0: // BEQ (Branch on EQual)
-            addr = read(ProgramCounter);
+            addr = cpuRead<Mode>(ProgramCounter);
             ProgramCounter++;
             if (flag_Zero) {
                 const auto signedVal = static_cast<int8_t>(addr);
                 ProgramCounter =
                     static_cast<uint16_t>(ProgramCounter + signedVal);
-                cycles = 3;
-            } else {
-                cycles = 2;
+                cycles++;
             }
             break;
 
@@ -436,26 +1068,22 @@ class Emulator {
              */
 
         case 0x48: // PHA
-            push(A);
-            cycles = 3;
+            push<Mode>(A);
             break;
 
         case 0x68: // PLA
-            A = pull();
+            A = pull<Mode>();
             flag_Zero = A == 0;
             flag_Negative = A >= 0x80;
-            cycles = 4;
             break;
 
         case 0x9A: // TXS - Transfer X to Stack Pointer
             stackPointer = X;
-            cycles = 2;
             break;
 
         case 0xBA: // TSX - Transfer Stack Pointer to X
             X = stackPointer;
             flagZN(&X);
-            cycles = 2;
             break;
 
             /*
@@ -463,38 +1091,42 @@ class Emulator {
              */
 
         case 0x20: // JSR
-            addr_low = read(ProgramCounter);
+            addr_low = cpuRead<Mode>(ProgramCounter);
             ProgramCounter++;
-            addr_high = read(ProgramCounter);
-            push(static_cast<uint8_t>(ProgramCounter / 256));
-            push(static_cast<uint8_t>(ProgramCounter));
+            addr_high = cpuRead<Mode>(ProgramCounter);
+            push<Mode>(static_cast<uint8_t>(ProgramCounter / 256));
+            push<Mode>(static_cast<uint8_t>(ProgramCounter));
             ProgramCounter = static_cast<uint16_t>(addr_high * 256 + addr_low);
-            cycles = 6;
+            if constexpr (Instrumented) {
+                if (profiler)
+                    profiler->onCall(ProgramCounter);
+            }
             break;
 
         case 0x60: // RTS
-            addr_low = pull();
-            addr_high = pull();
+            addr_low = pull<Mode>();
+            addr_high = pull<Mode>();
             ProgramCounter = static_cast<uint16_t>(addr_high * 256 + addr_low);
             ProgramCounter++;
-            cycles = 6;
+            if constexpr (Instrumented) {
+                if (profiler)
+                    profiler->onReturn();
+            }
             break;
 
         case 0x4C: // JMP
-            addr_low = read(ProgramCounter);
+            addr_low = cpuRead<Mode>(ProgramCounter);
             ProgramCounter++;
-            addr_high = read(ProgramCounter);
+            addr_high = cpuRead<Mode>(ProgramCounter);
             ProgramCounter = static_cast<uint16_t>(addr_high * 256 + addr_low);
-            cycles = 3;
             break;
 
         case 0x6C: // JMP - Indirect
-            addr_low = read(ProgramCounter);
+            addr_low = cpuRead<Mode>(ProgramCounter);
             ProgramCounter++;
-            addr_high = read(ProgramCounter);
+            addr_high = cpuRead<Mode>(ProgramCounter);
             ProgramCounter =
-                read(static_cast<uint16_t>(addr_high * 256 + addr_low));
-            cycles = 5;
+                cpuRead<Mode>(static_cast<uint16_t>(addr_high * 256 + addr_low));
             break;
 
             /*
@@ -504,51 +1136,43 @@ class Emulator {
         case 0xE8: // INX - Increment X
             X++;
             flagZN(&X);
-            cycles = 2;
             break;
 
         case 0xC8: // INY - Increment Y
             Y++;
             flagZN(&Y);
-            cycles = 2;
             break;
 
         case 0xCA: // DEX - Decrement X
             X--;
             flagZN(&X);
-            cycles = 2;
             break;
 
         case 0x88: // DEY - Decrement Y
             Y--;
             flagZN(&Y);
-            cycles = 2;
             break;
 
         case 0xAA: // TAX - Transfer A to X
             X = A;
             flagZN(&X);
-            cycles = 2;
             break;
 
         case 0x8A: // TXA - Transfer X to A
             A = X;
             flag_Zero = A == 0;
             flag_Negative = A >= 0x80;
-            cycles = 2;
             break;
 
         case 0xA8: // TAY - Transfer A to Y
             Y = A;
             flagZN(&Y);
-            cycles = 2;
             break;
 
         case 0x98: // TYA - Transfer Y to A
             A = Y;
             flag_Zero = A == 0;
             flag_Negative = A >= 0x80;
-            cycles = 2;
             break;
 
         case 0x0A: // ASL - Arithmetic Shift Left
@@ -556,43 +1180,38 @@ class Emulator {
             A <<= 1;
             flag_Zero = A == 0;
             flag_Negative = A > 127;
-            cycles = 2;
             break;
         case 0x0E: // ASL Absolute
-            readAbsolute(&addr_abs);
-            value = read(addr_abs);
+            readAbsolute<Mode>(&addr_abs);
+            value = busReadModify<Instrumented, Mode>(addr_abs);
             flag_Carry = (value & 0x80) != 0;
             value <<= 1;
-            write(addr_abs, value);
+            busWrite<Instrumented, Mode>(addr_abs, value);
             flagZN(&value);
-            cycles = 6;
             break;
         case 0x1E: // ASL Absolute,X
-            readAbsoluteIndexed(&addr_abs, X);
-            value = read(addr_abs);
+            readAbsoluteIndexed<Mode>(&addr_abs, X, true);
+            value = busReadModify<Instrumented, Mode>(addr_abs);
             flag_Carry = (value & 0x80) != 0;
             value <<= 1;
-            write(addr_abs, value);
+            busWrite<Instrumented, Mode>(addr_abs, value);
             flagZN(&value);
-            cycles = 7;
             break;
         case 0x06: // ASL Zero Page
-            readZeroPage(&addr_low);
-            value = read(addr_low);
+            readZeroPage<Mode>(&addr_low);
+            value = busReadModify<Instrumented, Mode>(addr_low);
             flag_Carry = (value & 0x80) != 0;
             value <<= 1;
-            write(addr_low, value);
+            busWrite<Instrumented, Mode>(addr_low, value);
             flagZN(&value);
-            cycles = 5;
             break;
         case 0x16: // ASL Zero Page,X
-            readZeroPageIndexed(&addr_low, X);
-            value = read(addr_low);
+            readZeroPageIndexed<Mode>(&addr_low, X);
+            value = busReadModify<Instrumented, Mode>(addr_low);
             flag_Carry = (value & 0x80) != 0;
             value <<= 1;
-            write(addr_low, value);
+            busWrite<Instrumented, Mode>(addr_low, value);
             flagZN(&value);
-            cycles = 6;
             break;
 
         case 0x2A: // ROL - ROtate Left (Accumulator)
@@ -603,102 +1222,92 @@ class Emulator {
                 A |= 1;
             }
             flagZN(&A);
-            cycles = 2;
             break;
         case 0x26: // ROL Zero Page
-            readZeroPage(&addr);
-            value = read(addr);
+            readZeroPage<Mode>(&addr);
+            value = busReadModify<Instrumented, Mode>(addr);
             oldCarry = flag_Carry;
             flag_Carry = (value & 0x80) != 0;
             value <<= 1;
             if (oldCarry) {
                 value |= 1;
             }
-            write(addr, value);
+            busWrite<Instrumented, Mode>(addr, value);
             flagZN(&value);
-            cycles = 5;
             break;
         case 0x36: // ROL Zero Page,X
-            readZeroPageIndexed(&addr, X);
-            value = read(addr);
+            readZeroPageIndexed<Mode>(&addr, X);
+            value = busReadModify<Instrumented, Mode>(addr);
             oldCarry = flag_Carry;
             flag_Carry = (value & 0x80) != 0;
             value <<= 1;
             if (oldCarry) {
                 value |= 1;
             }
-            write(addr, value);
+            busWrite<Instrumented, Mode>(addr, value);
             flagZN(&value);
-            cycles = 6;
             break;
         case 0x2E: // ROL Absolute
-            readAbsolute(&addr_abs);
-            value = read(addr_abs);
+            readAbsolute<Mode>(&addr_abs);
+            value = busReadModify<Instrumented, Mode>(addr_abs);
             oldCarry = flag_Carry;
             flag_Carry = (value & 0x80) != 0;
             value <<= 1;
             if (oldCarry) {
                 value |= 1;
             }
-            write(addr_abs, value);
+            busWrite<Instrumented, Mode>(addr_abs, value);
             flagZN(&value);
-            cycles = 6;
             break;
         case 0x3E: // ROL Absolute,X
-            readAbsoluteIndexed(&addr_abs, X);
-            value = read(addr_abs);
+            readAbsoluteIndexed<Mode>(&addr_abs, X, true);
+            value = busReadModify<Instrumented, Mode>(addr_abs);
             oldCarry = flag_Carry;
             flag_Carry = (value & 0x80) != 0;
             value <<= 1;
             if (oldCarry) {
                 value |= 1;
             }
-            write(addr_abs, value);
+            busWrite<Instrumented, Mode>(addr_abs, value);
             flagZN(&value);
-            cycles = 7;
             break;
 
         case 0x4A: // LSR - Logical Shift Right
             flag_Carry = (A & 0x01) != 0;
             A >>= 1;
             flagZN(&A);
-            cycles = 2;
             break;
         case 0x4E: // LSR Absolute
-            readAbsolute(&addr_abs);
-            value = read(addr_abs);
+            readAbsolute<Mode>(&addr_abs);
+            value = busReadModify<Instrumented, Mode>(addr_abs);
             flag_Carry = (value & 0x01) != 0;
             value >>= 1;
-            write(addr_abs, value);
+            busWrite<Instrumented, Mode>(addr_abs, value);
             flagZN(&value);
-            cycles = 6;
             break;
         case 0x5E: // LSR Absolute,X
-            readAbsoluteIndexed(&addr_abs, X);
-            value = read(addr_abs);
+            readAbsoluteIndexed<Mode>(&addr_abs, X, true);
+            value = busReadModify<Instrumented, Mode>(addr_abs);
             flag_Carry = (value & 0x01) != 0;
             value >>= 1;
-            write(addr_abs, value);
+            busWrite<Instrumented, Mode>(addr_abs, value);
             flagZN(&value);
-            cycles = 7;
             break;
         case 0x46: // LSR Zero Page
-            readZeroPage(&addr_low);
-            value = read(addr_low);
+            readZeroPage<Mode>(&addr_low);
+            value = busReadModify<Instrumented, Mode>(addr_low);
             flag_Carry = (value & 0x01) != 0;
             value >>= 1;
-            write(addr_low, value);
+            busWrite<Instrumented, Mode>(addr_low, value);
             flagZN(&value);
-            cycles = 5;
             break;
         case 0x56: // LSR Zero Page,X
-            readZeroPageIndexed(&addr_low, X);
-            value = read(addr_low);
+            readZeroPageIndexed<Mode>(&addr_low, X);
+            value = busReadModify<Instrumented, Mode>(addr_low);
             flag_Carry = (value & 0x01) != 0;
             value >>= 1;
-            write(addr_low, value);
+            busWrite<Instrumented, Mode>(addr_low, value);
             flagZN(&value);
-            cycles = 6;
             break;
 
         case 0x6A: // ROR - ROtate Right (Accumulator)
@@ -709,59 +1318,54 @@ class Emulator {
                 A |= 0x80;
             }
             flagZN(&A);
-            cycles = 2;
             break;
         case 0x66: // ROR Zero Page
-            readZeroPage(&addr);
-            value = read(addr);
+            readZeroPage<Mode>(&addr);
+            value = busReadModify<Instrumented, Mode>(addr);
             oldCarry = flag_Carry;
             flag_Carry = (value & 0x01) != 0;
             value >>= 1;
             if (oldCarry) {
                 value |= 0x80;
             }
-            write(addr, value);
+            busWrite<Instrumented, Mode>(addr, value);
             flagZN(&value);
-            cycles = 5;
             break;
         case 0x76: // ROR Zero Page,X
-            readZeroPageIndexed(&addr, X);
-            value = read(addr);
+            readZeroPageIndexed<Mode>(&addr, X);
+            value = busReadModify<Instrumented, Mode>(addr);
             oldCarry = flag_Carry;
             flag_Carry = (value & 0x01) != 0;
             value >>= 1;
             if (oldCarry) {
                 value |= 0x80;
             }
-            write(addr, value);
+            busWrite<Instrumented, Mode>(addr, value);
             flagZN(&value);
-            cycles = 6;
             break;
         case 0x6E: // ROR Absolute
-            readAbsolute(&addr_abs);
-            value = read(addr_abs);
+            readAbsolute<Mode>(&addr_abs);
+            value = busReadModify<Instrumented, Mode>(addr_abs);
             oldCarry = flag_Carry;
             flag_Carry = (value & 0x01) != 0;
             value >>= 1;
             if (oldCarry) {
                 value |= 0x80;
             }
-            write(addr_abs, value);
+            busWrite<Instrumented, Mode>(addr_abs, value);
             flagZN(&value);
-            cycles = 6;
             break;
         case 0x7E: // ROR Absolute,X
-            readAbsoluteIndexed(&addr_abs, X);
-            value = read(addr_abs);
+            readAbsoluteIndexed<Mode>(&addr_abs, X, true);
+            value = busReadModify<Instrumented, Mode>(addr_abs);
             oldCarry = flag_Carry;
             flag_Carry = (value & 0x01) != 0;
             value >>= 1;
             if (oldCarry) {
                 value |= 0x80;
             }
-            write(addr_abs, value);
+            busWrite<Instrumented, Mode>(addr_abs, value);
             flagZN(&value);
-            cycles = 7;
             break;
 
             /*
@@ -769,74 +1373,66 @@ class Emulator {
              */
 
         case 0xE6: // INC Zero Page - Increment
-            readZeroPage(&addr);
-            value = read(addr);
+            readZeroPage<Mode>(&addr);
+            value = busReadModify<Instrumented, Mode>(addr);
             value++;
-            write(addr, value);
+            busWrite<Instrumented, Mode>(addr, value);
             flagZN(&value); // WARNING : MUST TEST
-            cycles = 5;
             break;
 
         case 0xF6: // INC Zero Page,X - Increment
-            readZeroPageIndexed(&addr, X);
-            value = read(addr);
+            readZeroPageIndexed<Mode>(&addr, X);
+            value = busReadModify<Instrumented, Mode>(addr);
             value++;
-            write(addr, value);
+            busWrite<Instrumented, Mode>(addr, value);
             flagZN(&value); // WARNING : MUST TEST
-            cycles = 5;
             break;
 
         case 0xEE: // INC Absolute
-            readAbsolute(&addr_abs);
-            value = read(addr_abs);
+            readAbsolute<Mode>(&addr_abs);
+            value = busReadModify<Instrumented, Mode>(addr_abs);
             value++;
-            write(addr_abs, value);
+            busWrite<Instrumented, Mode>(addr_abs, value);
             flagZN(&value);
-            cycles = 6;
             break;
 
         case 0xFE: // INC Absolute,X
-            readAbsoluteIndexed(&addr_abs, X);
-            value = read(addr_abs);
+            readAbsoluteIndexed<Mode>(&addr_abs, X, true);
+            value = busReadModify<Instrumented, Mode>(addr_abs);
             value++;
-            write(addr_abs, value);
+            busWrite<Instrumented, Mode>(addr_abs, value);
             flagZN(&value);
-            cycles = 6;
             break;
 
         case 0xC6: // DEC Zero Page - Decrement
-            readZeroPage(&addr);
-            value = read(addr);
+            readZeroPage<Mode>(&addr);
+            value = busReadModify<Instrumented, Mode>(addr);
             value--;
-            write(addr, value);
+            busWrite<Instrumented, Mode>(addr, value);
             flagZN(&value); // WARNING : MUST TEST
-            cycles = 5;
             break;
 
         case 0xD6: // DEC Zero Page,X - Decrement
-            readZeroPageIndexed(&addr, X);
-            value = read(addr);
+            readZeroPageIndexed<Mode>(&addr, X);
+            value = busReadModify<Instrumented, Mode>(addr);
             value--;
-            write(addr, value);
+            busWrite<Instrumented, Mode>(addr, value);
             flagZN(&value); // WARNING : MUST TEST
-            cycles = 5;
             break;
         case 0xCE: // DEC Absolute
-            readAbsolute(&addr_abs);
-            value = read(addr_abs);
+            readAbsolute<Mode>(&addr_abs);
+            value = busReadModify<Instrumented, Mode>(addr_abs);
             value--;
-            write(addr_abs, value);
+            busWrite<Instrumented, Mode>(addr_abs, value);
             flagZN(&value);
-            cycles = 6;
             break;
 
         case 0xDE: // DEC Absolute,X
-            readAbsoluteIndexed(&addr_abs, X);
-            value = read(addr_abs);
+            readAbsoluteIndexed<Mode>(&addr_abs, X, true);
+            value = busReadModify<Instrumented, Mode>(addr_abs);
             value--;
-            write(addr_abs, value);
+            busWrite<Instrumented, Mode>(addr_abs, value);
             flagZN(&value);
-            cycles = 6;
             break;
 
             /*
@@ -853,320 +1449,277 @@ class Emulator {
             addr += 0x20;
             addr += static_cast<uint8_t>(flag_Overflow ? 0x40 : 0);
             addr += static_cast<uint8_t>(flag_Negative ? 0x80 : 0);
-            push(addr);
-            cycles = 3;
+            push<Mode>(addr);
             break;
 
         case 0x28: // PLP - Pull Processor Flags
-            addr = pull();
+            addr = pull<Mode>();
             flag_Carry = (addr & 1) != 0;
             flag_Zero = (addr & 2) != 0;
             flag_InterruptDisable = (addr & 4) != 0;
             flag_Decimal = (addr & 8) != 0;
             flag_Overflow = (addr & 0x40) != 0;
             flag_Negative = (addr & 0x80) != 0;
-            cycles = 3;
+            pollIrq();
             break;
 
         case 0x09: // ORA - OR Accumulator
-            value = read(ProgramCounter);
+            value = cpuRead<Mode>(ProgramCounter);
             ProgramCounter++;
             A |= value;
             flagZN(&A);
-            cycles = 2;
             break;
 
         case 0x05: // ORA Zero Page
-            readZeroPage(&addr);
-            value = read(addr);
+            readZeroPage<Mode>(&addr);
+            value = busRead<Instrumented, Mode>(addr);
             A |= value;
             flagZN(&A);
-            cycles = 3;
             break;
         case 0x15: // ORA Zero Page,X
-            readZeroPageIndexed(&addr, X);
-            value = read(addr);
+            readZeroPageIndexed<Mode>(&addr, X);
+            value = busRead<Instrumented, Mode>(addr);
             A |= value;
             flagZN(&A);
-            cycles = 3;
             break;
 
         case 0x0D: // ORA Absolute
-            readAbsolute(&addr_abs);
-            value = read(addr_abs);
+            readAbsolute<Mode>(&addr_abs);
+            value = busRead<Instrumented, Mode>(addr_abs);
             A |= value;
             flagZN(&A);
-            cycles = 4;
             break;
         case 0x1D: // ORA Absolute,X
-            readAbsoluteIndexed(&addr_abs, X);
-            value = read(addr_abs);
+            readAbsoluteIndexed<Mode>(&addr_abs, X);
+            value = busRead<Instrumented, Mode>(addr_abs);
             A |= value;
             flagZN(&A);
-            cycles = 4;
             break;
         case 0x19: // ORA Absolute,Y
-            readAbsoluteIndexed(&addr_abs, Y);
-            value = read(addr_abs);
+            readAbsoluteIndexed<Mode>(&addr_abs, Y);
+            value = busRead<Instrumented, Mode>(addr_abs);
             A |= value;
             flagZN(&A);
-            cycles = 4;
             break;
 
         case 0x29: // AND - AND Accumulator
-            value = read(ProgramCounter);
+            value = cpuRead<Mode>(ProgramCounter);
             ProgramCounter++;
             A &= value;
             flagZN(&A);
-            cycles = 2;
             break;
 
         case 0x25: // AND Zero Page
-            readZeroPage(&addr);
-            value = read(addr);
+            readZeroPage<Mode>(&addr);
+            value = busRead<Instrumented, Mode>(addr);
             A &= value;
             flagZN(&A);
-            cycles = 3;
             break;
         case 0x35: // AND Zero Page,X
-            readZeroPageIndexed(&addr, X);
-            value = read(addr);
+            readZeroPageIndexed<Mode>(&addr, X);
+            value = busRead<Instrumented, Mode>(addr);
             A &= value;
             flagZN(&A);
-            cycles = 3;
             break;
 
         case 0x2D: // AND Absolute
-            readAbsolute(&addr_abs);
-            value = read(addr_abs);
+            readAbsolute<Mode>(&addr_abs);
+            value = busRead<Instrumented, Mode>(addr_abs);
             A &= value;
             flagZN(&A);
-            cycles = 4;
             break;
         case 0x3D: // AND Absolute,X
-            readAbsoluteIndexed(&addr_abs, X);
-            value = read(addr_abs);
+            readAbsoluteIndexed<Mode>(&addr_abs, X);
+            value = busRead<Instrumented, Mode>(addr_abs);
             A &= value;
             flagZN(&A);
-            cycles = 4;
             break;
         case 0x39: // AND Absolute,Y
-            readAbsoluteIndexed(&addr_abs, Y);
-            value = read(addr_abs);
+            readAbsoluteIndexed<Mode>(&addr_abs, Y);
+            value = busRead<Instrumented, Mode>(addr_abs);
             A &= value;
             flagZN(&A);
-            cycles = 4;
             break;
 
         case 0x49: // EOR - XOR Accumulator
-            value = read(ProgramCounter);
+            value = cpuRead<Mode>(ProgramCounter);
             ProgramCounter++;
             A ^= value;
             flagZN(&A);
-            cycles = 2;
             break;
 
         case 0x45: // EOR Zero Page
-            readZeroPage(&addr);
-            value = read(addr);
+            readZeroPage<Mode>(&addr);
+            value = busRead<Instrumented, Mode>(addr);
             A ^= value;
             flagZN(&A);
-            cycles = 3;
             break;
 
         case 0x55: // EOR Zero Page
-            readZeroPageIndexed(&addr, X);
-            value = read(addr);
+            readZeroPageIndexed<Mode>(&addr, X);
+            value = busRead<Instrumented, Mode>(addr);
             A ^= value;
             flagZN(&A);
-            cycles = 3;
             break;
 
         case 0x4D: // EOR Absolute
-            readAbsolute(&addr_abs);
-            value = read(addr_abs);
+            readAbsolute<Mode>(&addr_abs);
+            value = busRead<Instrumented, Mode>(addr_abs);
             A ^= value;
             flagZN(&A);
-            cycles = 4;
             break;
 
         case 0x5D: // EOR Absolute,X
-            readAbsoluteIndexed(&addr_abs, X);
-            value = read(addr_abs);
+            readAbsoluteIndexed<Mode>(&addr_abs, X);
+            value = busRead<Instrumented, Mode>(addr_abs);
             A ^= value;
             flagZN(&A);
-            cycles = 4;
             break;
 
         case 0x59: // EOR Absolute,Y
-            readAbsoluteIndexed(&addr_abs, Y);
-            value = read(addr_abs);
+            readAbsoluteIndexed<Mode>(&addr_abs, Y);
+            value = busRead<Instrumented, Mode>(addr_abs);
             A ^= value;
             flagZN(&A);
-            cycles = 4;
             break;
 
         case 0x69: // ADC Immediate
-            value = read(ProgramCounter);
+            value = cpuRead<Mode>(ProgramCounter);
             ProgramCounter++;
             opADC(value);
-            cycles = 2;
             break;
         case 0x6D: // ADC Absolute
-            readAbsolute(&addr_abs);
-            value = read(addr_abs);
+            readAbsolute<Mode>(&addr_abs);
+            value = busRead<Instrumented, Mode>(addr_abs);
             opADC(value);
-            cycles = 2;
             break;
         case 0x7D: // ADC Absolute,X
-            readAbsoluteIndexed(&addr_abs, X);
-            value = read(addr_abs);
+            readAbsoluteIndexed<Mode>(&addr_abs, X);
+            value = busRead<Instrumented, Mode>(addr_abs);
             opADC(value);
-            cycles = 2;
             break;
         case 0x79: // ADC Absolute,Y
-            readAbsoluteIndexed(&addr_abs, Y);
-            value = read(addr_abs);
+            readAbsoluteIndexed<Mode>(&addr_abs, Y);
+            value = busRead<Instrumented, Mode>(addr_abs);
             opADC(value);
-            cycles = 2;
             break;
         case 0x65: // ADC Zero Page
-            readZeroPage(&addr);
-            value = read(addr);
+            readZeroPage<Mode>(&addr);
+            value = busRead<Instrumented, Mode>(addr);
             ProgramCounter++;
             opADC(value);
-            cycles = 2;
             break;
         case 0x75: // ADC Zero Page,X
-            readZeroPageIndexed(&addr, X);
-            value = read(addr);
+            readZeroPageIndexed<Mode>(&addr, X);
+            value = busRead<Instrumented, Mode>(addr);
             ProgramCounter++;
             opADC(value);
-            cycles = 2;
             break;
 
         case 0xE9: // SBC Immediate
-            value = read(ProgramCounter);
+            value = cpuRead<Mode>(ProgramCounter);
             ProgramCounter++;
             opSBC(value);
-            cycles = 2;
             break;
         case 0xED: // SBC Absolute
-            readAbsolute(&addr_abs);
-            value = read(addr_abs);
+            readAbsolute<Mode>(&addr_abs);
+            value = busRead<Instrumented, Mode>(addr_abs);
             opSBC(value);
-            cycles = 3;
             break;
         case 0xFD: // SBC Absolute,X
-            readAbsoluteIndexed(&addr_abs, X);
-            value = read(addr_abs);
+            readAbsoluteIndexed<Mode>(&addr_abs, X);
+            value = busRead<Instrumented, Mode>(addr_abs);
             opSBC(value);
-            cycles = 3;
             break;
         case 0xF9: // SBC Absolute,Y
-            readAbsoluteIndexed(&addr_abs, Y);
-            value = read(addr_abs);
+            readAbsoluteIndexed<Mode>(&addr_abs, Y);
+            value = busRead<Instrumented, Mode>(addr_abs);
             opSBC(value);
-            cycles = 3;
             break;
         case 0xE5: // SBC Zero Page
-            readZeroPage(&addr);
-            value = read(addr);
+            readZeroPage<Mode>(&addr);
+            value = busRead<Instrumented, Mode>(addr);
             opSBC(value);
-            cycles = 3;
             break;
         case 0xF5: // SBC Zero Page,X
-            readZeroPageIndexed(&addr, X);
-            value = read(addr);
+            readZeroPageIndexed<Mode>(&addr, X);
+            value = busRead<Instrumented, Mode>(addr);
             opSBC(value);
-            cycles = 3;
             break;
 
         case 0xC9: // CMP Immediate
-            value = read(ProgramCounter);
+            value = cpuRead<Mode>(ProgramCounter);
             ProgramCounter++;
             opCMP(value, A);
-            cycles = 2;
             break;
 
         case 0xC5: // CMP Zero Page
-            readZeroPage(&addr);
-            value = read(addr);
+            readZeroPage<Mode>(&addr);
+            value = busRead<Instrumented, Mode>(addr);
             opCMP(value, A);
-            cycles = 2;
             break;
 
         case 0xD5: // CMP Zero Page,X
-            readZeroPageIndexed(&addr, X);
-            value = read(addr);
+            readZeroPageIndexed<Mode>(&addr, X);
+            value = busRead<Instrumented, Mode>(addr);
             opCMP(value, A);
-            cycles = 2;
             break;
 
         case 0xCD: // CMP Absolute
-            readAbsolute(&addr_abs);
-            value = read(addr_abs);
+            readAbsolute<Mode>(&addr_abs);
+            value = busRead<Instrumented, Mode>(addr_abs);
             opCMP(value, A);
-            cycles = 2;
             break;
         case 0xDD: // CMP Absolute,X
-            readAbsoluteIndexed(&addr_abs, X);
-            value = read(addr_abs);
+            readAbsoluteIndexed<Mode>(&addr_abs, X);
+            value = busRead<Instrumented, Mode>(addr_abs);
             opCMP(value, A);
-            cycles = 2;
             break;
         case 0xD9: // CMP Absolute,Y
-            readAbsoluteIndexed(&addr_abs, Y);
-            value = read(addr_abs);
+            readAbsoluteIndexed<Mode>(&addr_abs, Y);
+            value = busRead<Instrumented, Mode>(addr_abs);
             opCMP(value, A);
-            cycles = 2;
             break;
 
         case 0xE0: // CPX Immediate
-            value = read(ProgramCounter);
+            value = cpuRead<Mode>(ProgramCounter);
             ProgramCounter++;
             opCMP(value, X);
-            cycles = 2;
             break;
         case 0xE4: // CPX Zero Page
-            readZeroPage(&addr);
-            value = read(addr);
+            readZeroPage<Mode>(&addr);
+            value = busRead<Instrumented, Mode>(addr);
             opCMP(value, X);
-            cycles = 2;
             break;
 
         case 0xC0: // CPY Immediate
-            value = read(ProgramCounter);
+            value = cpuRead<Mode>(ProgramCounter);
             ProgramCounter++;
             opCMP(value, Y);
-            cycles = 2;
             break;
 
         case 0xC4: // CPY Zero Page
-            readZeroPage(&addr);
-            value = read(addr);
+            readZeroPage<Mode>(&addr);
+            value = busRead<Instrumented, Mode>(addr);
             opCMP(value, Y);
-            cycles = 2;
             break;
 
         case 0x24: // BIT Zero Page
-            readZeroPage(&addr);
-            value = read(addr);
+            readZeroPage<Mode>(&addr);
+            value = busRead<Instrumented, Mode>(addr);
             opBIT(value);
-            cycles = 3;
             break;
 
         case 0x2C: // BIT Absolute
-            readAbsolute(&addr_abs);
-            value = read(addr_abs);
+            readAbsolute<Mode>(&addr_abs);
+            value = busRead<Instrumented, Mode>(addr_abs);
             opBIT(value);
-            cycles = 4;
             break;
 
         case 0x00: // BRK
             ProgramCounter++;
-            push(static_cast<uint8_t>(ProgramCounter >> 8));
-            push(static_cast<uint8_t>(ProgramCounter));
+            push<Mode>(static_cast<uint8_t>(ProgramCounter >> 8));
+            push<Mode>(static_cast<uint8_t>(ProgramCounter));
             addr = 0;
             addr += static_cast<uint8_t>(flag_Carry ? 1 : 0);
             addr += static_cast<uint8_t>(flag_Zero ? 2 : 0);
@@ -1176,73 +1729,107 @@ class Emulator {
             addr += 0x20;
             addr += static_cast<uint8_t>(flag_Overflow ? 0x40 : 0);
             addr += static_cast<uint8_t>(flag_Negative ? 0x80 : 0);
-            push(addr);
-            addr_low = read(0xFFFE);
-            addr_high = read(0xFFFF);
+            push<Mode>(addr);
+            addr_low = cpuRead<Mode>(0xFFFE);
+            addr_high = cpuRead<Mode>(0xFFFF);
             ProgramCounter =
                 static_cast<uint16_t>((addr_high * 0x100) + addr_low);
-            cycles = 7;
+            if constexpr (Instrumented) {
+                if (profiler)
+                    profiler->onInterrupt(ProgramCounter);
+            }
             break;
 
         case 0x40: // RTI
-            addr = pull();
+            addr = pull<Mode>();
             flag_Carry = (addr & 1) != 0;
             flag_Zero = (addr & 2) != 0;
             flag_InterruptDisable = (addr & 4) != 0;
             flag_Decimal = (addr & 8) != 0;
             flag_Overflow = (addr & 0x40) != 0;
             flag_Negative = (addr & 0x80) != 0;
-            addr_low = pull();
-            addr_high = pull();
+            addr_low = pull<Mode>();
+            addr_high = pull<Mode>();
             ProgramCounter =
                 static_cast<uint16_t>((addr_high * 0x100) + addr_low);
-            cycles = 6;
+            pollIrq();
+            if constexpr (Instrumented) {
+                if (profiler)
+                    profiler->onReturnFromInterrupt();
+            }
             break;
 
         case 0x38: // SEC - SEt Carry
             flag_Carry = 1;
-            cycles = 2;
             break;
 
         case 0xF8: // SED - SEt Decimal
             flag_Decimal = 1;
-            cycles = 2;
             break;
 
         case 0x78: // SEI - SEt Interrupt Disable
             flag_InterruptDisable = 1;
-            cycles = 2;
             break;
 
         case 0x18: // CLC - CLear Carry
             flag_Carry = 0;
-            cycles = 2;
             break;
 
         case 0xD8: // CLD - CLear Decimal
             flag_Decimal = 0;
-            cycles = 2;
             break;
 
         case 0x58: // CLI - CLear Interrupt disable
             flag_InterruptDisable = 0;
-            cycles = 2;
+            pollIrq();
             break;
 
         case 0xB8: // CLV - CLear oVerflow
             flag_Overflow = 0;
-            cycles = 2;
             break;
 
         default:
-            std::cout << "Unknown opcode 0x" << std::hex
-                      << static_cast<unsigned int>(opcode)
-                      << ", bailing out, you're on your own!" << std::endl;
+            if (tracing)
+                std::cout << "Unknown opcode 0x" << std::hex
+                          << static_cast<unsigned int>(opcode)
+                          << ", bailing out, you're on your own!" << std::dec
+                          << std::endl;
             CpuHalted = true;
             break;
         }
 
-        tracelog(opcode);
+        if constexpr (Mode == Stepping::Cycle) {
+            // Accesses already advanced the clock; only idle cycles are left.
+            cycleCount = std::max(cycleCount, firstCycle + static_cast<uint64_t>(cycles));
+        } else {
+            cycleCount += static_cast<uint64_t>(cycles);
+        }
+
+        if constexpr (Instrumented) {
+            if (profiler)
+                profiler->endInstruction(cycles);
+            if (traceWriter)
+                traceWriter->end(opcode);
+            if (cdl && opcode == 0x6C && ProgramCounter >= 0x8000)
+                cdl->log(prgOffset(ProgramCounter), ProgramCounter, CodeDataLogger::IndirectCode);
+            if (debugger && (debugger->consumeWatchHit() || debugger->checkStepped()))
+                paused = true;
+        }
+
+        if (tracing)
+            tracelog(instructionAddress);
+    }
+
+    // The PRG-ROM byte behind a bus address at $8000 or above.
+    uint32_t prgOffset(uint16_t addr) const { return static_cast<uint32_t>(addr - 0x8000) & prgMask; }
+
+    // Marks the instruction's bytes as code, and remembers whether its data
+    // accesses go through a pointer.
+    void logInstruction(uint16_t pc, uint8_t opcode) {
+        const AddressingMode mode = kOpcodeModes[opcode];
+        cdlIndirect = mode == AddressingMode::IndexedIndirect || mode == AddressingMode::IndirectIndexed;
+        if (pc >= 0x8000)
+            cdl->logCode(prgOffset(pc), pc, instructionLength(mode));
     }
 
     void opADC(uint8_t input) {
@@ -1281,20 +1868,88 @@ class Emulator {
         flag_Overflow = (input & 0x40) != 0;
     }
 
-    void tracelog(uint8_t opcode) {
-        std::string line = std::format(
-            "{:04X} \t {:02X} \t {:<4} \t A:{:02X} X:{:02X} Y:{:02X}\t "
+    // One line per instruction: its address, bytes and disassembly, then the
+    // registers after it ran.
+    void tracelog(uint16_t address) {
+        const Disassembler::Line &line = disassembler.decode(*this, address);
+        std::string bytes;
+        for (int i = 0; i < 3; i++)
+            bytes += i < line.length ? std::format("{:02X} ", line.bytes[i]) : "   ";
+        std::string text = std::format(
+            "{:04X} \t {}\t {:<16} \t A:{:02X} X:{:02X} Y:{:02X}\t "
             "{}{}{}{}{}{}{} \n",
-            ProgramCounter, opcode, opCodesArr[opcode], A, X, Y,
+            address, bytes, line.text, A, X, Y,
             (flag_Negative ? "N" : "n"), (flag_Overflow ? "V" : "v"), "--",
             (flag_Decimal ? "D" : "d"), (flag_InterruptDisable ? "I" : "i"),
             (flag_Zero ? "Z" : "z"), (flag_Carry ? "C" : "c"));
-        std::cout << line;
+        std::cout << text;
     }
 
+    // Shared by the trace and the debug console, so both reuse its cache.
+    Disassembler &getDisassembler() { return disassembler; }
+
   private:
+    // Interrupts are only taken between scheduler deadlines, so anything that
+    // makes one deliverable brings the next deadline forward to now.
+    void raiseNmi() {
+        nmiPending = true;
+        scheduler.schedule(Scheduler::Event::IrqPoll, cycleCount);
+    }
+
+    void pollIrq() {
+        if (frameIrq && !flag_InterruptDisable)
+            scheduler.schedule(Scheduler::Event::IrqPoll, cycleCount);
+    }
+
+    static constexpr uint64_t dotToCycle(uint64_t dot) { return (dot + 2) / 3; }
+    uint64_t frameStartDot() const { return frameCount * kDotsPerFrame; }
+
     uint16_t ProgramCounter;
     bool CpuHalted = false;
+    uint64_t cycleCount = 0;
+
+    bool paused = false;
+    bool loaded = false;
+    bool tracing = true;
+    bool idleSkip = true;
+    IdleSkipStats idleStats;
+    bool frameEnded = false;
+    Stepping stepping = Stepping::Instruction;
+    uint64_t lastInstructionCycle = 0;
+    uint64_t frameCount = 0;
+    uint64_t romHash = 0;
+
+    static constexpr uint64_t kDotsPerFrame = 341 * 262;
+    static constexpr uint64_t kVBlankStartDot = 241 * 341 + 1;
+    static constexpr uint64_t kVBlankEndDot = 261 * 341 + 1;
+    static constexpr uint64_t kLineRenderDot = 256;
+    static constexpr uint64_t kFrameIrqPeriod = 29830;
+
+    Scheduler scheduler;
+    Ppu ppu;
+    int scanline = 0;
+    std::array<uint8_t, Ppu::kWidth * Ppu::kHeight> frameBuffer{};
+    uint8_t frameCounterMode = 0;
+    bool frameIrq = false;
+    bool nmiPending = false;
+
+    uint8_t controllerState[2] = {0, 0};
+    uint8_t controllerShift[2] = {0, 0};
+    bool controllerStrobe = false;
+
+    InputState *input = nullptr;
+    FlatBus *flatBus = nullptr;
+    Profiler *profiler = nullptr;
+    BinaryTraceWriter *traceWriter = nullptr;
+    CodeDataLogger *cdl = nullptr;
+    Disassembler disassembler;
+    bool cdlIndirect = false;
+    size_t chrRomSize = 0;
+    Debugger *debugger = nullptr;
+    PpuPipeline *pipeline = nullptr;
+    bool drawPicture = true;
+    bool ppuTiming = false;
+    std::chrono::steady_clock::duration ppuTime{};
     uint16_t stackPointer{};
 
     uint8_t A; // Accumulator
@@ -1304,6 +1959,7 @@ class Emulator {
     std::vector<uint8_t> RAM;
     std::vector<uint8_t> INesHeader;
     std::vector<uint8_t> ROM;
+    uint32_t prgMask = 0x7FFF;
 
     bool flag_Carry = false;
     bool flag_Zero = false;
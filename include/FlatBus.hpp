@@ -0,0 +1,29 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// 64 KiB of plain RAM in place of the NES memory map, for CPU conformance
+// tests: no mirroring, no devices, and every access the CPU makes is logged
+// in order.
+struct FlatBus {
+    struct Access {
+        uint16_t addr;
+        uint8_t value;
+        bool write;
+    };
+
+    std::array<uint8_t, 0x10000> memory{};
+    std::vector<Access> log;
+
+    uint8_t read(uint16_t addr) {
+        const uint8_t value = memory[addr];
+        log.push_back({addr, value, false});
+        return value;
+    }
+
+    void write(uint16_t addr, uint8_t value) {
+        memory[addr] = value;
+        log.push_back({addr, value, true});
+    }
+};
@@ -0,0 +1,226 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+// FNV-1a, 64-bit. Small and good enough to fingerprint ROMs and save states.
+inline uint64_t fnv1a64(const void *data, size_t size,
+                        uint64_t hash = 0xCBF29CE484222325ull) {
+    const auto *bytes = static_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3ull;
+    }
+    return hash;
+}
+
+// CRC-32 (IEEE, as used by No-Intro and GoodNES), slicing-by-8: eight table
+// lookups per 8 input bytes instead of one per byte.
+class Crc32 {
+  public:
+    static uint32_t compute(const void *data, size_t size, uint32_t crc = 0) {
+        static const Tables tables;
+        const auto *p = static_cast<const uint8_t *>(data);
+        crc = ~crc;
+        while (size >= 8) {
+            uint32_t lo = crc ^ (static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 |
+                                 static_cast<uint32_t>(p[2]) << 16 | static_cast<uint32_t>(p[3]) << 24);
+            crc = tables.t[7][lo & 0xFF] ^ tables.t[6][(lo >> 8) & 0xFF] ^
+                  tables.t[5][(lo >> 16) & 0xFF] ^ tables.t[4][lo >> 24] ^
+                  tables.t[3][p[4]] ^ tables.t[2][p[5]] ^ tables.t[1][p[6]] ^ tables.t[0][p[7]];
+            p += 8;
+            size -= 8;
+        }
+        while (size--)
+            crc = tables.t[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+        return ~crc;
+    }
+
+  private:
+    struct Tables {
+        uint32_t t[8][256];
+        Tables() {
+            for (uint32_t i = 0; i < 256; i++) {
+                uint32_t c = i;
+                for (int k = 0; k < 8; k++)
+                    c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                t[0][i] = c;
+            }
+            for (uint32_t i = 0; i < 256; i++) {
+                for (int k = 1; k < 8; k++)
+                    t[k][i] = t[0][t[k - 1][i] & 0xFF] ^ (t[k - 1][i] >> 8);
+            }
+        }
+    };
+};
+
+// SHA-1, for matching ROM databases. Not for anything security related.
+class Sha1 {
+  public:
+    using Digest = std::array<uint8_t, 20>;
+
+    static Digest compute(const void *data, size_t size) {
+        uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+        const auto *p = static_cast<const uint8_t *>(data);
+
+        size_t full = size / 64;
+        for (size_t i = 0; i < full; i++)
+            block(h, p + i * 64);
+
+        // Padding: 0x80, zeros, then the bit length, over one or two blocks.
+        uint8_t tail[128] = {};
+        size_t rest = size % 64;
+        std::memcpy(tail, p + full * 64, rest);
+        tail[rest] = 0x80;
+        size_t tailSize = rest < 56 ? 64 : 128;
+        uint64_t bits = static_cast<uint64_t>(size) * 8;
+        for (int i = 0; i < 8; i++)
+            tail[tailSize - 1 - i] = static_cast<uint8_t>(bits >> (8 * i));
+        for (size_t off = 0; off < tailSize; off += 64)
+            block(h, tail + off);
+
+        Digest digest;
+        for (int i = 0; i < 5; i++) {
+            for (int b = 0; b < 4; b++)
+                digest[i * 4 + b] = static_cast<uint8_t>(h[i] >> (24 - 8 * b));
+        }
+        return digest;
+    }
+
+    static std::string hex(const Digest &digest) {
+        static const char digits[] = "0123456789abcdef";
+        std::string out;
+        for (uint8_t b : digest) {
+            out += digits[b >> 4];
+            out += digits[b & 15];
+        }
+        return out;
+    }
+
+  private:
+    static uint32_t rotl(uint32_t v, int n) { return (v << n) | (v >> (32 - n)); }
+
+    static void block(uint32_t h[5], const uint8_t *p) {
+        uint32_t w[80];
+        for (int i = 0; i < 16; i++)
+            w[i] = static_cast<uint32_t>(p[i * 4]) << 24 | static_cast<uint32_t>(p[i * 4 + 1]) << 16 |
+                   static_cast<uint32_t>(p[i * 4 + 2]) << 8 | p[i * 4 + 3];
+        for (int i = 16; i < 80; i++)
+            w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; i++) {
+            uint32_t f, k;
+            if (i < 20) {
+                f = (b & c) | (~b & d);
+                k = 0x5A827999;
+            } else if (i < 40) {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1;
+            } else if (i < 60) {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8F1BBCDC;
+            } else {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6;
+            }
+            uint32_t t = rotl(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = rotl(b, 30);
+            b = a;
+            a = t;
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+    }
+};
+
+// XXH64. Four independent 64-bit accumulators over 32-byte stripes, so it
+// runs at several GB/s: fast enough to fingerprint every video frame.
+class Xxh64 {
+  public:
+    static uint64_t compute(const void *data, size_t size, uint64_t seed = 0) {
+        const auto *p = static_cast<const uint8_t *>(data);
+        const uint8_t *end = p + size;
+        uint64_t h;
+        if (size >= 32) {
+            uint64_t v1 = seed + P1 + P2;
+            uint64_t v2 = seed + P2;
+            uint64_t v3 = seed;
+            uint64_t v4 = seed - P1;
+            const uint8_t *limit = end - 32;
+            do {
+                v1 = round(v1, read64(p));
+                v2 = round(v2, read64(p + 8));
+                v3 = round(v3, read64(p + 16));
+                v4 = round(v4, read64(p + 24));
+                p += 32;
+            } while (p <= limit);
+            h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+            h = merge(h, v1);
+            h = merge(h, v2);
+            h = merge(h, v3);
+            h = merge(h, v4);
+        } else {
+            h = seed + P5;
+        }
+        h += size;
+
+        for (; p + 8 <= end; p += 8) {
+            h ^= round(0, read64(p));
+            h = rotl(h, 27) * P1 + P4;
+        }
+        if (p + 4 <= end) {
+            h ^= read32(p) * P1;
+            h = rotl(h, 23) * P2 + P3;
+            p += 4;
+        }
+        for (; p < end; p++) {
+            h ^= *p * P5;
+            h = rotl(h, 11) * P1;
+        }
+
+        h ^= h >> 33;
+        h *= P2;
+        h ^= h >> 29;
+        h *= P3;
+        h ^= h >> 32;
+        return h;
+    }
+
+  private:
+    static constexpr uint64_t P1 = 0x9E3779B185EBCA87ull;
+    static constexpr uint64_t P2 = 0xC2B2AE3D27D4EB4Full;
+    static constexpr uint64_t P3 = 0x165667B19E3779F9ull;
+    static constexpr uint64_t P4 = 0x85EBCA77C2B2AE63ull;
+    static constexpr uint64_t P5 = 0x27D4EB2F165667C5ull;
+
+    static uint64_t rotl(uint64_t v, int n) { return (v << n) | (v >> (64 - n)); }
+
+    static uint64_t read64(const uint8_t *p) {
+        return static_cast<uint64_t>(p[0]) | static_cast<uint64_t>(p[1]) << 8 | static_cast<uint64_t>(p[2]) << 16 |
+               static_cast<uint64_t>(p[3]) << 24 | static_cast<uint64_t>(p[4]) << 32 |
+               static_cast<uint64_t>(p[5]) << 40 | static_cast<uint64_t>(p[6]) << 48 |
+               static_cast<uint64_t>(p[7]) << 56;
+    }
+
+    static uint64_t read32(const uint8_t *p) {
+        return static_cast<uint64_t>(p[0] | p[1] << 8 | p[2] << 16 | static_cast<uint32_t>(p[3]) << 24);
+    }
+
+    static uint64_t round(uint64_t acc, uint64_t input) {
+        acc += input * P2;
+        return rotl(acc, 31) * P1;
+    }
+
+    static uint64_t merge(uint64_t h, uint64_t v) {
+        h ^= round(0, v);
+        return h * P1 + P4;
+    }
+};
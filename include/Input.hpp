@@ -0,0 +1,84 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// Controller state handed from the thread that reads host input to the one
+// that runs the emulator.
+//
+// Both ports and the time of the host event that produced them are packed in
+// one 64-bit word, so the emulator always sees a consistent snapshot without
+// locking. The emulator samples it when the game strobes $4016, which is the
+// latest moment the input can still affect the frame.
+class InputState {
+  public:
+    // Host input side. `eventTimeUs` is when the host event happened.
+    void publish(uint8_t port1, uint8_t port2, uint64_t eventTimeUs) {
+        uint64_t word = (eventTimeUs << 16) | static_cast<uint64_t>(port2) << 8 | port1;
+        state.store(word, std::memory_order_release);
+    }
+
+    /*
+     * Emulator side.
+     */
+
+    // Returns both ports, port 1 in the low byte. A change since the last
+    // latch starts a latency measurement, closed by presented().
+    uint16_t latch() {
+        uint64_t word = state.load(std::memory_order_acquire);
+        auto buttons = static_cast<uint16_t>(word & 0xFFFF);
+        if (buttons != lastLatched && pendingEventUs == 0)
+            pendingEventUs = word >> 16;
+        lastLatched = buttons;
+        return buttons;
+    }
+
+    // Called right after a frame that may contain latched input is shown.
+    void presented(uint64_t nowUs) {
+        if (pendingEventUs == 0)
+            return;
+        uint64_t latency = nowUs > pendingEventUs ? nowUs - pendingEventUs : 0;
+        pendingEventUs = 0;
+        if (samples.size() < kMaxSamples)
+            samples.push_back(latency);
+        else
+            samples[sampleCount % kMaxSamples] = latency;
+        sampleCount++;
+        lastLatencyUs = latency;
+    }
+
+    struct LatencyStats {
+        uint64_t count = 0;
+        uint64_t lastUs = 0;
+        uint64_t medianUs = 0;
+        uint64_t p99Us = 0;
+        uint64_t maxUs = 0;
+    };
+
+    // Input-event-to-present latency over the last kMaxSamples changes.
+    LatencyStats latency() const {
+        LatencyStats stats;
+        stats.count = sampleCount;
+        stats.lastUs = lastLatencyUs;
+        if (samples.empty())
+            return stats;
+        std::vector<uint64_t> sorted = samples;
+        std::sort(sorted.begin(), sorted.end());
+        stats.medianUs = sorted[sorted.size() / 2];
+        stats.p99Us = sorted[(sorted.size() - 1) * 99 / 100];
+        stats.maxUs = sorted.back();
+        return stats;
+    }
+
+  private:
+    static constexpr size_t kMaxSamples = 1024;
+
+    std::atomic<uint64_t> state{0};
+
+    uint16_t lastLatched = 0;
+    uint64_t pendingEventUs = 0;
+    uint64_t sampleCount = 0;
+    uint64_t lastLatencyUs = 0;
+    std::vector<uint64_t> samples;
+};
@@ -0,0 +1,98 @@
+#pragma once
+#include <charconv>
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+// Names for guest addresses, shared by the profiler and the disassembler.
+// Accepts FCEUX .nl files ("$C000#Name#Comment") and ca65 .dbg files
+// ("sym id=0,name=\"Name\",...,val=0xC000,...,type=lab").
+class Labels {
+  public:
+    void load(const char *filename) {
+        std::ifstream file(filename);
+        if (!file)
+            throw std::runtime_error("Failed to open the label file.");
+
+        std::string path(filename);
+        bool isDbg = path.size() >= 4 && path.compare(path.size() - 4, 4, ".dbg") == 0;
+
+        std::string line;
+        while (std::getline(file, line)) {
+            if (isDbg)
+                parseDbgLine(line);
+            else
+                parseNlLine(line);
+        }
+    }
+
+    const std::string *find(uint16_t address) const {
+        auto it = names.find(address);
+        return it != names.end() ? &it->second : nullptr;
+    }
+
+    bool empty() const { return names.empty(); }
+
+  private:
+    void parseNlLine(const std::string &line) {
+        if (line.size() < 2 || line[0] != '$')
+            return;
+        size_t hash = line.find('#');
+        if (hash == std::string::npos)
+            return;
+        size_t end = line.find('#', hash + 1);
+        std::string name = line.substr(hash + 1, end == std::string::npos
+                                                     ? std::string::npos
+                                                     : end - hash - 1);
+        if (name.empty())
+            return;
+        // "$C000/10#Table#" declares an array; the address ends at the slash.
+        uint16_t address;
+        if (parseAddress(line.substr(1, 4), 16, address))
+            names.try_emplace(address, name);
+    }
+
+    void parseDbgLine(const std::string &line) {
+        if (line.compare(0, 4, "sym\t") != 0)
+            return;
+        std::string name = dbgField(line, "name");
+        std::string val = dbgField(line, "val");
+        std::string type = dbgField(line, "type");
+        if (name.size() < 2 || val.empty() || (!type.empty() && type != "lab"))
+            return;
+        name = name.substr(1, name.size() - 2); // strip quotes
+        uint16_t address;
+        const bool hex = val.compare(0, 2, "0x") == 0 || val.compare(0, 2, "0X") == 0;
+        if (parseAddress(hex ? val.substr(2) : val, hex ? 16 : 10, address))
+            names.try_emplace(address, name);
+    }
+
+    // A line with a malformed address is skipped, not the whole file.
+    static bool parseAddress(const std::string &text, int base, uint16_t &address) {
+        unsigned long value = 0;
+        const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value, base);
+        if (error != std::errc() || end == text.data())
+            return false;
+        address = static_cast<uint16_t>(value);
+        return true;
+    }
+
+    static std::string dbgField(const std::string &line, const std::string &key) {
+        size_t pos = 0;
+        std::string needle = key + "=";
+        while ((pos = line.find(needle, pos)) != std::string::npos) {
+            if (pos == 4 || line[pos - 1] == ',')
+                break;
+            pos += needle.size();
+        }
+        if (pos == std::string::npos)
+            return {};
+        pos += needle.size();
+        size_t end = line.find(',', pos);
+        return line.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+    }
+
+    std::unordered_map<uint16_t, std::string> names;
+};
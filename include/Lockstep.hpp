@@ -0,0 +1,837 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "Emulator.hpp"
+#include "Hash.hpp"
+#include "OpcodeTable.hpp"
+#include "RomHeader.hpp"
+
+struct LockstepStats {
+    uint64_t groupSteps = 0;       // Instructions decoded once for several lanes
+    uint64_t scalarSteps = 0;      // Instructions run for a single lane
+    uint64_t laneInstructions = 0; // Instructions executed, summed over lanes
+};
+
+// Experimental core that runs `Lanes` consoles of one game side by side.
+//
+// Registers and RAM are stored lane-minor (ram[address][lane]). While the
+// lanes sit at the same PC, an instruction is fetched and decoded once, and
+// its effect is a short loop over the lanes that the compiler turns into
+// vector code. When the lanes diverge, for example on a branch that goes
+// different ways, the lanes at the lowest PC run as a smaller group so the
+// others can catch up. A group of one lane takes the plain scalar path.
+//
+// Only the CPU, RAM, the controllers and the PPU's VBlank flag and NMI are
+// modelled. There is no rendering, no sprite-0 hit and no APU: no frame IRQ,
+// and $4015 is not there. It suits games whose state lives in RAM.
+// Instructions take the cycles in kCoreCycles, as in Emulator, and the
+// opcodes Emulator halts on halt the lane. Lanes still diverge from Emulator
+// where its results are known to be wrong: ADC zero page and zero page,X and
+// JMP indirect.
+template <size_t Lanes> class LockstepCore {
+    static_assert(Lanes >= 1);
+
+  public:
+    // NROM only, like Emulator: PRG is mirrored over $8000-$FFFF.
+    explicit LockstepCore(const std::vector<uint8_t> &rom) {
+        if (rom.size() < 16)
+            throw std::runtime_error("The ROM is too small.");
+        RomHeader info = RomHeader::parse(rom.data(), rom.size());
+        size_t prgStart = 16 + (info.valid && info.trainer ? 512 : 0);
+        size_t prgSize = info.valid ? info.prgSize : rom.size() - 16;
+        if (prgSize == 0 || prgStart + prgSize > rom.size())
+            throw std::runtime_error("The ROM is truncated.");
+        for (size_t i = 0; i < prg.size(); i++)
+            prg[i] = rom[prgStart + i % prgSize];
+        powerOn();
+    }
+
+    void powerOn() {
+        const auto reset = static_cast<uint16_t>(prg[0x7FFC] | prg[0x7FFD] << 8);
+        for (size_t i = 0; i < Lanes; i++) {
+            a[i] = x[i] = y[i] = 0;
+            sp[i] = 0xFD;
+            p[i] = 0x24;
+            pc[i] = reset;
+            cycles[i] = 0;
+            padState[0][i] = padState[1][i] = 0;
+            padShift[0][i] = padShift[1][i] = 0;
+            strobe[i] = 0;
+            ppuCtrl[i] = ppuStatus[i] = 0;
+            nmiPending[i] = 0;
+            halted[i] = 0;
+        }
+        for (auto &row : ram)
+            row.fill(0);
+        pendingNmis = 0;
+        frameCount = 0;
+    }
+
+    // Puts every lane in the state an Emulator saved between two frames.
+    void loadState(const Emulator::State &s) {
+        for (size_t i = 0; i < Lanes; i++) {
+            pc[i] = s.cpu.pc;
+            a[i] = s.cpu.a;
+            x[i] = s.cpu.x;
+            y[i] = s.cpu.y;
+            sp[i] = s.cpu.sp;
+            p[i] = static_cast<uint8_t>((s.cpu.p & 0xCF) | 0x20);
+            cycles[i] = s.cpu.cycles;
+            for (int port = 0; port < 2; port++) {
+                padState[port][i] = s.controllerState[port];
+                padShift[port][i] = s.controllerShift[port];
+            }
+            strobe[i] = s.controllerStrobe;
+            ppuCtrl[i] = s.ppu.nmiEnabled() ? 0x80 : 0;
+            ppuStatus[i] = s.ppu.inVBlank() ? 0x80 : 0;
+            nmiPending[i] = s.nmiPending;
+            halted[i] = s.halted;
+        }
+        for (size_t addr = 0; addr < ram.size(); addr++)
+            ram[addr].fill(s.ram[addr]);
+        pendingNmis = s.nmiPending ? Lanes : 0;
+        frameCount = s.frameCount;
+    }
+
+    void setInput(size_t lane, uint8_t port1, uint8_t port2) {
+        padState[0][lane] = port1;
+        padState[1][lane] = port2;
+    }
+
+    // Off, every lane runs on its own: the baseline the lockstep mode is
+    // measured against.
+    void setLockstep(bool enabled) { lockstep = enabled; }
+
+    // Same frame timing as Emulator::runFrame.
+    void runFrame() {
+        const uint64_t start = frameCount * kDotsPerFrame;
+        runUntil(dotToCycle(start + kVBlankStartDot));
+        for (size_t i = 0; i < Lanes; i++) {
+            ppuStatus[i] |= 0x80;
+            if ((ppuCtrl[i] & 0x80) && !nmiPending[i]) {
+                nmiPending[i] = 1;
+                pendingNmis++;
+            }
+        }
+        takeNmis();
+        runUntil(dotToCycle(start + kVBlankEndDot));
+        for (size_t i = 0; i < Lanes; i++)
+            ppuStatus[i] &= 0x1F;
+        runUntil(dotToCycle(start + kDotsPerFrame));
+        frameCount++;
+    }
+
+    CpuRegisters registers(size_t lane) const {
+        return {pc[lane], a[lane], x[lane], y[lane], sp[lane], p[lane], cycles[lane]};
+    }
+    uint8_t peekRam(size_t lane, uint16_t addr) const { return ram[addr & 0x07FF][lane]; }
+    bool isHalted(size_t lane) const { return halted[lane] != 0; }
+    uint64_t getFrameCount() const { return frameCount; }
+    const LockstepStats &statistics() const { return stats; }
+
+    // Fingerprint of one lane's registers and RAM.
+    uint64_t laneHash(size_t lane) const {
+        CpuRegisters r = registers(lane);
+        uint64_t hash = fnv1a64(&r.pc, sizeof(r.pc));
+        const uint8_t regs[] = {r.a, r.x, r.y, r.sp, r.p, halted[lane]};
+        hash = fnv1a64(regs, sizeof(regs), hash);
+        hash = fnv1a64(&r.cycles, sizeof(r.cycles), hash);
+        std::array<uint8_t, 0x0800> column;
+        for (size_t addr = 0; addr < column.size(); addr++)
+            column[addr] = ram[addr][lane];
+        return fnv1a64(column.data(), column.size(), hash);
+    }
+
+  private:
+    enum class Op : uint8_t {
+        Illegal, ADC, AND, ASL, BCC, BCS, BEQ, BIT, BMI, BNE, BPL, BRK, BVC, BVS, CLC, CLD, CLI, CLV,
+        CMP, CPX, CPY, DEC, DEX, DEY, EOR, INC, INX, INY, JMP, JSR, LDA, LDX, LDY, LSR, NOP, ORA, PHA,
+        PHP, PLA, PLP, ROL, ROR, RTI, RTS, SBC, SEC, SED, SEI, STA, STX, STY, TAX, TAY, TSX, TXA, TXS, TYA,
+    };
+
+    // Operation of every official opcode; the addressing mode comes from
+    // kOpcodeModes.
+    static constexpr std::array<Op, 256> kOps = [] {
+        std::array<Op, 256> ops{};
+        auto set = [&ops](Op op, std::initializer_list<uint8_t> opcodes) {
+            for (uint8_t opcode : opcodes)
+                ops[opcode] = op;
+        };
+        set(Op::ADC, {0x69, 0x65, 0x75, 0x6D, 0x7D, 0x79, 0x61, 0x71});
+        set(Op::AND, {0x29, 0x25, 0x35, 0x2D, 0x3D, 0x39, 0x21, 0x31});
+        set(Op::ASL, {0x0A, 0x06, 0x16, 0x0E, 0x1E});
+        set(Op::BCC, {0x90});
+        set(Op::BCS, {0xB0});
+        set(Op::BEQ, {0xF0});
+        set(Op::BIT, {0x24, 0x2C});
+        set(Op::BMI, {0x30});
+        set(Op::BNE, {0xD0});
+        set(Op::BPL, {0x10});
+        set(Op::BRK, {0x00});
+        set(Op::BVC, {0x50});
+        set(Op::BVS, {0x70});
+        set(Op::CLC, {0x18});
+        set(Op::CLD, {0xD8});
+        set(Op::CLI, {0x58});
+        set(Op::CLV, {0xB8});
+        set(Op::CMP, {0xC9, 0xC5, 0xD5, 0xCD, 0xDD, 0xD9, 0xC1, 0xD1});
+        set(Op::CPX, {0xE0, 0xE4, 0xEC});
+        set(Op::CPY, {0xC0, 0xC4, 0xCC});
+        set(Op::DEC, {0xC6, 0xD6, 0xCE, 0xDE});
+        set(Op::DEX, {0xCA});
+        set(Op::DEY, {0x88});
+        set(Op::EOR, {0x49, 0x45, 0x55, 0x4D, 0x5D, 0x59, 0x41, 0x51});
+        set(Op::INC, {0xE6, 0xF6, 0xEE, 0xFE});
+        set(Op::INX, {0xE8});
+        set(Op::INY, {0xC8});
+        set(Op::JMP, {0x4C, 0x6C});
+        set(Op::JSR, {0x20});
+        set(Op::LDA, {0xA9, 0xA5, 0xB5, 0xAD, 0xBD, 0xB9, 0xA1, 0xB1});
+        set(Op::LDX, {0xA2, 0xA6, 0xB6, 0xAE, 0xBE});
+        set(Op::LDY, {0xA0, 0xA4, 0xB4, 0xAC, 0xBC});
+        set(Op::LSR, {0x4A, 0x46, 0x56, 0x4E, 0x5E});
+        set(Op::NOP, {0xEA});
+        set(Op::ORA, {0x09, 0x05, 0x15, 0x0D, 0x1D, 0x19, 0x01, 0x11});
+        set(Op::PHA, {0x48});
+        set(Op::PHP, {0x08});
+        set(Op::PLA, {0x68});
+        set(Op::PLP, {0x28});
+        set(Op::ROL, {0x2A, 0x26, 0x36, 0x2E, 0x3E});
+        set(Op::ROR, {0x6A, 0x66, 0x76, 0x6E, 0x7E});
+        set(Op::RTI, {0x40});
+        set(Op::RTS, {0x60});
+        set(Op::SBC, {0xE9, 0xE5, 0xF5, 0xED, 0xFD, 0xF9, 0xE1, 0xF1});
+        set(Op::SEC, {0x38});
+        set(Op::SED, {0xF8});
+        set(Op::SEI, {0x78});
+        set(Op::STA, {0x85, 0x95, 0x8D, 0x9D, 0x99, 0x81, 0x91});
+        set(Op::STX, {0x86, 0x96, 0x8E});
+        set(Op::STY, {0x84, 0x94, 0x8C});
+        set(Op::TAX, {0xAA});
+        set(Op::TAY, {0xA8});
+        set(Op::TSX, {0xBA});
+        set(Op::TXA, {0x8A});
+        set(Op::TXS, {0x9A});
+        set(Op::TYA, {0x98});
+        return ops;
+    }();
+
+    static constexpr uint64_t dotToCycle(uint64_t dot) { return (dot + 2) / 3; }
+    static constexpr uint64_t kDotsPerFrame = 341 * 262;
+    static constexpr uint64_t kVBlankStartDot = 241 * 341 + 1;
+    static constexpr uint64_t kVBlankEndDot = 261 * 341 + 1;
+
+    bool running(size_t i, uint64_t deadline) const { return !halted[i] && cycles[i] < deadline; }
+
+    void runUntil(uint64_t deadline) {
+        if (!lockstep) {
+            for (size_t i = 0; i < Lanes; i++) {
+                lane = i;
+                while (running(i, deadline))
+                    step<true>();
+            }
+            return;
+        }
+        for (;;) {
+            if (pendingNmis)
+                takeNmis();
+            // The lanes at the lowest PC go next: lanes that are behind in a
+            // loop or took a shorter path catch up with the others there.
+            size_t leader = Lanes;
+            for (size_t i = 0; i < Lanes; i++) {
+                if (running(i, deadline) && (leader == Lanes || pc[i] < pc[leader]))
+                    leader = i;
+            }
+            if (leader == Lanes)
+                return;
+            lane = leader;
+            // Code in RAM may differ between lanes.
+            const uint16_t at = pc[leader];
+            if (at < 0x8000) {
+                step<true>();
+                continue;
+            }
+            size_t count = 0;
+            for (size_t i = 0; i < Lanes; i++) {
+                mask[i] = running(i, deadline) && pc[i] == at;
+                count += mask[i];
+            }
+            if (count == 1)
+                step<true>();
+            else
+                step<false>();
+        }
+    }
+
+    void takeNmis() {
+        for (size_t i = 0; i < Lanes; i++) {
+            if (nmiPending[i]) {
+                nmiPending[i] = 0;
+                if (!halted[i])
+                    interrupt(i, 0xFFFA);
+            }
+        }
+        pendingNmis = 0;
+    }
+
+    void interrupt(size_t i, uint16_t vector) {
+        push(i, static_cast<uint8_t>(pc[i] >> 8));
+        push(i, static_cast<uint8_t>(pc[i]));
+        push(i, static_cast<uint8_t>(p[i] & ~0x10));
+        p[i] |= 0x04;
+        pc[i] = static_cast<uint16_t>(prg[vector & 0x7FFF] | prg[(vector + 1) & 0x7FFF] << 8);
+        cycles[i] += 7;
+    }
+
+    // Runs f(i) for every lane of the group. In a group of several lanes it
+    // also runs for the lanes outside it, whose results assign() discards:
+    // that keeps the loop free of branches.
+    template <bool Single, typename F> void forGroup(F f) {
+        if constexpr (Single) {
+            f(lane);
+        } else {
+            for (size_t i = 0; i < Lanes; i++)
+                f(i);
+        }
+    }
+
+    // Runs f(i) only for the lanes of the group, for side effects.
+    template <bool Single, typename F> void forMembers(F f) {
+        if constexpr (Single) {
+            f(lane);
+        } else {
+            for (size_t i = 0; i < Lanes; i++) {
+                if (mask[i])
+                    f(i);
+            }
+        }
+    }
+
+    template <bool Single, typename T, typename V> void assign(T *dst, size_t i, V value) {
+        if constexpr (Single)
+            dst[i] = static_cast<T>(value);
+        else
+            dst[i] = mask[i] ? static_cast<T>(value) : dst[i];
+    }
+
+    static uint8_t zn(uint8_t status, uint8_t value) {
+        return static_cast<uint8_t>((status & 0x7D) | (value ? 0 : 0x02) | (value & 0x80));
+    }
+
+    uint8_t read(size_t i, uint16_t addr) {
+        if (addr < 0x2000)
+            return ram[addr & 0x07FF][i];
+        if (addr >= 0x8000)
+            return prg[addr & 0x7FFF];
+        if (addr < 0x4000) {
+            if ((addr & 7) != 2)
+                return 0;
+            uint8_t value = ppuStatus[i];
+            ppuStatus[i] &= 0x7F;
+            return value;
+        }
+        if (addr == 0x4016 || addr == 0x4017) {
+            const int port = addr & 1;
+            if (strobe[i])
+                padShift[port][i] = padState[port][i];
+            uint8_t value = static_cast<uint8_t>(0x40 | (padShift[port][i] & 1));
+            padShift[port][i] = static_cast<uint8_t>(0x80 | (padShift[port][i] >> 1));
+            return value;
+        }
+        return 0;
+    }
+
+    void write(size_t i, uint16_t addr, uint8_t value) {
+        if (addr < 0x2000) {
+            ram[addr & 0x07FF][i] = value;
+        } else if (addr < 0x4000) {
+            if ((addr & 7) != 0)
+                return;
+            // Enabling NMI during VBlank raises one right away.
+            if (!(ppuCtrl[i] & 0x80) && (value & 0x80) && (ppuStatus[i] & 0x80) && !nmiPending[i]) {
+                nmiPending[i] = 1;
+                pendingNmis++;
+            }
+            ppuCtrl[i] = value;
+        } else if (addr == 0x4014) {
+            cycles[i] += 513 + (cycles[i] & 1);
+        } else if (addr == 0x4016) {
+            strobe[i] = value & 1;
+            if (strobe[i]) {
+                padShift[0][i] = padState[0][i];
+                padShift[1][i] = padState[1][i];
+            }
+        }
+    }
+
+    void push(size_t i, uint8_t value) {
+        ram[0x100 + sp[i]][i] = value;
+        sp[i]--;
+    }
+
+    uint8_t pull(size_t i) {
+        sp[i]++;
+        return ram[0x100 + sp[i]][i];
+    }
+
+    // Effective address of the instruction: one for the whole group, or one
+    // per lane in ea[].
+    struct Target {
+        bool uniform;
+        uint16_t addr;
+    };
+
+    template <bool Single> Target resolve(AddressingMode mode, uint8_t lo, uint16_t abs) {
+        switch (mode) {
+        case AddressingMode::ZeroPage:
+            return {true, lo};
+        case AddressingMode::Absolute:
+            return {true, abs};
+        case AddressingMode::ZeroPageX:
+            forGroup<Single>([&](size_t i) { ea[i] = static_cast<uint8_t>(lo + x[i]); });
+            break;
+        case AddressingMode::ZeroPageY:
+            forGroup<Single>([&](size_t i) { ea[i] = static_cast<uint8_t>(lo + y[i]); });
+            break;
+        case AddressingMode::AbsoluteX:
+            forGroup<Single>([&](size_t i) { ea[i] = static_cast<uint16_t>(abs + x[i]); });
+            break;
+        case AddressingMode::AbsoluteY:
+            forGroup<Single>([&](size_t i) { ea[i] = static_cast<uint16_t>(abs + y[i]); });
+            break;
+        case AddressingMode::IndexedIndirect:
+            forGroup<Single>([&](size_t i) {
+                const auto ptr = static_cast<uint8_t>(lo + x[i]);
+                ea[i] = static_cast<uint16_t>(ram[ptr][i] | ram[static_cast<uint8_t>(ptr + 1)][i] << 8);
+            });
+            break;
+        case AddressingMode::IndirectIndexed:
+            forGroup<Single>([&](size_t i) {
+                ea[i] = static_cast<uint16_t>((ram[lo][i] | ram[static_cast<uint8_t>(lo + 1)][i] << 8) + y[i]);
+            });
+            break;
+        default:
+            break;
+        }
+        return {false, 0};
+    }
+
+    // Reads the target into val[]. RAM at a shared address is one
+    // contiguous row, ROM is the same for everyone.
+    template <bool Single> void load(Target t) {
+        if (!t.uniform) {
+            forMembers<Single>([&](size_t i) { val[i] = read(i, ea[i]); });
+        } else if (t.addr < 0x2000) {
+            const auto &row = ram[t.addr & 0x07FF];
+            forGroup<Single>([&](size_t i) { val[i] = row[i]; });
+        } else if (t.addr >= 0x8000) {
+            const uint8_t value = prg[t.addr & 0x7FFF];
+            forGroup<Single>([&](size_t i) { val[i] = value; });
+        } else {
+            forMembers<Single>([&](size_t i) { val[i] = read(i, t.addr); });
+        }
+    }
+
+    template <bool Single> void store(Target t, const uint8_t *src) {
+        if (t.uniform && t.addr < 0x2000) {
+            uint8_t *row = ram[t.addr & 0x07FF].data();
+            forGroup<Single>([&](size_t i) { assign<Single>(row, i, src[i]); });
+        } else if (t.uniform) {
+            forMembers<Single>([&](size_t i) { write(i, t.addr, src[i]); });
+        } else {
+            forMembers<Single>([&](size_t i) { write(i, ea[i], src[i]); });
+        }
+    }
+
+    template <bool Single> void operand(AddressingMode mode, uint8_t lo, uint16_t abs) {
+        if (mode == AddressingMode::Immediate)
+            forGroup<Single>([&](size_t i) { val[i] = lo; });
+        else
+            load<Single>(resolve<Single>(mode, lo, abs));
+    }
+
+    template <bool Single> void setZN(uint8_t *reg, const uint8_t *src) {
+        forGroup<Single>([&](size_t i) {
+            const uint8_t value = src[i];
+            assign<Single>(reg, i, value);
+            assign<Single>(p.data(), i, zn(p[i], value));
+        });
+    }
+
+    template <bool Single> void compare(const uint8_t *reg) {
+        forGroup<Single>([&](size_t i) {
+            const auto diff = static_cast<uint8_t>(reg[i] - val[i]);
+            assign<Single>(p.data(), i, (zn(p[i], diff) & 0xFE) | (reg[i] >= val[i]));
+        });
+    }
+
+    // ADC, and SBC with the operand inverted.
+    template <bool Single> void add(uint8_t invert) {
+        forGroup<Single>([&](size_t i) {
+            const auto value = static_cast<uint8_t>(val[i] ^ invert);
+            const unsigned sum = a[i] + value + (p[i] & 1);
+            const auto result = static_cast<uint8_t>(sum);
+            const unsigned overflow = (~(a[i] ^ value) & (a[i] ^ result) & 0x80) >> 1;
+            assign<Single>(p.data(), i, (zn(p[i], result) & 0xBE) | overflow | (sum >> 8));
+            assign<Single>(a.data(), i, result);
+        });
+    }
+
+    // Shifts and rotates of v[] in place.
+    template <bool Single, Op K> void shift(uint8_t *v) {
+        forGroup<Single>([&](size_t i) {
+            const uint8_t in = v[i];
+            const uint8_t carry = p[i] & 1;
+            uint8_t out, carryOut;
+            if constexpr (K == Op::ASL) {
+                out = static_cast<uint8_t>(in << 1);
+                carryOut = in >> 7;
+            } else if constexpr (K == Op::LSR) {
+                out = in >> 1;
+                carryOut = in & 1;
+            } else if constexpr (K == Op::ROL) {
+                out = static_cast<uint8_t>(in << 1 | carry);
+                carryOut = in >> 7;
+            } else {
+                out = static_cast<uint8_t>(in >> 1 | carry << 7);
+                carryOut = in & 1;
+            }
+            assign<Single>(v, i, out);
+            assign<Single>(p.data(), i, (zn(p[i], out) & 0xFE) | carryOut);
+        });
+    }
+
+    template <bool Single, Op K> void shiftInstruction(AddressingMode mode, uint8_t lo, uint16_t abs) {
+        if (mode == AddressingMode::Accumulator) {
+            shift<Single, K>(a.data());
+            return;
+        }
+        Target t = resolve<Single>(mode, lo, abs);
+        load<Single>(t);
+        shift<Single, K>(val.data());
+        store<Single>(t, val.data());
+    }
+
+    template <bool Single> void increment(AddressingMode mode, uint8_t lo, uint16_t abs, uint8_t delta) {
+        Target t = resolve<Single>(mode, lo, abs);
+        load<Single>(t);
+        forGroup<Single>([&](size_t i) {
+            val[i] = static_cast<uint8_t>(val[i] + delta);
+            assign<Single>(p.data(), i, zn(p[i], val[i]));
+        });
+        store<Single>(t, val.data());
+    }
+
+    template <bool Single> void incrementRegister(uint8_t *reg, uint8_t delta) {
+        forGroup<Single>([&](size_t i) {
+            const auto value = static_cast<uint8_t>(reg[i] + delta);
+            assign<Single>(reg, i, value);
+            assign<Single>(p.data(), i, zn(p[i], value));
+        });
+    }
+
+    template <bool Single> void setFlag(uint8_t bit, bool on) {
+        forGroup<Single>([&](size_t i) { assign<Single>(p.data(), i, on ? p[i] | bit : p[i] & ~bit); });
+    }
+
+    template <bool Single> void branch(uint8_t bit, bool set, uint16_t next, uint8_t offset) {
+        const auto target = static_cast<uint16_t>(next + static_cast<int8_t>(offset));
+        forGroup<Single>([&](size_t i) {
+            const bool taken = ((p[i] & bit) != 0) == set;
+            assign<Single>(pc.data(), i, taken ? target : next);
+            assign<Single>(cycles.data(), i, cycles[i] + (taken ? 3 : 2));
+        });
+    }
+
+    // Executes one instruction for the group: the lanes in mask[], or just
+    // `lane` on the scalar path.
+    template <bool Single> void step() {
+        const uint16_t at = pc[lane];
+        const uint8_t opcode = read(lane, at);
+        const uint8_t lo = read(lane, static_cast<uint16_t>(at + 1));
+        const uint8_t hi = read(lane, static_cast<uint16_t>(at + 2));
+        const uint16_t abs = static_cast<uint16_t>(lo | hi << 8);
+        const AddressingMode mode = kOpcodeModes[opcode];
+        const auto next = static_cast<uint16_t>(at + instructionLength(mode));
+        const uint8_t length = kCoreCycles[opcode];
+        bool jumped = false;
+
+        if constexpr (Single) {
+            stats.scalarSteps++;
+            stats.laneInstructions++;
+        } else {
+            stats.groupSteps++;
+            for (size_t i = 0; i < Lanes; i++)
+                stats.laneInstructions += mask[i];
+        }
+
+        if (length == 0) {
+            forMembers<Single>([&](size_t i) { halted[i] = 1; });
+            return;
+        }
+
+        switch (kOps[opcode]) {
+        case Op::LDA:
+            operand<Single>(mode, lo, abs);
+            setZN<Single>(a.data(), val.data());
+            break;
+        case Op::LDX:
+            operand<Single>(mode, lo, abs);
+            setZN<Single>(x.data(), val.data());
+            break;
+        case Op::LDY:
+            operand<Single>(mode, lo, abs);
+            setZN<Single>(y.data(), val.data());
+            break;
+        case Op::STA:
+            store<Single>(resolve<Single>(mode, lo, abs), a.data());
+            break;
+        case Op::STX:
+            store<Single>(resolve<Single>(mode, lo, abs), x.data());
+            break;
+        case Op::STY:
+            store<Single>(resolve<Single>(mode, lo, abs), y.data());
+            break;
+        case Op::TAX:
+            setZN<Single>(x.data(), a.data());
+            break;
+        case Op::TAY:
+            setZN<Single>(y.data(), a.data());
+            break;
+        case Op::TXA:
+            setZN<Single>(a.data(), x.data());
+            break;
+        case Op::TYA:
+            setZN<Single>(a.data(), y.data());
+            break;
+        case Op::TSX:
+            setZN<Single>(x.data(), sp.data());
+            break;
+        case Op::TXS:
+            forGroup<Single>([&](size_t i) { assign<Single>(sp.data(), i, x[i]); });
+            break;
+        case Op::ADC:
+            operand<Single>(mode, lo, abs);
+            add<Single>(0x00);
+            break;
+        case Op::SBC:
+            operand<Single>(mode, lo, abs);
+            add<Single>(0xFF);
+            break;
+        case Op::AND:
+            operand<Single>(mode, lo, abs);
+            forGroup<Single>([&](size_t i) { val[i] &= a[i]; });
+            setZN<Single>(a.data(), val.data());
+            break;
+        case Op::ORA:
+            operand<Single>(mode, lo, abs);
+            forGroup<Single>([&](size_t i) { val[i] |= a[i]; });
+            setZN<Single>(a.data(), val.data());
+            break;
+        case Op::EOR:
+            operand<Single>(mode, lo, abs);
+            forGroup<Single>([&](size_t i) { val[i] ^= a[i]; });
+            setZN<Single>(a.data(), val.data());
+            break;
+        case Op::CMP:
+            operand<Single>(mode, lo, abs);
+            compare<Single>(a.data());
+            break;
+        case Op::CPX:
+            operand<Single>(mode, lo, abs);
+            compare<Single>(x.data());
+            break;
+        case Op::CPY:
+            operand<Single>(mode, lo, abs);
+            compare<Single>(y.data());
+            break;
+        case Op::BIT:
+            operand<Single>(mode, lo, abs);
+            forGroup<Single>([&](size_t i) {
+                assign<Single>(p.data(), i, (p[i] & 0x3D) | ((a[i] & val[i]) ? 0 : 0x02) | (val[i] & 0xC0));
+            });
+            break;
+        case Op::ASL:
+            shiftInstruction<Single, Op::ASL>(mode, lo, abs);
+            break;
+        case Op::LSR:
+            shiftInstruction<Single, Op::LSR>(mode, lo, abs);
+            break;
+        case Op::ROL:
+            shiftInstruction<Single, Op::ROL>(mode, lo, abs);
+            break;
+        case Op::ROR:
+            shiftInstruction<Single, Op::ROR>(mode, lo, abs);
+            break;
+        case Op::INC:
+            increment<Single>(mode, lo, abs, 1);
+            break;
+        case Op::DEC:
+            increment<Single>(mode, lo, abs, 0xFF);
+            break;
+        case Op::INX:
+            incrementRegister<Single>(x.data(), 1);
+            break;
+        case Op::INY:
+            incrementRegister<Single>(y.data(), 1);
+            break;
+        case Op::DEX:
+            incrementRegister<Single>(x.data(), 0xFF);
+            break;
+        case Op::DEY:
+            incrementRegister<Single>(y.data(), 0xFF);
+            break;
+        case Op::CLC:
+            setFlag<Single>(0x01, false);
+            break;
+        case Op::SEC:
+            setFlag<Single>(0x01, true);
+            break;
+        case Op::CLI:
+            setFlag<Single>(0x04, false);
+            break;
+        case Op::SEI:
+            setFlag<Single>(0x04, true);
+            break;
+        case Op::CLD:
+            setFlag<Single>(0x08, false);
+            break;
+        case Op::SED:
+            setFlag<Single>(0x08, true);
+            break;
+        case Op::CLV:
+            setFlag<Single>(0x40, false);
+            break;
+        case Op::BPL:
+            branch<Single>(0x80, false, next, lo);
+            return;
+        case Op::BMI:
+            branch<Single>(0x80, true, next, lo);
+            return;
+        case Op::BVC:
+            branch<Single>(0x40, false, next, lo);
+            return;
+        case Op::BVS:
+            branch<Single>(0x40, true, next, lo);
+            return;
+        case Op::BCC:
+            branch<Single>(0x01, false, next, lo);
+            return;
+        case Op::BCS:
+            branch<Single>(0x01, true, next, lo);
+            return;
+        case Op::BNE:
+            branch<Single>(0x02, false, next, lo);
+            return;
+        case Op::BEQ:
+            branch<Single>(0x02, true, next, lo);
+            return;
+        case Op::JMP:
+            if (mode == AddressingMode::Absolute) {
+                forGroup<Single>([&](size_t i) { assign<Single>(pc.data(), i, abs); });
+            } else {
+                // The pointer's high byte is fetched without crossing the page.
+                const auto second = static_cast<uint16_t>((abs & 0xFF00) | ((abs + 1) & 0xFF));
+                forMembers<Single>([&](size_t i) {
+                    pc[i] = static_cast<uint16_t>(read(i, abs) | read(i, second) << 8);
+                });
+            }
+            jumped = true;
+            break;
+        case Op::JSR:
+            forMembers<Single>([&](size_t i) {
+                const auto ret = static_cast<uint16_t>(next - 1);
+                push(i, static_cast<uint8_t>(ret >> 8));
+                push(i, static_cast<uint8_t>(ret));
+                pc[i] = abs;
+            });
+            jumped = true;
+            break;
+        case Op::RTS:
+            forMembers<Single>([&](size_t i) {
+                const uint8_t pcl = pull(i);
+                pc[i] = static_cast<uint16_t>((pcl | pull(i) << 8) + 1);
+            });
+            jumped = true;
+            break;
+        case Op::RTI:
+            forMembers<Single>([&](size_t i) {
+                p[i] = static_cast<uint8_t>((pull(i) & 0xCF) | 0x20);
+                const uint8_t pcl = pull(i);
+                pc[i] = static_cast<uint16_t>(pcl | pull(i) << 8);
+            });
+            jumped = true;
+            break;
+        case Op::BRK:
+            forMembers<Single>([&](size_t i) {
+                const auto ret = static_cast<uint16_t>(at + 2);
+                push(i, static_cast<uint8_t>(ret >> 8));
+                push(i, static_cast<uint8_t>(ret));
+                push(i, static_cast<uint8_t>(p[i] | 0x30));
+                p[i] |= 0x04;
+                pc[i] = static_cast<uint16_t>(prg[0x7FFE] | prg[0x7FFF] << 8);
+            });
+            jumped = true;
+            break;
+        case Op::PHA:
+            forMembers<Single>([&](size_t i) { push(i, a[i]); });
+            break;
+        case Op::PHP:
+            forMembers<Single>([&](size_t i) { push(i, static_cast<uint8_t>(p[i] | 0x30)); });
+            break;
+        case Op::PLA:
+            forMembers<Single>([&](size_t i) {
+                a[i] = pull(i);
+                p[i] = zn(p[i], a[i]);
+            });
+            break;
+        case Op::PLP:
+            forMembers<Single>([&](size_t i) { p[i] = static_cast<uint8_t>((pull(i) & 0xCF) | 0x20); });
+            break;
+        case Op::NOP:
+            break;
+        case Op::Illegal:
+            forMembers<Single>([&](size_t i) { halted[i] = 1; });
+            return;
+        }
+
+        forGroup<Single>([&](size_t i) {
+            if (!jumped)
+                assign<Single>(pc.data(), i, next);
+            assign<Single>(cycles.data(), i, cycles[i] + length);
+        });
+    }
+
+    std::array<uint8_t, 0x8000> prg{};
+
+    alignas(64) std::array<uint8_t, Lanes> a{};
+    alignas(64) std::array<uint8_t, Lanes> x{};
+    alignas(64) std::array<uint8_t, Lanes> y{};
+    alignas(64) std::array<uint8_t, Lanes> sp{};
+    alignas(64) std::array<uint8_t, Lanes> p{};
+    alignas(64) std::array<uint16_t, Lanes> pc{};
+    alignas(64) std::array<uint64_t, Lanes> cycles{};
+    alignas(64) std::array<std::array<uint8_t, Lanes>, 0x0800> ram{};
+
+    uint8_t padState[2][Lanes] = {};
+    uint8_t padShift[2][Lanes] = {};
+    std::array<uint8_t, Lanes> strobe{};
+    std::array<uint8_t, Lanes> ppuCtrl{};
+    std::array<uint8_t, Lanes> ppuStatus{};
+    std::array<uint8_t, Lanes> nmiPending{};
+    std::array<uint8_t, Lanes> halted{};
+    size_t pendingNmis = 0;
+    uint64_t frameCount = 0;
+
+    // Scratch for the instruction being executed.
+    alignas(64) std::array<uint8_t, Lanes> mask{};
+    alignas(64) std::array<uint8_t, Lanes> val{};
+    alignas(64) std::array<uint16_t, Lanes> ea{};
+    size_t lane = 0;
+    bool lockstep = true;
+
+    LockstepStats stats;
+};
@@ -0,0 +1,136 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+#include "Emulator.hpp"
+
+// Input movie: the controller state of every frame, plus the state hash the
+// emulator reached at the end of that frame when it was recorded.
+//
+// File layout (little endian):
+//   "NESMOV1\0", u64 ROM hash, u64 initial state hash, u32 frame count,
+//   then per frame: u8 port 1, u8 port 2, u64 state hash.
+class Movie {
+  public:
+    struct Frame {
+        uint8_t port1;
+        uint8_t port2;
+        uint64_t stateHash;
+    };
+
+    uint64_t romHash = 0;
+    uint64_t initialStateHash = 0;
+    std::vector<Frame> frames;
+
+    // Must be called right after the ROM is loaded, before the first frame.
+    void begin(const Emulator &emu) {
+        romHash = emu.getRomHash();
+        initialStateHash = emu.stateHash();
+        frames.clear();
+    }
+
+    void record(uint8_t port1, uint8_t port2, uint64_t stateHash) {
+        frames.push_back({port1, port2, stateHash});
+    }
+
+    void save(const char *filename) const {
+        std::ofstream file(filename, std::ios::binary);
+        if (!file)
+            throw std::runtime_error("Failed to create the movie file.");
+
+        file.write(kMagic, sizeof(kMagic));
+        put(file, romHash, 8);
+        put(file, initialStateHash, 8);
+        put(file, frames.size(), 4);
+        for (const Frame &f : frames) {
+            put(file, f.port1, 1);
+            put(file, f.port2, 1);
+            put(file, f.stateHash, 8);
+        }
+    }
+
+    static Movie load(const char *filename) {
+        std::ifstream file(filename, std::ios::binary);
+        if (!file)
+            throw std::runtime_error("Failed to open the movie file.");
+
+        char magic[sizeof(kMagic)];
+        if (!file.read(magic, sizeof(magic)) || std::memcmp(magic, kMagic, sizeof(kMagic)) != 0)
+            throw std::runtime_error("Not a movie file.");
+
+        Movie movie;
+        movie.romHash = get(file, 8);
+        movie.initialStateHash = get(file, 8);
+        auto count = static_cast<size_t>(get(file, 4));
+        if (!file)
+            throw std::runtime_error("The movie file is truncated.");
+        // The count comes from the file: check it against what is left
+        // before allocating for it.
+        const std::streampos body = file.tellg();
+        file.seekg(0, std::ios::end);
+        const auto left = static_cast<uint64_t>(file.tellg() - body);
+        file.seekg(body);
+        if (static_cast<uint64_t>(count) * 10 > left)
+            throw std::runtime_error("The movie file is truncated.");
+        movie.frames.resize(count);
+        for (Frame &f : movie.frames) {
+            f.port1 = static_cast<uint8_t>(get(file, 1));
+            f.port2 = static_cast<uint8_t>(get(file, 1));
+            f.stateHash = get(file, 8);
+        }
+        if (!file)
+            throw std::runtime_error("The movie file is truncated.");
+        return movie;
+    }
+
+  private:
+    static constexpr char kMagic[8] = {'N', 'E', 'S', 'M', 'O', 'V', '1', '\0'};
+
+    static void put(std::ofstream &file, uint64_t value, int bytes) {
+        for (int i = 0; i < bytes; i++)
+            file.put(static_cast<char>((value >> (8 * i)) & 0xFF));
+    }
+
+    static uint64_t get(std::ifstream &file, int bytes) {
+        uint64_t value = 0;
+        for (int i = 0; i < bytes; i++)
+            value |= static_cast<uint64_t>(static_cast<uint8_t>(file.get())) << (8 * i);
+        return value;
+    }
+};
+
+struct MovieVerifyResult {
+    uint64_t frames = 0;
+    uint64_t mismatches = 0;
+    int64_t firstMismatch = -1;
+    double seconds = 0;
+};
+
+// Replays a movie as fast as the core goes: no pacing, no presentation, no
+// trace. The emulator must hold the movie's ROM, freshly powered on.
+inline MovieVerifyResult verifyMovie(Emulator &emu, const Movie &movie) {
+    if (emu.getRomHash() != movie.romHash)
+        throw std::runtime_error("The movie was recorded with another ROM.");
+    if (emu.stateHash() != movie.initialStateHash)
+        throw std::runtime_error("The initial state does not match the movie.");
+
+    MovieVerifyResult result;
+    auto start = std::chrono::steady_clock::now();
+    for (const Movie::Frame &f : movie.frames) {
+        emu.setInput(f.port1, f.port2);
+        emu.runFrame();
+        if (emu.stateHash() != f.stateHash) {
+            if (result.firstMismatch < 0)
+                result.firstMismatch = static_cast<int64_t>(result.frames);
+            result.mismatches++;
+        }
+        result.frames++;
+    }
+    result.seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
@@ -0,0 +1,87 @@
+#ifndef NESEMU_CORE_H
+#define NESEMU_CORE_H
+
+/*
+ * C interface to the emulator core, for embedding it as a training
+ * environment. No SDL, no output on stdout, no allocation while stepping.
+ *
+ * Controller bytes use the standard layout, bit 0 to 7: A, B, Select, Start,
+ * Up, Down, Left, Right. Functions that can fail return 0 (or NULL) and leave
+ * a message for nesemu_last_error().
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#define NESEMU_API __declspec(dllexport)
+#else
+#define NESEMU_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NESEMU_FRAME_WIDTH 256
+#define NESEMU_FRAME_HEIGHT 240
+#define NESEMU_RAM_SIZE 2048
+
+typedef struct nesemu_instance nesemu_instance;
+
+/* Copies the iNES image and powers the console on. */
+NESEMU_API nesemu_instance *nesemu_create(const uint8_t *rom, size_t size);
+NESEMU_API void nesemu_destroy(nesemu_instance *instance);
+
+/* Message of the last failure on the calling thread. */
+NESEMU_API const char *nesemu_last_error(void);
+
+/*
+ * Runs `frames` frames. `inputs` holds two bytes (port 1, port 2) per
+ * frame, or is NULL to keep the last ones. Returns the number of frames
+ * run, fewer if the CPU halted.
+ */
+NESEMU_API uint32_t nesemu_step_frames(nesemu_instance *instance, uint32_t frames, const uint8_t *inputs);
+
+/*
+ * Steps `count` instances by `frames` frames each on a shared thread pool.
+ * `inputs` holds frames * 2 bytes per instance, instance after instance, or
+ * is NULL. `threads` caps the threads used, 0 for one per core.
+ */
+NESEMU_API void nesemu_step_batch(nesemu_instance *const *instances, size_t count, uint32_t frames,
+                                  const uint8_t *inputs, unsigned threads);
+
+/* Zero-copy views, valid until the instance is destroyed. RAM is writable. */
+NESEMU_API uint8_t *nesemu_ram(nesemu_instance *instance);
+/* NESEMU_FRAME_WIDTH * NESEMU_FRAME_HEIGHT NES colour indices (0-63). */
+NESEMU_API const uint8_t *nesemu_framebuffer(const nesemu_instance *instance);
+/* The 64 colours as 0xRRGGBB. */
+NESEMU_API const uint32_t *nesemu_palette(void);
+
+NESEMU_API uint64_t nesemu_frame_count(const nesemu_instance *instance);
+/* 1 once the CPU stopped on an opcode the core does not implement. */
+NESEMU_API int nesemu_halted(const nesemu_instance *instance);
+
+/* Save states are plain byte blobs of nesemu_state_size() bytes. */
+NESEMU_API size_t nesemu_state_size(void);
+NESEMU_API void nesemu_save_state(const nesemu_instance *instance, void *buffer);
+/* Fails if the state was saved with another ROM. */
+NESEMU_API int nesemu_load_state(nesemu_instance *instance, const void *buffer);
+
+/*
+ * Code/data logging, for coverage: while enabled, the instance flags every
+ * PRG byte run as code or read as data (FCEUX .cdl flags), at some cost in
+ * speed. nesemu_cdl returns the flags, one byte per PRG byte, and their
+ * count in `size`; NULL while disabled. nesemu_cdl_save ORs the logs of
+ * instances running the same ROM into the .cdl file at `path`, keeping what
+ * it held before.
+ */
+NESEMU_API void nesemu_cdl_enable(nesemu_instance *instance, int enabled);
+NESEMU_API const uint8_t *nesemu_cdl(const nesemu_instance *instance, size_t *size);
+NESEMU_API int nesemu_cdl_save(nesemu_instance *const *instances, size_t count, const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,345 @@
+#pragma once
+#include <algorithm>
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <netdb.h>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+#include "Emulator.hpp"
+
+// Rollback netplay for two players.
+//
+// Each side runs its own emulator and never waits for the other: the remote
+// player's input is predicted (their last known input repeated) and the frame
+// runs right away. When the real input arrives and differs from the
+// prediction, the emulator goes back to the state saved before that frame and
+// re-simulates up to the present, all within one host frame.
+
+/*
+ * Wire format, little endian:
+ *   "NP", u32 frame of the first input, u32 ack (every remote frame before it
+ *   was received), u8 count, count input bytes.
+ * Inputs are re-sent until acknowledged, so a lost packet is repaired by the
+ * next one.
+ */
+struct NetplayPacket {
+    uint32_t firstFrame = 0;
+    uint32_t ack = 0;
+    std::vector<uint8_t> inputs;
+
+    static constexpr size_t kMaxInputs = 32;
+
+    size_t encode(uint8_t *out) const {
+        out[0] = 'N';
+        out[1] = 'P';
+        put32(out + 2, firstFrame);
+        put32(out + 6, ack);
+        out[10] = static_cast<uint8_t>(inputs.size());
+        std::memcpy(out + 11, inputs.data(), inputs.size());
+        return 11 + inputs.size();
+    }
+
+    static bool decode(const uint8_t *in, size_t size, NetplayPacket &packet) {
+        if (size < 11 || in[0] != 'N' || in[1] != 'P' || size != 11u + in[10] || in[10] > kMaxInputs)
+            return false;
+        packet.firstFrame = get32(in + 2);
+        packet.ack = get32(in + 6);
+        packet.inputs.assign(in + 11, in + size);
+        return true;
+    }
+
+    static constexpr size_t kMaxSize = 11 + kMaxInputs;
+
+  private:
+    static void put32(uint8_t *p, uint32_t v) {
+        for (int i = 0; i < 4; i++)
+            p[i] = static_cast<uint8_t>(v >> (8 * i));
+    }
+    static uint32_t get32(const uint8_t *p) {
+        return static_cast<uint32_t>(p[0] | p[1] << 8 | p[2] << 16 | static_cast<uint32_t>(p[3]) << 24);
+    }
+};
+
+class NetplayTransport {
+  public:
+    virtual ~NetplayTransport() = default;
+    virtual void send(const NetplayPacket &packet) = 0;
+    virtual bool receive(NetplayPacket &packet) = 0;
+};
+
+// Non-blocking UDP socket bound to a local port, talking to one peer.
+class UdpTransport : public NetplayTransport {
+  public:
+    UdpTransport(uint16_t localPort, const std::string &peerHost, uint16_t peerPort) {
+        fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+        if (fd < 0)
+            throw std::runtime_error("Failed to create the netplay socket.");
+
+        sockaddr_in local{};
+        local.sin_family = AF_INET;
+        local.sin_addr.s_addr = htonl(INADDR_ANY);
+        local.sin_port = htons(localPort);
+        if (::bind(fd, reinterpret_cast<sockaddr *>(&local), sizeof(local)) != 0) {
+            ::close(fd);
+            throw std::runtime_error("Failed to bind the netplay port.");
+        }
+
+        addrinfo hints{};
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_DGRAM;
+        addrinfo *peer = nullptr;
+        std::string port = std::to_string(peerPort);
+        if (::getaddrinfo(peerHost.c_str(), port.c_str(), &hints, &peer) != 0 || !peer) {
+            ::close(fd);
+            throw std::runtime_error("Failed to resolve the netplay peer.");
+        }
+        int connected = ::connect(fd, peer->ai_addr, peer->ai_addrlen);
+        ::freeaddrinfo(peer);
+        if (connected != 0) {
+            ::close(fd);
+            throw std::runtime_error("Failed to reach the netplay peer.");
+        }
+        ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+    }
+
+    ~UdpTransport() override { ::close(fd); }
+
+    UdpTransport(const UdpTransport &) = delete;
+    UdpTransport &operator=(const UdpTransport &) = delete;
+
+    void send(const NetplayPacket &packet) override {
+        uint8_t buffer[NetplayPacket::kMaxSize];
+        size_t size = packet.encode(buffer);
+        // A full socket buffer just drops the packet; the inputs are re-sent.
+        (void)::send(fd, buffer, size, 0);
+    }
+
+    bool receive(NetplayPacket &packet) override {
+        uint8_t buffer[NetplayPacket::kMaxSize];
+        for (;;) {
+            ssize_t size = ::recv(fd, buffer, sizeof(buffer), 0);
+            if (size <= 0)
+                return false;
+            if (NetplayPacket::decode(buffer, static_cast<size_t>(size), packet))
+                return true;
+        }
+    }
+
+  private:
+    int fd = -1;
+};
+
+// In-process link for tests: packets reach the other end after a fixed delay
+// plus random jitter, and may be dropped. Time is set by the caller, so runs
+// are reproducible.
+class LoopbackTransport : public NetplayTransport {
+  public:
+    struct Link {
+        double delayMs = 0;
+        double jitterMs = 0;
+        double lossRate = 0;
+        double nowMs = 0;
+        std::mt19937 random{1};
+    };
+
+    LoopbackTransport(Link &link) : link(link) {}
+
+    static void connect(LoopbackTransport &a, LoopbackTransport &b) {
+        a.peer = &b;
+        b.peer = &a;
+    }
+
+    void send(const NetplayPacket &packet) override {
+        std::uniform_real_distribution<double> unit(0.0, 1.0);
+        if (unit(link.random) < link.lossRate)
+            return;
+        double arrival = link.nowMs + link.delayMs + unit(link.random) * link.jitterMs;
+        auto it = std::upper_bound(peer->inbox.begin(), peer->inbox.end(), arrival,
+                                   [](double t, const InFlight &p) { return t < p.arrival; });
+        peer->inbox.insert(it, InFlight{arrival, packet});
+    }
+
+    bool receive(NetplayPacket &packet) override {
+        if (inbox.empty() || inbox.front().arrival > link.nowMs)
+            return false;
+        packet = std::move(inbox.front().packet);
+        inbox.pop_front();
+        return true;
+    }
+
+  private:
+    struct InFlight {
+        double arrival;
+        NetplayPacket packet;
+    };
+
+    Link &link;
+    LoopbackTransport *peer = nullptr;
+    std::deque<InFlight> inbox;
+};
+
+struct NetplayStats {
+    uint64_t frames = 0;
+    uint64_t rollbacks = 0;
+    uint64_t resimulatedFrames = 0;
+    uint64_t maxRollbackDepth = 0;
+    uint64_t stalls = 0;
+    double rollbackSeconds = 0;
+    double maxRollbackSeconds = 0;
+};
+
+class RollbackSession {
+  public:
+    static constexpr uint32_t kRing = 64;
+
+    // `localPort` is the controller port of this side, 0 or 1. Local input
+    // is applied `inputDelay` frames late, which hides that much latency
+    // without any rollback. The local side stalls rather than predict more
+    // than `maxRollback` frames ahead of the remote input it has.
+    RollbackSession(Emulator &emu, NetplayTransport &transport, int localPort, uint32_t inputDelay = 0,
+                    uint32_t maxRollback = 8)
+        : emu(emu), transport(transport), localPort(localPort & 1), inputDelay(inputDelay),
+          maxRollback(maxRollback) {
+        if (inputDelay + maxRollback + 1 > std::min<size_t>(kRing, NetplayPacket::kMaxInputs))
+            throw std::runtime_error("The input delay and rollback window are too large.");
+        for (uint32_t f = 0; f < kRing; f++)
+            remoteFrame[f] = kUnknown;
+        // The first frames, before any delayed input applies, are idle for both.
+        for (uint32_t f = 0; f < inputDelay; f++) {
+            localInput[f] = 0;
+            remoteInput[f] = 0;
+            remoteFrame[f] = f;
+        }
+        localKnown = inputDelay;
+        remoteKnown = inputDelay;
+    }
+
+    // Runs one frame with `input` as this side's controller. Returns false,
+    // without using the input, if the remote side is too far behind.
+    bool advance(uint8_t input) {
+        poll();
+        if (frame >= remoteKnown + maxRollback) {
+            stats.stalls++;
+            sendInputs();
+            return false;
+        }
+
+        localInput[localKnown % kRing] = input;
+        localKnown++;
+        sendInputs();
+
+        simulate(frame);
+        frame++;
+        stats.frames++;
+        return true;
+    }
+
+    // Takes in the remote inputs that arrived and repairs any misprediction.
+    void poll() {
+        uint32_t rollbackFrom = frame;
+        NetplayPacket packet;
+        while (transport.receive(packet)) {
+            peerAck = std::max(peerAck, packet.ack);
+            for (size_t i = 0; i < packet.inputs.size(); i++) {
+                uint32_t f = packet.firstFrame + static_cast<uint32_t>(i);
+                if (f < remoteKnown || f >= remoteKnown + kRing - maxRollback)
+                    continue;
+                if (remoteFrame[f % kRing] == f)
+                    continue;
+                remoteFrame[f % kRing] = f;
+                remoteInput[f % kRing] = packet.inputs[i];
+                if (f < frame && usedRemote[f % kRing] != packet.inputs[i])
+                    rollbackFrom = std::min(rollbackFrom, f);
+            }
+            while (remoteFrame[remoteKnown % kRing] == remoteKnown)
+                remoteKnown++;
+        }
+        if (rollbackFrom < frame)
+            rollback(rollbackFrom);
+    }
+
+    // Sends the unacknowledged inputs again, for when no frame is running.
+    void resend() { sendInputs(); }
+
+    uint32_t currentFrame() const { return frame; }
+    // Frame whose local input the next advance() provides.
+    uint32_t nextInputFrame() const { return localKnown; }
+    // Every frame before this one ran with the real inputs of both sides.
+    uint32_t confirmedFrame() const { return std::min(frame, remoteKnown); }
+    const NetplayStats &statistics() const { return stats; }
+
+  private:
+    static constexpr uint32_t kUnknown = 0xFFFFFFFF;
+
+    void simulate(uint32_t f) {
+        const uint32_t slot = f % kRing;
+        emu.saveState(states[slot]);
+        uint8_t remote;
+        if (remoteFrame[slot] == f)
+            remote = remoteInput[slot];
+        else if (remoteKnown > 0)
+            remote = remoteInput[(remoteKnown - 1) % kRing];
+        else
+            remote = 0;
+        usedRemote[slot] = remote;
+        if (localPort == 0)
+            emu.setInput(localInput[slot], remote);
+        else
+            emu.setInput(remote, localInput[slot]);
+        emu.runFrame();
+    }
+
+    void rollback(uint32_t from) {
+        auto start = std::chrono::steady_clock::now();
+        emu.loadState(states[from % kRing]);
+        for (uint32_t f = from; f < frame; f++)
+            simulate(f);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        uint64_t depth = frame - from;
+        stats.rollbacks++;
+        stats.resimulatedFrames += depth;
+        stats.maxRollbackDepth = std::max(stats.maxRollbackDepth, depth);
+        stats.rollbackSeconds += seconds;
+        stats.maxRollbackSeconds = std::max(stats.maxRollbackSeconds, seconds);
+    }
+
+    void sendInputs() {
+        NetplayPacket packet;
+        packet.firstFrame = std::max(peerAck, localKnown > NetplayPacket::kMaxInputs
+                                                  ? localKnown - static_cast<uint32_t>(NetplayPacket::kMaxInputs)
+                                                  : 0u);
+        packet.ack = remoteKnown;
+        for (uint32_t f = packet.firstFrame; f < localKnown; f++)
+            packet.inputs.push_back(localInput[f % kRing]);
+        transport.send(packet);
+    }
+
+    Emulator &emu;
+    NetplayTransport &transport;
+    int localPort;
+    uint32_t inputDelay;
+    uint32_t maxRollback;
+
+    uint32_t frame = 0;       // Next frame to simulate
+    uint32_t localKnown = 0;  // Local inputs are known for frames before this
+    uint32_t remoteKnown = 0; // Same for remote inputs, without gaps
+    uint32_t peerAck = 0;
+
+    uint8_t localInput[kRing] = {};
+    uint8_t remoteInput[kRing] = {};
+    uint32_t remoteFrame[kRing] = {};
+    uint8_t usedRemote[kRing] = {};
+    std::vector<Emulator::State> states = std::vector<Emulator::State>(kRing);
+
+    NetplayStats stats;
+};
@@ -0,0 +1,147 @@
+#pragma once
+#include <array>
+#include <cstdint>
+
+// Addressing mode and length of every 6502 opcode, official or not.
+enum class AddressingMode : uint8_t {
+    Implied,
+    Accumulator,
+    Immediate,
+    ZeroPage,
+    ZeroPageX,
+    ZeroPageY,
+    Absolute,
+    AbsoluteX,
+    AbsoluteY,
+    Indirect,        // JMP ($nnnn)
+    IndexedIndirect, // ($nn,X)
+    IndirectIndexed, // ($nn),Y
+    Relative,
+};
+
+constexpr uint8_t instructionLength(AddressingMode mode) {
+    switch (mode) {
+    case AddressingMode::Implied:
+    case AddressingMode::Accumulator:
+        return 1;
+    case AddressingMode::Absolute:
+    case AddressingMode::AbsoluteX:
+    case AddressingMode::AbsoluteY:
+    case AddressingMode::Indirect:
+        return 3;
+    default:
+        return 2;
+    }
+}
+
+constexpr std::array<AddressingMode, 256> kOpcodeModes = [] {
+    constexpr auto IMP = AddressingMode::Implied, ACC = AddressingMode::Accumulator,
+                   IMM = AddressingMode::Immediate, ZP = AddressingMode::ZeroPage,
+                   ZPX = AddressingMode::ZeroPageX, ZPY = AddressingMode::ZeroPageY,
+                   ABS = AddressingMode::Absolute, ABX = AddressingMode::AbsoluteX,
+                   ABY = AddressingMode::AbsoluteY, IND = AddressingMode::Indirect,
+                   IZX = AddressingMode::IndexedIndirect,
+                   IZY = AddressingMode::IndirectIndexed, REL = AddressingMode::Relative;
+    return std::array<AddressingMode, 256>{
+        IMP, IZX, IMP, IZX, ZP, ZP, ZP, ZP, IMP, IMM, ACC, IMM, ABS, ABS, ABS, ABS,
+        REL, IZY, IMP, IZY, ZPX, ZPX, ZPX, ZPX, IMP, ABY, IMP, ABY, ABX, ABX, ABX, ABX,
+        ABS, IZX, IMP, IZX, ZP, ZP, ZP, ZP, IMP, IMM, ACC, IMM, ABS, ABS, ABS, ABS,
+        REL, IZY, IMP, IZY, ZPX, ZPX, ZPX, ZPX, IMP, ABY, IMP, ABY, ABX, ABX, ABX, ABX,
+        IMP, IZX, IMP, IZX, ZP, ZP, ZP, ZP, IMP, IMM, ACC, IMM, ABS, ABS, ABS, ABS,
+        REL, IZY, IMP, IZY, ZPX, ZPX, ZPX, ZPX, IMP, ABY, IMP, ABY, ABX, ABX, ABX, ABX,
+        IMP, IZX, IMP, IZX, ZP, ZP, ZP, ZP, IMP, IMM, ACC, IMM, IND, ABS, ABS, ABS,
+        REL, IZY, IMP, IZY, ZPX, ZPX, ZPX, ZPX, IMP, ABY, IMP, ABY, ABX, ABX, ABX, ABX,
+        IMM, IZX, IMM, IZX, ZP, ZP, ZP, ZP, IMP, IMM, IMP, IMM, ABS, ABS, ABS, ABS,
+        REL, IZY, IMP, IZY, ZPX, ZPX, ZPY, ZPY, IMP, ABY, IMP, ABY, ABX, ABX, ABY, ABY,
+        IMM, IZX, IMM, IZX, ZP, ZP, ZP, ZP, IMP, IMM, IMP, IMM, ABS, ABS, ABS, ABS,
+        REL, IZY, IMP, IZY, ZPX, ZPX, ZPY, ZPY, IMP, ABY, IMP, ABY, ABX, ABX, ABY, ABY,
+        IMM, IZX, IMM, IZX, ZP, ZP, ZP, ZP, IMP, IMM, IMP, IMM, ABS, ABS, ABS, ABS,
+        REL, IZY, IMP, IZY, ZPX, ZPX, ZPX, ZPX, IMP, ABY, IMP, ABY, ABX, ABX, ABX, ABX,
+        IMM, IZX, IMM, IZX, ZP, ZP, ZP, ZP, IMP, IMM, IMP, IMM, ABS, ABS, ABS, ABS,
+        REL, IZY, IMP, IZY, ZPX, ZPX, ZPX, ZPX, IMP, ABY, IMP, ABY, ABX, ABX, ABX, ABX
+    };
+}();
+
+// Mnemonic of every opcode. Unofficial ones use the names common in NES
+// documentation (SLO, DCP, ISC...); every jam opcode is HLT.
+constexpr std::array<const char *, 256> kOpcodeMnemonics = {
+    "BRK", "ORA", "HLT", "SLO", "NOP", "ORA", "ASL", "SLO", "PHP", "ORA", "ASL", "ANC", "NOP", "ORA", "ASL", "SLO",
+    "BPL", "ORA", "HLT", "SLO", "NOP", "ORA", "ASL", "SLO", "CLC", "ORA", "NOP", "SLO", "NOP", "ORA", "ASL", "SLO",
+    "JSR", "AND", "HLT", "RLA", "BIT", "AND", "ROL", "RLA", "PLP", "AND", "ROL", "ANC", "BIT", "AND", "ROL", "RLA",
+    "BMI", "AND", "HLT", "RLA", "NOP", "AND", "ROL", "RLA", "SEC", "AND", "NOP", "RLA", "NOP", "AND", "ROL", "RLA",
+    "RTI", "EOR", "HLT", "SRE", "NOP", "EOR", "LSR", "SRE", "PHA", "EOR", "LSR", "ALR", "JMP", "EOR", "LSR", "SRE",
+    "BVC", "EOR", "HLT", "SRE", "NOP", "EOR", "LSR", "SRE", "CLI", "EOR", "NOP", "SRE", "NOP", "EOR", "LSR", "SRE",
+    "RTS", "ADC", "HLT", "RRA", "NOP", "ADC", "ROR", "RRA", "PLA", "ADC", "ROR", "ARR", "JMP", "ADC", "ROR", "RRA",
+    "BVS", "ADC", "HLT", "RRA", "NOP", "ADC", "ROR", "RRA", "SEI", "ADC", "NOP", "RRA", "NOP", "ADC", "ROR", "RRA",
+    "NOP", "STA", "NOP", "SAX", "STY", "STA", "STX", "SAX", "DEY", "NOP", "TXA", "ANE", "STY", "STA", "STX", "SAX",
+    "BCC", "STA", "HLT", "SHA", "STY", "STA", "STX", "SAX", "TYA", "STA", "TXS", "SHS", "SHY", "STA", "SHX", "SHA",
+    "LDY", "LDA", "LDX", "LAX", "LDY", "LDA", "LDX", "LAX", "TAY", "LDA", "TAX", "LXA", "LDY", "LDA", "LDX", "LAX",
+    "BCS", "LDA", "HLT", "LAX", "LDY", "LDA", "LDX", "LAX", "CLV", "LDA", "TSX", "LAE", "LDY", "LDA", "LDX", "LAX",
+    "CPY", "CMP", "NOP", "DCP", "CPY", "CMP", "DEC", "DCP", "INY", "CMP", "DEX", "AXS", "CPY", "CMP", "DEC", "DCP",
+    "BNE", "CMP", "HLT", "DCP", "NOP", "CMP", "DEC", "DCP", "CLD", "CMP", "NOP", "DCP", "NOP", "CMP", "DEC", "DCP",
+    "CPX", "SBC", "NOP", "ISC", "CPX", "SBC", "INC", "ISC", "INX", "SBC", "NOP", "SBC", "CPX", "SBC", "INC", "ISC",
+    "BEQ", "SBC", "HLT", "ISC", "NOP", "SBC", "INC", "ISC", "SED", "SBC", "NOP", "ISC", "NOP", "SBC", "INC", "ISC",
+};
+
+constexpr const char *addressingModeName(AddressingMode mode) {
+    switch (mode) {
+    case AddressingMode::Implied: return "implied";
+    case AddressingMode::Accumulator: return "accumulator";
+    case AddressingMode::Immediate: return "immediate";
+    case AddressingMode::ZeroPage: return "zero page";
+    case AddressingMode::ZeroPageX: return "zero page,X";
+    case AddressingMode::ZeroPageY: return "zero page,Y";
+    case AddressingMode::Absolute: return "absolute";
+    case AddressingMode::AbsoluteX: return "absolute,X";
+    case AddressingMode::AbsoluteY: return "absolute,Y";
+    case AddressingMode::Indirect: return "indirect";
+    case AddressingMode::IndexedIndirect: return "(indirect,X)";
+    case AddressingMode::IndirectIndexed: return "(indirect),Y";
+    case AddressingMode::Relative: return "relative";
+    }
+    return "";
+}
+
+// Base cycle count of every opcode, before page-crossing and branch-taken
+// penalties.
+constexpr std::array<uint8_t, 256> kOpcodeCycles = {
+    7, 6, 2, 8, 3, 3, 5, 5, 3, 2, 2, 2, 4, 4, 6, 6,
+    2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
+    6, 6, 2, 8, 3, 3, 5, 5, 4, 2, 2, 2, 4, 4, 6, 6,
+    2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
+    6, 6, 2, 8, 3, 3, 5, 5, 3, 2, 2, 2, 3, 4, 6, 6,
+    2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
+    6, 6, 2, 8, 3, 3, 5, 5, 4, 2, 2, 2, 5, 4, 6, 6,
+    2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
+    2, 6, 2, 6, 3, 3, 3, 3, 2, 2, 2, 2, 4, 4, 4, 4,
+    2, 6, 2, 6, 4, 4, 4, 4, 2, 5, 2, 5, 5, 5, 5, 5,
+    2, 6, 2, 6, 3, 3, 3, 3, 2, 2, 2, 2, 4, 4, 4, 4,
+    2, 5, 2, 5, 4, 4, 4, 4, 2, 4, 2, 4, 4, 4, 4, 4,
+    2, 6, 2, 8, 3, 3, 5, 5, 2, 2, 2, 2, 4, 4, 6, 6,
+    2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
+    2, 6, 2, 8, 3, 3, 5, 5, 2, 2, 2, 2, 4, 4, 6, 6,
+    2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
+};
+
+// Cycles the CPU core charges for each opcode, for a branch not taken (one
+// more when taken); 0 for the opcodes it halts on. Some are below
+// kOpcodeCycles, such as ADC absolute or STA absolute,X. LockstepCore charges
+// the same so the two stay comparable.
+constexpr std::array<uint8_t, 256> kCoreCycles = {
+    7, 0, 0, 0, 0, 3, 5, 0, 3, 2, 2, 0, 0, 4, 6, 0,
+    2, 0, 0, 0, 0, 3, 6, 0, 2, 4, 0, 0, 0, 4, 7, 0,
+    6, 0, 0, 0, 3, 3, 5, 0, 3, 2, 2, 0, 4, 4, 6, 0,
+    2, 0, 0, 0, 0, 3, 6, 0, 2, 4, 0, 0, 0, 4, 7, 0,
+    6, 0, 0, 0, 0, 3, 5, 0, 3, 2, 2, 0, 3, 4, 6, 0,
+    2, 0, 0, 0, 0, 3, 6, 0, 2, 4, 0, 0, 0, 4, 7, 0,
+    6, 0, 0, 0, 0, 2, 5, 0, 4, 2, 2, 0, 5, 2, 6, 0,
+    2, 0, 0, 0, 0, 2, 6, 0, 2, 2, 0, 0, 0, 2, 7, 0,
+    0, 0, 0, 0, 3, 3, 3, 0, 2, 0, 2, 0, 4, 4, 4, 0,
+    2, 0, 0, 0, 4, 4, 4, 0, 2, 4, 2, 0, 0, 4, 0, 0,
+    2, 0, 2, 0, 3, 3, 3, 0, 2, 2, 2, 0, 4, 4, 4, 0,
+    2, 0, 0, 0, 4, 4, 4, 0, 2, 4, 2, 0, 4, 4, 4, 0,
+    2, 0, 0, 0, 2, 2, 5, 0, 2, 2, 2, 0, 0, 2, 6, 0,
+    2, 0, 0, 0, 0, 2, 5, 0, 2, 2, 0, 0, 0, 2, 6, 0,
+    2, 0, 0, 0, 2, 3, 5, 0, 2, 2, 2, 0, 0, 3, 6, 0,
+    2, 0, 0, 0, 0, 3, 5, 0, 2, 3, 0, 0, 0, 3, 6, 0,
+};
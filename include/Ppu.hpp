@@ -0,0 +1,564 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+#include "Hash.hpp"
+
+// Picture processing unit, rendered one whole scanline at a time.
+//
+// Output pixels are NES colour indices (0-63), see kNesPalette for RGB.
+// Scrolling follows the usual v/t/fine-X register model, so splits made
+// between two scanlines show up where the game expects them.
+class Ppu {
+  public:
+    static constexpr int kWidth = 256;
+    static constexpr int kHeight = 240;
+
+    // `chrData` is the 8 KiB of CHR-ROM, or nullptr for CHR-RAM.
+    void setCartridge(const uint8_t *chrData, size_t chrSize, bool verticalMirroring, bool fourScreenMirroring) {
+        chr.fill(0);
+        if (chrData)
+            std::memcpy(chr.data(), chrData, chrSize < chr.size() ? chrSize : chr.size());
+        chrWritable = chrData == nullptr;
+        tilesDecoded.fill(0);
+        if (!chrWritable) {
+            for (uint16_t tile = 0; tile < kTiles; tile++)
+                decodeTile(tile);
+        }
+        vertical = verticalMirroring;
+        fourScreen = fourScreenMirroring;
+    }
+
+    void reset() {
+        ctrl = mask = status = oamAddr = 0;
+        v = t = 0;
+        fineX = 0;
+        latch = false;
+        readBuffer = 0;
+        openBus = 0;
+        vram.fill(0);
+        palette.fill(0);
+        oam.fill(0);
+        spritesChanged = true;
+        if (chrWritable) {
+            chr.fill(0);
+            tilesDecoded.fill(0);
+        }
+    }
+
+    /*
+     * CPU side, $2000-$2007 (the register number is addr & 7).
+     */
+
+    uint8_t readRegister(uint16_t addr) {
+        switch (addr & 7) {
+        case 2: {
+            uint8_t value = static_cast<uint8_t>((status & 0xE0) | (openBus & 0x1F));
+            status &= 0x7F;
+            latch = false;
+            return openBus = value;
+        }
+        case 4:
+            return openBus = oam[oamAddr];
+        case 7: {
+            uint16_t address = v & 0x3FFF;
+            uint8_t value;
+            if (address >= 0x3F00) {
+                // Palette reads are immediate; the buffer gets the nametable below.
+                value = static_cast<uint8_t>((openBus & 0xC0) | palette[paletteIndex(address)]);
+                readBuffer = memoryRead(static_cast<uint16_t>(address - 0x1000));
+            } else {
+                value = readBuffer;
+                readBuffer = memoryRead(address);
+            }
+            v = static_cast<uint16_t>(v + addressIncrement());
+            return openBus = value;
+        }
+        default:
+            return openBus;
+        }
+    }
+
+    uint8_t peekRegister(uint16_t addr) const {
+        switch (addr & 7) {
+        case 2: return static_cast<uint8_t>((status & 0xE0) | (openBus & 0x1F));
+        case 4: return oam[oamAddr];
+        default: return openBus;
+        }
+    }
+
+    void writeRegister(uint16_t addr, uint8_t value) {
+        openBus = value;
+        switch (addr & 7) {
+        case 0:
+            ctrl = value;
+            t = static_cast<uint16_t>((t & 0xF3FF) | (value & 0x03) << 10);
+            break;
+        case 1:
+            mask = value;
+            break;
+        case 3:
+            oamAddr = value;
+            break;
+        case 4:
+            oam[oamAddr++] = value;
+            spritesChanged = true;
+            break;
+        case 5:
+            if (!latch) {
+                fineX = value & 7;
+                t = static_cast<uint16_t>((t & 0xFFE0) | value >> 3);
+            } else {
+                t = static_cast<uint16_t>((t & 0x8C1F) | (value & 0x07) << 12 | (value & 0xF8) << 2);
+            }
+            latch = !latch;
+            break;
+        case 6:
+            if (!latch) {
+                t = static_cast<uint16_t>((t & 0x00FF) | (value & 0x3F) << 8);
+            } else {
+                t = static_cast<uint16_t>((t & 0xFF00) | value);
+                v = t;
+            }
+            latch = !latch;
+            break;
+        case 7:
+            memoryWrite(v & 0x3FFF, value);
+            v = static_cast<uint16_t>(v + addressIncrement());
+            break;
+        }
+    }
+
+    // One byte of OAM DMA.
+    void writeOam(uint8_t value) {
+        oam[oamAddr++] = value;
+        spritesChanged = true;
+    }
+
+    /*
+     * Timing, driven by the emulator's scheduler.
+     */
+
+    void startVBlank() { status |= 0x80; }
+
+    // Pre-render line: flags clear and the vertical scroll is reloaded.
+    void startFrame() {
+        status &= 0x1F;
+        if (renderingEnabled())
+            v = static_cast<uint16_t>((v & 0x841F) | (t & 0x7BE0));
+    }
+
+    bool nmiEnabled() const { return (ctrl & 0x80) != 0; }
+    bool inVBlank() const { return (status & 0x80) != 0; }
+    bool renderingEnabled() const { return (mask & 0x18) != 0; }
+
+    // Draws visible line `line` into `row` (kWidth colour indices), then
+    // advances the scroll registers the way the end of a line does.
+    void renderScanline(int line, uint8_t *row) {
+        if (!renderingEnabled()) {
+            std::memset(row, palette[0] & 0x3F, kWidth);
+            return;
+        }
+
+        uint8_t line8[kWidth + 16] = {};
+        const uint8_t *background = renderBackground(line8);
+
+        uint8_t sprites[kWidth + 8] = {};
+        if (mask & 0x10)
+            renderSprites(line, background, sprites);
+
+        // Branch-free so that the compiler vectorises the merge.
+        uint8_t colours[kWidth];
+        for (int x = 0; x < kWidth; x++) {
+            const uint8_t s = sprites[x];
+            const uint8_t b = background[x];
+            const bool front = s != 0 && (b == 0 || (s & kBehind) == 0);
+            colours[x] = front ? static_cast<uint8_t>(s & 0x1F) : b;
+        }
+        const uint8_t grey = (mask & 0x01) ? 0x30 : 0x3F;
+        for (int x = 0; x < kWidth; x++)
+            row[x] = palette[colours[x]] & grey;
+
+        endScanline();
+    }
+
+    // Has the same effect on the PPU state as renderScanline(), without
+    // drawing: the sprite overflow and sprite 0 hit flags, and the scroll.
+    // Only a line with sprite 0 on it draws its background, for the hit test.
+    void advanceScanline(int line) {
+        if (!renderingEnabled())
+            return;
+        if (mask & 0x10) {
+            const int height = spriteHeight();
+            if (spritesChanged || spriteLinesHeight != height)
+                buildSpriteLines(height);
+            if (spriteOverflow[line])
+                status |= 0x20;
+            // Sprite 0 comes first in its lines, as sprites are bucketed in
+            // OAM order.
+            if (!(status & 0x40) && spriteCounts[line] != 0 && spriteLines[line][0] == 0) {
+                uint8_t line8[kWidth + 16] = {};
+                const uint8_t *background = renderBackground(line8);
+                testSpriteZero(oam[3], spriteRow(line, 0, height), background);
+            }
+        }
+        endScanline();
+    }
+
+    uint64_t hash(uint64_t seed) const {
+        const uint8_t regs[] = {ctrl, mask, status, oamAddr, fineX, latch, readBuffer, openBus,
+                                static_cast<uint8_t>(v), static_cast<uint8_t>(v >> 8),
+                                static_cast<uint8_t>(t), static_cast<uint8_t>(t >> 8)};
+        seed = fnv1a64(regs, sizeof(regs), seed);
+        seed = fnv1a64(vram.data(), vram.size(), seed);
+        seed = fnv1a64(palette.data(), palette.size(), seed);
+        seed = fnv1a64(oam.data(), oam.size(), seed);
+        if (chrWritable)
+            seed = fnv1a64(chr.data(), chr.size(), seed);
+        return seed;
+    }
+
+    // What a save state keeps. CHR-ROM belongs to the cartridge, and the
+    // decoded tiles and sprite lines are rebuilt from the rest, so only
+    // CHR-RAM is saved with the registers and memories.
+    struct State {
+        uint8_t ctrl;
+        uint8_t mask;
+        uint8_t status;
+        uint8_t oamAddr;
+        uint16_t v;
+        uint16_t t;
+        uint8_t fineX;
+        bool latch;
+        uint8_t readBuffer;
+        uint8_t openBus;
+        std::array<uint8_t, 0x1000> vram;
+        std::array<uint8_t, 32> palette;
+        std::array<uint8_t, 256> oam;
+        std::array<uint8_t, 0x2000> chrRam; // Unused with CHR-ROM
+
+        bool nmiEnabled() const { return (ctrl & 0x80) != 0; }
+        bool inVBlank() const { return (status & 0x80) != 0; }
+    };
+
+    void save(State &s) const {
+        s.ctrl = ctrl;
+        s.mask = mask;
+        s.status = status;
+        s.oamAddr = oamAddr;
+        s.v = v;
+        s.t = t;
+        s.fineX = fineX;
+        s.latch = latch;
+        s.readBuffer = readBuffer;
+        s.openBus = openBus;
+        s.vram = vram;
+        s.palette = palette;
+        s.oam = oam;
+        if (chrWritable)
+            s.chrRam = chr;
+    }
+
+    // Only valid with the cartridge the state was saved with.
+    void load(const State &s) {
+        ctrl = s.ctrl;
+        mask = s.mask;
+        status = s.status;
+        oamAddr = s.oamAddr;
+        v = s.v;
+        t = s.t;
+        fineX = s.fineX;
+        latch = s.latch;
+        readBuffer = s.readBuffer;
+        openBus = s.openBus;
+        vram = s.vram;
+        palette = s.palette;
+        oam = s.oam;
+        if (chrWritable) {
+            chr = s.chrRam;
+            tilesDecoded.fill(0);
+        }
+        spritesChanged = true;
+    }
+
+  private:
+    uint16_t addressIncrement() const { return (ctrl & 0x04) ? 32 : 1; }
+
+    static uint8_t paletteIndex(uint16_t address) {
+        uint8_t i = address & 0x1F;
+        // $3F10/$3F14/$3F18/$3F1C mirror the backdrop entries.
+        if ((i & 0x13) == 0x10)
+            i &= 0x0F;
+        return i;
+    }
+
+    uint16_t nametableIndex(uint16_t address) const {
+        uint16_t offset = address & 0x03FF;
+        uint16_t table = (address >> 10) & 3;
+        if (fourScreen)
+            return static_cast<uint16_t>(table * 0x400 + offset);
+        table = vertical ? (table & 1) : (table >> 1);
+        return static_cast<uint16_t>(table * 0x400 + offset);
+    }
+
+    uint8_t memoryRead(uint16_t address) const {
+        address &= 0x3FFF;
+        if (address < 0x2000)
+            return chr[address];
+        if (address < 0x3F00)
+            return vram[nametableIndex(address)];
+        return palette[paletteIndex(address)];
+    }
+
+    void memoryWrite(uint16_t address, uint8_t value) {
+        address &= 0x3FFF;
+        if (address < 0x2000) {
+            if (chrWritable && chr[address] != value) {
+                chr[address] = value;
+                tilesDecoded[address >> 10] &= ~(uint64_t{1} << (address >> 4 & 63));
+            }
+        } else if (address < 0x3F00) {
+            vram[nametableIndex(address)] = value;
+        } else {
+            palette[paletteIndex(address)] = value & 0x3F;
+        }
+    }
+
+    /*
+     * CHR is kept decoded as well: one byte per pixel (0-3), a row of eight
+     * pixels per uint64_t, leftmost pixel first in memory. CHR-ROM is decoded
+     * when the cartridge is set; CHR-RAM tiles are decoded again on first use
+     * after a write.
+     */
+
+    static constexpr uint16_t kTiles = 0x2000 / 16;
+
+    void decodeTile(uint16_t tile) {
+        for (int row = 0; row < 8; row++) {
+            const uint8_t lo = chr[tile * 16 + row];
+            const uint8_t hi = chr[tile * 16 + row + 8];
+            uint8_t pixels[8];
+            for (int x = 0; x < 8; x++)
+                pixels[x] = static_cast<uint8_t>(((lo >> (7 - x)) & 1) | ((hi >> (7 - x)) & 1) << 1);
+            std::memcpy(&tileRows[tile * 8 + row], pixels, 8);
+        }
+        tilesDecoded[tile >> 6] |= uint64_t{1} << (tile & 63);
+    }
+
+    // Row `row` (0-7) of the tile at CHR address `pattern`.
+    uint64_t tileRow(uint16_t pattern, int row) {
+        const uint16_t tile = pattern >> 4;
+        if (!(tilesDecoded[tile >> 6] >> (tile & 63) & 1))
+            decodeTile(tile);
+        return tileRows[tile * 8 + row];
+    }
+
+    // The row mirrored left to right.
+    static uint64_t flipped(uint64_t row) {
+        row = (row & 0x00FF00FF00FF00FF) << 8 | (row >> 8 & 0x00FF00FF00FF00FF);
+        row = (row & 0x0000FFFF0000FFFF) << 16 | (row >> 16 & 0x0000FFFF0000FFFF);
+        return row << 32 | row >> 32;
+    }
+
+    // `value` in every byte where `row` has an opaque pixel, else 0.
+    static uint64_t opaqueBytes(uint64_t row, uint8_t value) {
+        return ((row | row >> 1) & 0x0101010101010101) * value;
+    }
+
+    // The line's background as palette entries 0-15 (0 is transparent),
+    // pixel 0 first, drawn into `line8` (kWidth + 16 bytes, zeroed).
+    const uint8_t *renderBackground(uint8_t *line8) {
+        if (mask & 0x08)
+            renderTiles(line8);
+        uint8_t *background = line8 + fineX;
+        if (!(mask & 0x02))
+            std::memset(background, 0, 8);
+        return background;
+    }
+
+    // Fills `out` a whole tile at a time: pixel 0 of the line is out[fineX].
+    void renderTiles(uint8_t *out) {
+        uint16_t address = v;
+        const uint16_t patternBase = (ctrl & 0x10) ? 0x1000 : 0;
+        const int fineY = (address >> 12) & 7;
+        for (int tile = 0; tile < 33; tile++) {
+            uint8_t name = vram[nametableIndex(0x2000 | (address & 0x0FFF))];
+            uint8_t attribute = vram[nametableIndex(static_cast<uint16_t>(
+                0x23C0 | (address & 0x0C00) | ((address >> 4) & 0x38) | ((address >> 2) & 0x07)))];
+            int shift = ((address >> 4) & 4) | (address & 2);
+            uint8_t group = static_cast<uint8_t>(((attribute >> shift) & 3) << 2);
+
+            const uint64_t row = tileRow(static_cast<uint16_t>(patternBase + name * 16), fineY);
+            const uint64_t pixels = row | opaqueBytes(row, group);
+            std::memcpy(out + tile * 8, &pixels, 8);
+
+            // Coarse X, wrapping into the next horizontal nametable.
+            if ((address & 0x1F) == 31)
+                address = static_cast<uint16_t>((address & ~0x1F) ^ 0x0400);
+            else
+                address++;
+        }
+    }
+
+    // Sprites are drawn one line below their OAM Y. Up to eight per line, in
+    // OAM order; the first opaque sprite pixel wins. Which sprites fall on
+    // each line is worked out once whenever OAM or the sprite size changed,
+    // rather than by scanning all of OAM on every line.
+    void buildSpriteLines(int height) {
+        spriteCounts.fill(0);
+        spriteOverflow.fill(false);
+        for (uint8_t i = 0; i < 64; i++) {
+            const int top = oam[i * 4] + 1;
+            const int bottom = top + height < kHeight ? top + height : kHeight;
+            for (int line = top; line < bottom; line++) {
+                if (spriteCounts[line] == 8)
+                    spriteOverflow[line] = true;
+                else
+                    spriteLines[line][spriteCounts[line]++] = i;
+            }
+        }
+        spriteLinesHeight = static_cast<uint8_t>(height);
+        spritesChanged = false;
+    }
+
+    // Draws the line's sprites last to first, so that earlier ones overwrite
+    // later ones. `out` gets palette entries 16-31, or 0, with kBehind set for
+    // sprites behind the background.
+    void renderSprites(int line, const uint8_t *background, uint8_t *out) {
+        const int height = spriteHeight();
+        if (spritesChanged || spriteLinesHeight != height)
+            buildSpriteLines(height);
+        if (spriteOverflow[line])
+            status |= 0x20;
+
+        for (int k = spriteCounts[line] - 1; k >= 0; k--) {
+            const uint8_t i = spriteLines[line][k];
+            const uint8_t attributes = oam[i * 4 + 2];
+            const uint64_t row8 = spriteRow(line, i, height);
+            const int x = oam[i * 4 + 3];
+            if (i == 0)
+                testSpriteZero(x, row8, background);
+            const uint8_t group = static_cast<uint8_t>(0x10 | (attributes & 3) << 2 | ((attributes & 0x20) ? kBehind : 0));
+
+            // `out` has room past the right edge for sprites that run off it.
+            uint64_t merged;
+            std::memcpy(&merged, out + x, 8);
+            merged = (merged & ~opaqueBytes(row8, 0xFF)) | row8 | opaqueBytes(row8, group);
+            std::memcpy(out + x, &merged, 8);
+        }
+    }
+
+    int spriteHeight() const { return (ctrl & 0x20) ? 16 : 8; }
+
+    // The eight pixels (0-3) of sprite `i` on `line`, flipped as its attributes say.
+    // Pixels left of the left-edge clip are dropped.
+    uint64_t spriteRow(int line, uint8_t i, int height) {
+        const uint8_t *s = &oam[i * 4];
+        int row = line - 1 - s[0];
+        const uint8_t attributes = s[2];
+        if (attributes & 0x80)
+            row = height - 1 - row;
+        uint16_t pattern;
+        if (height == 16) {
+            pattern = static_cast<uint16_t>((s[1] & 1) * 0x1000 + (s[1] & 0xFE) * 16);
+            if (row >= 8) {
+                pattern += 16;
+                row -= 8;
+            }
+        } else {
+            pattern = static_cast<uint16_t>(((ctrl & 0x08) ? 0x1000 : 0) + s[1] * 16);
+        }
+        uint64_t row8 = tileRow(pattern, row);
+        if (attributes & 0x40)
+            row8 = flipped(row8);
+
+        const int firstX = (mask & 0x04) ? 0 : 8;
+        const int x = s[3];
+        if (x < firstX) {
+            uint8_t pixels[8];
+            std::memcpy(pixels, &row8, 8);
+            for (int bit = 0; bit < firstX - x; bit++)
+                pixels[bit] = 0;
+            std::memcpy(&row8, pixels, 8);
+        }
+        return row8;
+    }
+
+    // Sprite 0 hit: an opaque sprite 0 pixel over an opaque background one,
+    // anywhere but the last column.
+    void testSpriteZero(int x, uint64_t row8, const uint8_t *background) {
+        uint8_t pixels[8];
+        std::memcpy(pixels, &row8, 8);
+        for (int bit = 0; bit < 8 && x + bit < 255; bit++) {
+            if (pixels[bit] && background[x + bit])
+                status |= 0x40;
+        }
+    }
+
+    void endScanline() {
+        incrementY();
+        // Horizontal scroll bits come back from t for the next line.
+        v = static_cast<uint16_t>((v & 0xFBE0) | (t & 0x041F));
+    }
+
+    void incrementY() {
+        if ((v & 0x7000) != 0x7000) {
+            v = static_cast<uint16_t>(v + 0x1000);
+            return;
+        }
+        v &= 0x8FFF;
+        int coarseY = (v >> 5) & 0x1F;
+        if (coarseY == 29) {
+            coarseY = 0;
+            v ^= 0x0800;
+        } else if (coarseY == 31) {
+            coarseY = 0;
+        } else {
+            coarseY++;
+        }
+        v = static_cast<uint16_t>((v & ~0x03E0) | coarseY << 5);
+    }
+
+    uint8_t ctrl = 0;
+    uint8_t mask = 0;
+    uint8_t status = 0;
+    uint8_t oamAddr = 0;
+    uint16_t v = 0;
+    uint16_t t = 0;
+    uint8_t fineX = 0;
+    bool latch = false;
+    uint8_t readBuffer = 0;
+    uint8_t openBus = 0;
+
+    bool vertical = false;
+    bool fourScreen = false;
+    bool chrWritable = true;
+
+    std::array<uint8_t, 0x1000> vram{};
+    std::array<uint8_t, 32> palette{};
+    std::array<uint8_t, 256> oam{};
+    std::array<uint8_t, 0x2000> chr{};
+    std::array<uint64_t, kTiles * 8> tileRows{};
+    std::array<uint64_t, kTiles / 64> tilesDecoded{};
+
+    // Derived from OAM by buildSpriteLines().
+    static constexpr uint8_t kBehind = 0x80;
+    bool spritesChanged = true;
+    uint8_t spriteLinesHeight = 0;
+    std::array<uint8_t, kHeight> spriteCounts{};
+    std::array<bool, kHeight> spriteOverflow{};
+    std::array<std::array<uint8_t, 8>, kHeight> spriteLines{};
+};
+
+// 2C02 colours as 0xRRGGBB.
+constexpr uint32_t kNesPalette[64] = {
+    0x626262, 0x001FB2, 0x2404C8, 0x5200B2, 0x730076, 0x800024, 0x730B00, 0x522800,
+    0x244400, 0x005700, 0x005C00, 0x005324, 0x003C76, 0x000000, 0x000000, 0x000000,
+    0xABABAB, 0x0D57FF, 0x4B30FF, 0x8A13FF, 0xBC08D6, 0xD21269, 0xC72E00, 0x9D5400,
+    0x607B00, 0x209800, 0x00A300, 0x009942, 0x007DB4, 0x000000, 0x000000, 0x000000,
+    0xFFFFFF, 0x53AEFF, 0x9085FF, 0xD365FF, 0xFF57FF, 0xFF5DCF, 0xFF7757, 0xFA9E00,
+    0xBDC700, 0x7AE700, 0x43F611, 0x26EF7E, 0x2CD5F6, 0x4E4E4E, 0x000000, 0x000000,
+    0xFFFFFF, 0xB6E1FF, 0xCED1FF, 0xE9C3FF, 0xFFBCFF, 0xFFBDF4, 0xFFC6C3, 0xFFD59A,
+    0xE9E681, 0xCEF481, 0xB6FB9A, 0xA9FAC3, 0xA9F0F4, 0xB8B8B8, 0x000000, 0x000000,
+};
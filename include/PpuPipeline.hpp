@@ -0,0 +1,194 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "Ppu.hpp"
+
+// Draws the picture on a second thread, from a log of everything the CPU
+// did to the PPU.
+//
+// The emulation thread keeps its own Ppu for the registers the CPU reads,
+// and advances it through each scanline without drawing (Ppu::advanceScanline
+// works out sprite 0 hit and overflow itself, so the CPU never waits for the
+// renderer mid-frame). Every register access that changes PPU state, OAM DMA
+// byte and timing event goes into a single-producer ring; the renderer
+// applies them in the same order to a copy of the Ppu and draws each line
+// into the frame buffer. Both copies see the same sequence, so the picture
+// is the one the single-threaded path draws. The emulator waits for the
+// renderer once per frame, before the frame buffer is read.
+class PpuPipeline {
+  public:
+    enum class Op : uint8_t {
+        Write,     // writeRegister(addr, value)
+        Read,      // readRegister(addr), for its side effects
+        Oam,       // writeOam(value)
+        VBlank,    // startVBlank()
+        Frame,     // startFrame()
+        Scanline,  // renderScanline(addr)
+        Advance,   // advanceScanline(addr), for frames that are not shown
+    };
+
+    struct Stats {
+        uint64_t frames = 0;    // Frames waited for
+        uint64_t waits = 0;     // Of those, the renderer was still busy
+        uint64_t waitNs = 0;    // Time the emulation thread spent waiting
+        uint64_t entries = 0;   // Log entries
+        uint64_t renderNs = 0;  // Time the renderer spent applying the log
+    };
+
+    explicit PpuPipeline(size_t capacity = 1 << 16) : ring(capacity) {}
+
+    ~PpuPipeline() { stop(); }
+
+    PpuPipeline(const PpuPipeline &) = delete;
+    PpuPipeline &operator=(const PpuPipeline &) = delete;
+
+    // Starts the renderer from `ppu`, drawing into `frame`
+    // (Ppu::kWidth x Ppu::kHeight).
+    void start(const Ppu &ppu, uint8_t *frame) {
+        stop();
+        renderer = ppu;
+        last.op = Op::Frame;
+        output = frame;
+        stopping.store(false, std::memory_order_relaxed);
+        worker = std::thread([this] { renderLoop(); });
+    }
+
+    void stop() {
+        if (!worker.joinable())
+            return;
+        stopping.store(true, std::memory_order_release);
+        wake();
+        worker.join();
+    }
+
+    bool running() const { return worker.joinable(); }
+
+    // Emulation thread only. Waits if the renderer is a whole ring behind.
+    void push(Op op, uint16_t addr = 0, uint8_t value = 0) {
+        if (op == Op::Read) {
+            // Only $2002, $2004 and $2007 reads change anything, and a $2002
+            // or $2004 read right after the same one changes nothing, so a
+            // polling loop adds one entry rather than one per pass.
+            const int reg = addr & 7;
+            if (reg != 2 && reg != 4 && reg != 7)
+                return;
+            if (reg != 7 && last.op == Op::Read && (last.addr & 7) == reg)
+                return;
+        }
+        const uint64_t t = tail.load(std::memory_order_relaxed);
+        while (t - head.load(std::memory_order_acquire) == ring.size()) {
+            wake();
+            std::this_thread::yield();
+        }
+        last = {op, value, addr};
+        ring[t % ring.size()] = last;
+        tail.store(t + 1, std::memory_order_release);
+        entries++;
+        // The renderer is woken for batches of lines: waking it costs more
+        // than drawing one.
+        if ((op == Op::Scanline || op == Op::Advance) && (addr & (kLinesPerWake - 1)) == kLinesPerWake - 1)
+            wake();
+    }
+
+    // Returns once everything pushed so far has been drawn.
+    void sync() {
+        if (!running())
+            return;
+        const uint64_t t = tail.load(std::memory_order_relaxed);
+        frames++;
+        uint64_t h = head.load(std::memory_order_acquire);
+        if (h == t)
+            return;
+        waits++;
+        const auto begin = std::chrono::steady_clock::now();
+        wake();
+        while (h != t) {
+            head.wait(h, std::memory_order_acquire);
+            h = head.load(std::memory_order_acquire);
+        }
+        waitNs += static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count());
+    }
+
+    // After the emulator replaced its Ppu wholesale (power on, a loaded
+    // state): the renderer continues from the new one.
+    void restart(const Ppu &ppu) {
+        sync();
+        renderer = ppu;
+        last.op = Op::Frame;
+    }
+
+    Stats statistics() const { return {frames, waits, waitNs, entries, renderNs.load(std::memory_order_relaxed)}; }
+
+  private:
+    static constexpr uint16_t kLinesPerWake = 16;
+
+    struct Entry {
+        Op op;
+        uint8_t value;
+        uint16_t addr;
+    };
+
+    void wake() {
+        wakeups.fetch_add(1, std::memory_order_release);
+        wakeups.notify_one();
+    }
+
+    void renderLoop() {
+        for (;;) {
+            const uint32_t seen = wakeups.load(std::memory_order_acquire);
+            uint64_t h = head.load(std::memory_order_relaxed);
+            const uint64_t t = tail.load(std::memory_order_acquire);
+            if (h == t) {
+                if (stopping.load(std::memory_order_acquire))
+                    break;
+                wakeups.wait(seen, std::memory_order_acquire);
+                continue;
+            }
+            const auto begin = std::chrono::steady_clock::now();
+            for (; h != t; h++)
+                apply(ring[h % ring.size()]);
+            renderNs.fetch_add(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                   std::chrono::steady_clock::now() - begin).count()),
+                               std::memory_order_relaxed);
+            head.store(h, std::memory_order_release);
+            head.notify_one();
+        }
+    }
+
+    void apply(const Entry &e) {
+        switch (e.op) {
+        case Op::Write: renderer.writeRegister(e.addr, e.value); break;
+        case Op::Read: renderer.readRegister(e.addr); break;
+        case Op::Oam: renderer.writeOam(e.value); break;
+        case Op::VBlank: renderer.startVBlank(); break;
+        case Op::Frame: renderer.startFrame(); break;
+        case Op::Scanline:
+            renderer.renderScanline(e.addr, output + static_cast<size_t>(e.addr) * Ppu::kWidth);
+            break;
+        case Op::Advance: renderer.advanceScanline(e.addr); break;
+        }
+    }
+
+    std::vector<Entry> ring;
+    Ppu renderer; // Renderer thread only, except while it is idle
+    uint8_t *output = nullptr;
+
+    std::atomic<uint64_t> head{0}; // Next entry to apply
+    std::atomic<uint64_t> tail{0}; // Next entry to fill
+    std::atomic<uint32_t> wakeups{0};
+    std::atomic<bool> stopping{false};
+    std::atomic<uint64_t> renderNs{0};
+    std::thread worker;
+
+    // Emulation thread only.
+    Entry last{Op::Frame, 0, 0};
+    uint64_t frames = 0;
+    uint64_t waits = 0;
+    uint64_t waitNs = 0;
+    uint64_t entries = 0;
+};
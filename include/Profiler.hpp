@@ -0,0 +1,177 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Labels.hpp"
+
+// Guest code profiler. Keeps a shadow call stack driven by JSR/RTS/RTI and
+// interrupts, and attributes CPU cycles both to the PC that spent them and to
+// the call path that was active at the time.
+class Profiler {
+  public:
+    Profiler() {
+        pcCycles.assign(0x10000, 0);
+        nodes.push_back({0, 0, FrameKind::Root, 0});
+        stack.push_back(0);
+    }
+
+    void setLabels(const Labels &names) { labels = names; }
+
+    // Called at the start of every instruction, before any call/return hook
+    // of that instruction runs, so its cycles land on the caller's frame.
+    void beginInstruction(uint16_t pc) {
+        instructionPC = pc;
+        instructionNode = stack.back();
+    }
+
+    void endInstruction(int cycles) {
+        pcCycles[instructionPC] += static_cast<uint64_t>(cycles);
+        nodes[instructionNode].selfCycles += static_cast<uint64_t>(cycles);
+        totalCycles += static_cast<uint64_t>(cycles);
+    }
+
+    void onCall(uint16_t target) { enter(target, FrameKind::Subroutine); }
+
+    void onInterrupt(uint16_t handler) { enter(handler, FrameKind::Interrupt); }
+
+    void onReturn() {
+        if (overflowDepth > 0) {
+            overflowDepth--;
+            return;
+        }
+        // An RTS that does not match a JSR (stack tricks, jump tables pushed
+        // by hand) must not unwind an interrupt frame.
+        if (stack.size() > 1 && nodes[stack.back()].kind == FrameKind::Subroutine)
+            stack.pop_back();
+    }
+
+    void onReturnFromInterrupt() {
+        overflowDepth = 0;
+        while (stack.size() > 1) {
+            FrameKind kind = nodes[stack.back()].kind;
+            stack.pop_back();
+            if (kind == FrameKind::Interrupt)
+                break;
+        }
+    }
+
+    // One line per call path, "root;caller;callee <cycles>", as expected by
+    // flamegraph.pl, inferno and speedscope.
+    void writeCollapsed(std::ostream &out) const {
+        for (uint32_t i = 0; i < nodes.size(); i++) {
+            if (nodes[i].selfCycles == 0)
+                continue;
+            out << pathName(i) << ' ' << nodes[i].selfCycles << '\n';
+        }
+    }
+
+    // Flat per-PC listing, hottest first.
+    void writeFlat(std::ostream &out, size_t limit = 50) const {
+        std::vector<uint32_t> pcs;
+        for (uint32_t pc = 0; pc < pcCycles.size(); pc++) {
+            if (pcCycles[pc] != 0)
+                pcs.push_back(pc);
+        }
+        std::sort(pcs.begin(), pcs.end(), [this](uint32_t a, uint32_t b) {
+            return pcCycles[a] > pcCycles[b];
+        });
+        if (pcs.size() > limit)
+            pcs.resize(limit);
+
+        for (uint32_t pc : pcs) {
+            double share = totalCycles ? 100.0 * static_cast<double>(pcCycles[pc]) /
+                                             static_cast<double>(totalCycles)
+                                       : 0.0;
+            char buffer[32];
+            std::snprintf(buffer, sizeof(buffer), "%04X %6.2f%% ", pc, share);
+            out << buffer << pcCycles[pc] << '\n';
+        }
+    }
+
+    // Cycles the emulator skipped in idle loops. They are also in the totals,
+    // charged to the loop's instructions as if they had run.
+    void onIdleSkip(uint64_t cycles) { idleCycles += cycles; }
+
+    uint64_t cyclesAt(uint16_t pc) const { return pcCycles[pc]; }
+    uint64_t total() const { return totalCycles; }
+    uint64_t idle() const { return idleCycles; }
+
+  private:
+    enum class FrameKind : uint8_t { Root, Subroutine, Interrupt };
+
+    struct Node {
+        uint32_t parent;
+        uint16_t address;
+        FrameKind kind;
+        uint64_t selfCycles;
+    };
+
+    // Games that manipulate the stack by hand can make JSR outnumber RTS
+    // forever; past this depth calls are only counted, not tracked.
+    static constexpr size_t kMaxDepth = 256;
+
+    void enter(uint16_t address, FrameKind kind) {
+        if (stack.size() >= kMaxDepth) {
+            overflowDepth++;
+            return;
+        }
+
+        uint32_t parent = stack.back();
+        uint64_t key = (static_cast<uint64_t>(parent) << 17) |
+                       (static_cast<uint64_t>(kind == FrameKind::Interrupt) << 16) |
+                       address;
+        auto it = children.find(key);
+        if (it == children.end()) {
+            auto index = static_cast<uint32_t>(nodes.size());
+            nodes.push_back({parent, address, kind, 0});
+            it = children.emplace(key, index).first;
+        }
+        stack.push_back(it->second);
+    }
+
+    std::string frameName(uint32_t index) const {
+        const Node &node = nodes[index];
+        if (node.kind == FrameKind::Root)
+            return "root";
+
+        std::string name;
+        if (const std::string *label = labels.find(node.address)) {
+            name = *label;
+        } else {
+            char buffer[16];
+            std::snprintf(buffer, sizeof(buffer), "sub_%04X", node.address);
+            name = buffer;
+        }
+        if (node.kind == FrameKind::Interrupt)
+            name = "[int] " + name;
+        return name;
+    }
+
+    std::string pathName(uint32_t index) const {
+        std::vector<uint32_t> chain;
+        for (uint32_t i = index; i != 0; i = nodes[i].parent)
+            chain.push_back(i);
+
+        std::string path = frameName(0);
+        for (auto it = chain.rbegin(); it != chain.rend(); ++it)
+            path += ";" + frameName(*it);
+        return path;
+    }
+
+    std::vector<uint64_t> pcCycles;
+    std::vector<Node> nodes;
+    std::unordered_map<uint64_t, uint32_t> children;
+    std::vector<uint32_t> stack;
+    Labels labels;
+
+    size_t overflowDepth = 0;
+    uint16_t instructionPC = 0;
+    uint32_t instructionNode = 0;
+    uint64_t totalCycles = 0;
+    uint64_t idleCycles = 0;
+};
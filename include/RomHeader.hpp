@@ -0,0 +1,60 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+// Decoded iNES / NES 2.0 header.
+struct RomHeader {
+    enum class Region : uint8_t { NTSC, PAL, Multi, Dendy };
+
+    bool valid = false;
+    bool nes2 = false;
+    uint16_t mapper = 0;
+    uint32_t prgSize = 0; // bytes
+    uint32_t chrSize = 0; // bytes, 0 means CHR-RAM
+    bool verticalMirroring = false;
+    bool battery = false;
+    bool trainer = false;
+    bool fourScreen = false;
+    Region region = Region::NTSC;
+
+    static RomHeader parse(const uint8_t *h, size_t size) {
+        RomHeader info;
+        if (size < 16 || std::memcmp(h, "NES\x1A", 4) != 0)
+            return info;
+
+        info.valid = true;
+        info.nes2 = (h[7] & 0x0C) == 0x08;
+        info.mapper = static_cast<uint16_t>((h[6] >> 4) | (h[7] & 0xF0));
+        info.verticalMirroring = (h[6] & 0x01) != 0;
+        info.battery = (h[6] & 0x02) != 0;
+        info.trainer = (h[6] & 0x04) != 0;
+        info.fourScreen = (h[6] & 0x08) != 0;
+
+        if (info.nes2) {
+            info.mapper = static_cast<uint16_t>(info.mapper | (h[8] & 0x0F) << 8);
+            // The exponent-multiplier size notation (MSB nibble $F) is rare
+            // enough to be reported as unknown.
+            uint32_t prgUnits = h[4] | static_cast<uint32_t>(h[9] & 0x0F) << 8;
+            uint32_t chrUnits = h[5] | static_cast<uint32_t>(h[9] & 0xF0) << 4;
+            info.prgSize = (h[9] & 0x0F) == 0x0F ? 0 : prgUnits * 0x4000;
+            info.chrSize = (h[9] & 0xF0) == 0xF0 ? 0 : chrUnits * 0x2000;
+            info.region = static_cast<Region>(h[12] & 0x03);
+        } else {
+            info.prgSize = h[4] * 0x4000u;
+            info.chrSize = h[5] * 0x2000u;
+            info.region = (h[9] & 0x01) ? Region::PAL : Region::NTSC;
+        }
+        return info;
+    }
+
+    static const char *regionName(Region region) {
+        switch (region) {
+        case Region::NTSC: return "NTSC";
+        case Region::PAL: return "PAL";
+        case Region::Multi: return "Multi";
+        case Region::Dendy: return "Dendy";
+        }
+        return "";
+    }
+};
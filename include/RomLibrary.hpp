@@ -0,0 +1,215 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+#include "Hash.hpp"
+#include "RomHeader.hpp"
+
+// One ROM file of the library.
+struct RomEntry {
+    std::string path;
+    int64_t mtime = 0;
+    uint64_t size = 0;
+    uint32_t crc32 = 0;
+    Sha1::Digest sha1{};
+    uint8_t rawHeader[16] = {};
+    RomHeader header;
+
+    std::string name() const { return std::filesystem::path(path).stem().string(); }
+};
+
+// Index of every .nes file under a set of directories. Files are hashed and
+// their header parsed by a pool of threads; the result is kept in a cache
+// file, and entries whose size and mtime did not change are reused as is.
+class RomLibrary {
+  public:
+    explicit RomLibrary(std::string cacheFile) : cachePath(std::move(cacheFile)) {}
+
+    void scan(const std::vector<std::string> &directories, unsigned threads = 0) {
+        loadCache();
+
+        std::vector<std::string> paths;
+        for (const std::string &dir : directories) {
+            std::error_code ec;
+            for (auto it = std::filesystem::recursive_directory_iterator(
+                     dir, std::filesystem::directory_options::skip_permission_denied, ec);
+                 it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+                if (ec)
+                    break;
+                if (!it->is_regular_file(ec))
+                    continue;
+                std::string ext = it->path().extension().string();
+                std::transform(ext.begin(), ext.end(), ext.begin(),
+                               [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+                if (ext == ".nes")
+                    paths.push_back(it->path().string());
+            }
+        }
+
+        std::vector<RomEntry> results(paths.size());
+        std::vector<uint8_t> ok(paths.size(), 0);
+        std::atomic<size_t> next{0};
+        std::atomic<size_t> hashed{0};
+
+        auto worker = [&] {
+            for (size_t i = next++; i < paths.size(); i = next++) {
+                struct stat st {};
+                if (::stat(paths[i].c_str(), &st) != 0)
+                    continue;
+
+                auto cached = cache.find(paths[i]);
+                if (cached != cache.end() && cached->second.mtime == st.st_mtime &&
+                    cached->second.size == static_cast<uint64_t>(st.st_size)) {
+                    results[i] = cached->second;
+                    ok[i] = 1;
+                    continue;
+                }
+
+                if (index(paths[i], st, results[i])) {
+                    ok[i] = 1;
+                    hashed++;
+                }
+            }
+        };
+
+        if (threads == 0)
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        threads = static_cast<unsigned>(std::min<size_t>(threads, std::max<size_t>(1, paths.size())));
+        std::vector<std::thread> pool;
+        for (unsigned t = 1; t < threads; t++)
+            pool.emplace_back(worker);
+        worker();
+        for (std::thread &t : pool)
+            t.join();
+
+        roms.clear();
+        for (size_t i = 0; i < results.size(); i++) {
+            if (ok[i])
+                roms.push_back(std::move(results[i]));
+        }
+        std::sort(roms.begin(), roms.end(),
+                  [](const RomEntry &a, const RomEntry &b) { return a.path < b.path; });
+
+        hashedCount = hashed;
+        reusedCount = roms.size() - hashedCount;
+        if (hashedCount != 0 || roms.size() != cache.size())
+            saveCache();
+    }
+
+    const std::vector<RomEntry> &entries() const { return roms; }
+
+    size_t hashedCount = 0;
+    size_t reusedCount = 0;
+
+  private:
+    static bool index(const std::string &path, const struct stat &st, RomEntry &entry) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        auto size = static_cast<size_t>(st.st_size);
+        entry.path = path;
+        entry.mtime = st.st_mtime;
+        entry.size = size;
+        if (size == 0) {
+            ::close(fd);
+            return true;
+        }
+
+        void *mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED)
+            return false;
+        ::madvise(mapping, size, MADV_SEQUENTIAL);
+
+        const auto *data = static_cast<const uint8_t *>(mapping);
+        entry.crc32 = Crc32::compute(data, size);
+        entry.sha1 = Sha1::compute(data, size);
+        std::memcpy(entry.rawHeader, data, std::min<size_t>(size, 16));
+        entry.header = RomHeader::parse(data, size);
+
+        ::munmap(mapping, size);
+        return true;
+    }
+
+    /*
+     * Cache file, little endian:
+     *   "NESLIB1\0", u32 count, then per ROM: u16 path length, path,
+     *   i64 mtime, u64 size, u32 CRC-32, 20-byte SHA-1, 16-byte raw header.
+     */
+
+    void loadCache() {
+        cache.clear();
+        std::FILE *file = std::fopen(cachePath.c_str(), "rb");
+        if (!file)
+            return;
+
+        char magic[8];
+        uint32_t count = 0;
+        if (std::fread(magic, 1, 8, file) == 8 && std::memcmp(magic, kMagic, 8) == 0 &&
+            std::fread(&count, 4, 1, file) == 1) {
+            for (uint32_t i = 0; i < count; i++) {
+                RomEntry e;
+                uint16_t length = 0;
+                if (std::fread(&length, 2, 1, file) != 1)
+                    break;
+                e.path.resize(length);
+                if (std::fread(e.path.data(), 1, length, file) != length ||
+                    std::fread(&e.mtime, 8, 1, file) != 1 || std::fread(&e.size, 8, 1, file) != 1 ||
+                    std::fread(&e.crc32, 4, 1, file) != 1 ||
+                    std::fread(e.sha1.data(), 1, 20, file) != 20 ||
+                    std::fread(e.rawHeader, 1, 16, file) != 16)
+                    break;
+                e.header = RomHeader::parse(e.rawHeader, std::min<uint64_t>(e.size, 16));
+                cache.emplace(e.path, std::move(e));
+            }
+        }
+        std::fclose(file);
+    }
+
+    void saveCache() const {
+        std::string temp = cachePath + ".tmp";
+        std::FILE *file = std::fopen(temp.c_str(), "wb");
+        if (!file)
+            return;
+
+        auto count = static_cast<uint32_t>(roms.size());
+        std::fwrite(kMagic, 1, 8, file);
+        std::fwrite(&count, 4, 1, file);
+        for (const RomEntry &e : roms) {
+            auto length = static_cast<uint16_t>(e.path.size());
+            std::fwrite(&length, 2, 1, file);
+            std::fwrite(e.path.data(), 1, length, file);
+            std::fwrite(&e.mtime, 8, 1, file);
+            std::fwrite(&e.size, 8, 1, file);
+            std::fwrite(&e.crc32, 4, 1, file);
+            std::fwrite(e.sha1.data(), 1, 20, file);
+            std::fwrite(e.rawHeader, 1, 16, file);
+        }
+        bool written = std::fclose(file) == 0;
+        // Replace the old cache only once the new one is complete.
+        if (written)
+            std::rename(temp.c_str(), cachePath.c_str());
+        else
+            std::remove(temp.c_str());
+    }
+
+    static constexpr char kMagic[8] = {'N', 'E', 'S', 'L', 'I', 'B', '1', '\0'};
+
+    std::string cachePath;
+    std::unordered_map<std::string, RomEntry> cache;
+    std::vector<RomEntry> roms;
+};
@@ -0,0 +1,81 @@
+#pragma once
+#include <cstdint>
+#include <limits>
+
+// Future events of the console, keyed by the CPU cycle they are due at.
+//
+// Each kind has at most one pending deadline. The CPU loop only compares the
+// cycle counter against nextDeadline(), so its cost per instruction does not
+// depend on how many devices schedule events.
+class Scheduler {
+  public:
+    enum class Event : uint8_t {
+        FrameEnd,    // End of the current video frame
+        VBlankStart, // PPU enters vertical blank, NMI if enabled
+        VBlankEnd,   // Pre-render line clears the VBlank flag
+        Scanline,    // End of a visible line's pixels, the PPU draws it
+        ApuFrameIrq, // APU frame counter, 4-step mode
+        IrqPoll,     // An interrupt may have become deliverable
+        Count
+    };
+
+    static constexpr uint64_t kNever = std::numeric_limits<uint64_t>::max();
+
+    Scheduler() { clear(); }
+
+    void clear() {
+        for (uint64_t &d : deadlines)
+            d = kNever;
+        next = kNever;
+    }
+
+    void schedule(Event event, uint64_t cycle) {
+        deadlines[index(event)] = cycle;
+        if (cycle < next)
+            next = cycle;
+        else
+            refresh();
+    }
+
+    void cancel(Event event) {
+        deadlines[index(event)] = kNever;
+        refresh();
+    }
+
+    bool pending(Event event) const { return deadlines[index(event)] != kNever; }
+    uint64_t deadline(Event event) const { return deadlines[index(event)]; }
+    uint64_t nextDeadline() const { return next; }
+
+    // Removes and returns the earliest event due at or before `now`, with
+    // the cycle it was due at. Ties go to the lowest kind.
+    bool popDue(uint64_t now, Event &event, uint64_t &cycle) {
+        if (next > now)
+            return false;
+        int best = 0;
+        for (int i = 1; i < kCount; i++) {
+            if (deadlines[i] < deadlines[best])
+                best = i;
+        }
+        event = static_cast<Event>(best);
+        cycle = deadlines[best];
+        deadlines[best] = kNever;
+        refresh();
+        return true;
+    }
+
+  private:
+    static constexpr int kCount = static_cast<int>(Event::Count);
+
+    static int index(Event event) { return static_cast<int>(event); }
+
+    void refresh() {
+        next = kNever;
+        for (uint64_t d : deadlines) {
+            if (d < next)
+                next = d;
+        }
+    }
+
+    uint64_t deadlines[kCount];
+    uint64_t next;
+};
@@ -0,0 +1,751 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Emulator.hpp"
+#include "Lockstep.hpp"
+#include "OpcodeTable.hpp"
+
+// Microbenchmarks for the CPU core: every implemented opcode, the addressing
+// mode helpers, the memory bus and whole frames; for the PPU alone and the
+// disassembler.
+//
+//   nesemu-bench [--filter <text>] [--samples <n>] [--min-time <ms>]
+//                [--rom <file.nes>] [--json <out.json>] [--compare <old.json>]
+
+using Clock = std::chrono::steady_clock;
+
+static volatile uint64_t sink;
+
+struct BenchResult {
+	std::string name;
+	std::string group;
+	uint64_t iterations = 0;
+	double median = 0;
+	double mean = 0;
+	double stddev = 0;
+	double min = 0;
+};
+
+class BenchRunner {
+public:
+	int samples = 15;
+	double minSampleSeconds = 0.005;
+	std::string filter;
+	std::vector<BenchResult> results;
+
+	// body(n) performs n operations; the reported figure is ns per operation.
+	// Slow operations can start the calibration below 1000 iterations.
+	bool run(const std::string& group, const std::string& name, const std::function<void(uint64_t)>& body,
+		uint64_t firstIterations = 1000) {
+		std::string fullName = group + "/" + name;
+		if (!filter.empty() && fullName.find(filter) == std::string::npos) return false;
+
+		// Calibrate so that one sample lasts long enough to dwarf timer noise.
+		uint64_t iterations = firstIterations;
+		while (true) {
+			double seconds = time(body, iterations);
+			if (seconds >= minSampleSeconds || iterations >= (1ull << 32)) break;
+			iterations *= 2;
+		}
+
+		body(iterations); // Warm-up
+		std::vector<double> perOp;
+		for (int i = 0; i < samples; i++) {
+			perOp.push_back(time(body, iterations) * 1e9 / static_cast<double>(iterations));
+		}
+		std::sort(perOp.begin(), perOp.end());
+
+		BenchResult r;
+		r.name = name;
+		r.group = group;
+		r.iterations = iterations;
+		r.median = perOp[perOp.size() / 2];
+		r.min = perOp.front();
+		for (double v : perOp) r.mean += v;
+		r.mean /= static_cast<double>(perOp.size());
+		for (double v : perOp) r.stddev += (v - r.mean) * (v - r.mean);
+		r.stddev = std::sqrt(r.stddev / static_cast<double>(perOp.size()));
+
+		double cv = r.mean > 0 ? 100.0 * r.stddev / r.mean : 0.0;
+		std::printf("%-12s %-28s %10.2f ns/op  (min %8.2f, +/- %5.1f%%)%s\n", group.c_str(), name.c_str(),
+			r.median, r.min, cv, cv > 5.0 ? "  unstable" : "");
+		results.push_back(r);
+		return true;
+	}
+
+private:
+	static double time(const std::function<void(uint64_t)>& body, uint64_t iterations) {
+		auto start = Clock::now();
+		body(iterations);
+		return std::chrono::duration<double>(Clock::now() - start).count();
+	}
+};
+
+// A 32 KiB PRG image mapped at $8000, with the vectors pointing into it.
+struct TestRom {
+	std::vector<uint8_t> image = std::vector<uint8_t>(16 + 0x8000, 0);
+
+	uint8_t& at(uint16_t addr) { return image[16 + (addr - 0x8000)]; }
+
+	void setVector(uint16_t vector, uint16_t target) {
+		at(vector) = static_cast<uint8_t>(target);
+		at(static_cast<uint16_t>(vector + 1)) = static_cast<uint8_t>(target >> 8);
+	}
+
+	// Repeats an instruction sequence from $8000 up to the code limit, then
+	// loops back with JMP $8000.
+	void fill(const std::vector<uint8_t>& sequence, uint16_t limit = 0xF000) {
+		uint16_t addr = 0x8000;
+		while (addr + sequence.size() + 3 < limit) {
+			for (uint8_t b : sequence) at(addr++) = b;
+		}
+		at(addr++) = 0x4C;
+		at(addr++) = 0x00;
+		at(addr++) = 0x80;
+	}
+};
+
+static void prepare(Emulator& emu, TestRom& rom) {
+	rom.setVector(0xFFFC, 0x8000);
+	emu.setTracing(false);
+	emu.loadROM(rom.image);
+	// Pointers used by the indirect modes, at $10 and $0300.
+	emu.write(0x10, 0x00);
+	emu.write(0x11, 0x02);
+	emu.write(0x0300, 0x00);
+	emu.write(0x0301, 0x80);
+}
+
+static std::vector<uint8_t> encode(uint8_t opcode) {
+	switch (kOpcodeModes[opcode]) {
+	case AddressingMode::Implied:
+	case AddressingMode::Accumulator:
+		return { opcode };
+	case AddressingMode::Immediate:
+		return { opcode, 0x01 };
+	case AddressingMode::Relative:
+		return { opcode, 0x00 }; // Taken or not, lands on the next instruction
+	case AddressingMode::ZeroPage:
+	case AddressingMode::ZeroPageX:
+	case AddressingMode::ZeroPageY:
+	case AddressingMode::IndexedIndirect:
+	case AddressingMode::IndirectIndexed:
+		return { opcode, 0x10 };
+	case AddressingMode::Indirect:
+		return { opcode, 0x00, 0x03 };
+	default:
+		return { opcode, 0x00, 0x02 };
+	}
+}
+
+// Runs a few instructions on a copy; false if the CPU halted.
+static bool survives(const Emulator& emu, int instructions) {
+	Emulator probe = emu;
+	for (int i = 0; i < instructions && !probe.isHalted(); i++) {
+		probe.emulate_cpu<false>();
+	}
+	return !probe.isHalted();
+}
+
+static bool implemented(uint8_t opcode) {
+	TestRom rom;
+	rom.fill(encode(opcode));
+	Emulator emu;
+	prepare(emu, rom);
+	return survives(emu, 1);
+}
+
+static void runInstructions(Emulator& emu, uint64_t n) {
+	for (uint64_t i = 0; i < n; i++) {
+		emu.emulate_cpu<false>();
+	}
+	sink = emu.getCycleCount();
+}
+
+static void benchOpcodes(BenchRunner& runner) {
+	// Instructions that only make sense in pairs are measured together.
+	const uint8_t paired[] = { 0x00, 0x40, 0x20, 0x60, 0x48, 0x68, 0x08, 0x28 };
+
+	for (int op = 0; op < 256; op++) {
+		auto opcode = static_cast<uint8_t>(op);
+		if (opcode == 0x02 || std::find(std::begin(paired), std::end(paired), opcode) != std::end(paired)) continue;
+		if (!implemented(opcode)) continue;
+
+		TestRom rom;
+		if (opcode == 0x4C) {
+			rom.at(0x8000) = 0x4C; // JMP $8000, a tight self loop
+			rom.at(0x8001) = 0x00;
+			rom.at(0x8002) = 0x80;
+		} else if (opcode == 0x6C) {
+			rom.at(0x8000) = 0x6C; // JMP ($0300) -> $8000
+			rom.at(0x8001) = 0x00;
+			rom.at(0x8002) = 0x03;
+		} else {
+			rom.fill(encode(opcode));
+		}
+
+		Emulator emu;
+		prepare(emu, rom);
+		char name[48];
+		std::snprintf(name, sizeof(name), "%02X %s %s", opcode, kOpcodeMnemonics[opcode],
+			addressingModeName(kOpcodeModes[opcode]));
+		// An opcode that mis-steps the PC ends up on garbage and halts.
+		if (!survives(emu, 100000)) {
+			std::printf("%-12s %-28s skipped: the CPU halts on this sequence\n", "opcode", name);
+			continue;
+		}
+		runner.run("opcode", name, [&](uint64_t n) { runInstructions(emu, n); });
+	}
+
+	struct Pair {
+		const char* name;
+		std::vector<uint8_t> sequence;
+		uint16_t handler;
+		uint8_t handlerOpcode;
+	};
+	const Pair pairs[] = {
+		{ "JSR/RTS", { 0x20, 0x00, 0xF0 }, 0xF000, 0x60 },
+		{ "BRK/RTI", { 0x00, 0xEA }, 0xF000, 0x40 },
+		{ "PHA/PLA", { 0x48, 0x68 }, 0, 0 },
+		{ "PHP/PLP", { 0x08, 0x28 }, 0, 0 },
+	};
+	for (const Pair& pair : pairs) {
+		TestRom rom;
+		rom.fill(pair.sequence);
+		if (pair.handler) {
+			rom.at(pair.handler) = pair.handlerOpcode;
+			rom.setVector(0xFFFE, pair.handler);
+		}
+		Emulator emu;
+		prepare(emu, rom);
+		runner.run("opcode", pair.name, [&](uint64_t n) { runInstructions(emu, n); });
+	}
+}
+
+static void benchAddressing(BenchRunner& runner) {
+	TestRom rom;
+	rom.fill({ 0x10, 0x02 });
+	Emulator emu;
+	prepare(emu, rom);
+	emu.setRegisters({ 0x8000, 0, 1, 1, 0xFD, 0x24, 0 });
+
+	// The helpers advance the PC through the operand bytes, so it is rewound
+	// every few thousand calls.
+	auto batched = [&](const std::function<void()>& call) {
+		return [&emu, call](uint64_t n) {
+			CpuRegisters start = emu.registers();
+			for (uint64_t i = 0; i < n; i++) {
+				if ((i & 4095) == 0) emu.setRegisters(start);
+				call();
+			}
+		};
+	};
+
+	uint16_t addr = 0;
+	uint8_t zp = 0;
+	runner.run("addressing", "readAbsolute", batched([&] { emu.readAbsolute(&addr); sink = addr; }));
+	runner.run("addressing", "readAbsoluteIndexed", batched([&] { emu.readAbsoluteIndexed(&addr, 1); sink = addr; }));
+	runner.run("addressing", "readIndirectIndexed", batched([&] { emu.readIndirectIndexed(&addr, 1); sink = addr; }));
+	runner.run("addressing", "readIndexedIndirect", batched([&] { emu.readIndexedIndirect(&addr, 1); sink = addr; }));
+	runner.run("addressing", "readZeroPage", batched([&] { emu.readZeroPage(&zp); sink = zp; }));
+	runner.run("addressing", "readZeroPageIndexed", batched([&] { emu.readZeroPageIndexed(&zp, 1); sink = zp; }));
+}
+
+static void benchBus(BenchRunner& runner) {
+	TestRom rom;
+	rom.fill({ 0xEA });
+	Emulator emu;
+	prepare(emu, rom);
+
+	runner.run("bus", "read RAM", [&](uint64_t n) {
+		uint64_t sum = 0;
+		for (uint64_t i = 0; i < n; i++) sum += emu.read(static_cast<uint16_t>(i & 0x1FFF));
+		sink = sum;
+	});
+	runner.run("bus", "read ROM", [&](uint64_t n) {
+		uint64_t sum = 0;
+		for (uint64_t i = 0; i < n; i++) sum += emu.read(static_cast<uint16_t>(0x8000 | (i & 0x7FFF)));
+		sink = sum;
+	});
+	runner.run("bus", "read mixed", [&](uint64_t n) {
+		uint64_t sum = 0;
+		for (uint64_t i = 0; i < n; i++) sum += emu.read(static_cast<uint16_t>(i * 0x9E37));
+		sink = sum;
+	});
+	runner.run("bus", "write RAM", [&](uint64_t n) {
+		for (uint64_t i = 0; i < n; i++) emu.write(static_cast<uint16_t>(i & 0x07FF), static_cast<uint8_t>(i));
+		sink = emu.read(0);
+	});
+}
+
+static void benchFrames(BenchRunner& runner, const std::string& romPath) {
+	// A synthetic game-like frame: clear a page, sum it, count down in X.
+	//   loop: LDX #$00
+	//   clr:  STA $0300,X / INX / BNE clr
+	//         LDY #$20
+	//   sum:  ADC $0300,Y / DEY / BNE sum
+	//         JMP loop
+	TestRom rom;
+	const uint8_t program[] = {
+		0xA2, 0x00,
+		0x9D, 0x00, 0x03, 0xE8, 0xD0, 0xFA,
+		0xA0, 0x20,
+		0x79, 0x00, 0x03, 0x88, 0xD0, 0xFA,
+		0x4C, 0x00, 0x80,
+	};
+	std::memcpy(&rom.at(0x8000), program, sizeof(program));
+	// Each frame is measured with both cores, side by side.
+	for (Stepping stepping : { Stepping::Instruction, Stepping::Cycle }) {
+		const std::string suffix = stepping == Stepping::Cycle ? " (cycle)" : "";
+		Emulator synthetic;
+		prepare(synthetic, rom);
+		synthetic.setStepping(stepping);
+		runner.run("frame", "synthetic" + suffix, [&](uint64_t n) {
+			for (uint64_t i = 0; i < n; i++) synthetic.runFrame();
+			sink = synthetic.stateHash();
+		});
+	}
+
+	if (romPath.empty()) return;
+	Emulator game;
+	game.setTracing(false);
+	try {
+		game.loadROM(romPath.c_str());
+	} catch (const std::exception& e) {
+		std::cerr << "[Bench] " << e.what() << std::endl;
+		return;
+	}
+	for (Stepping stepping : { Stepping::Instruction, Stepping::Cycle }) {
+		game.setStepping(stepping);
+		runner.run("frame", romPath + (stepping == Stepping::Cycle ? " (cycle)" : ""), [&](uint64_t n) {
+			for (uint64_t i = 0; i < n; i++) game.runFrame();
+			sink = game.stateHash();
+		});
+	}
+}
+
+// Frames of the game with the picture drawn on a PpuPipeline thread, next
+// to the plain frames above. Both must draw the same frames.
+static void benchPpuPipeline(BenchRunner& runner, const std::string& romPath) {
+	if (romPath.empty()) return;
+	Emulator emulators[2];
+	PpuPipeline pipeline;
+	try {
+		for (Emulator& emu : emulators) {
+			emu.setTracing(false);
+			emu.loadROM(romPath.c_str());
+		}
+	} catch (const std::exception& e) {
+		std::cerr << "[Bench] " << e.what() << std::endl;
+		return;
+	}
+	emulators[1].attachPpuPipeline(&pipeline);
+	runner.run("frame", romPath + " (PPU thread)", [&](uint64_t n) {
+		for (uint64_t i = 0; i < n; i++) emulators[1].runFrame();
+		sink = emulators[1].frameHash();
+	}, 16);
+	const uint64_t frames = std::max(emulators[0].getFrameCount(), emulators[1].getFrameCount());
+	if (frames == 0) return; // Filtered out
+	for (Emulator& emu : emulators) {
+		while (emu.getFrameCount() < frames) emu.runFrame();
+	}
+	if (emulators[0].frameHash() != emulators[1].frameHash() || emulators[0].stateHash() != emulators[1].stateHash()) {
+		std::printf("%-12s the PPU thread drew a different frame\n", "frame");
+		return;
+	}
+	const PpuPipeline::Stats st = pipeline.statistics();
+	std::printf("%-12s PPU thread: waited for %.1f%% of frames, %.1f us on average\n", "frame",
+		100.0 * static_cast<double>(st.waits) / static_cast<double>(st.frames),
+		st.waits ? static_cast<double>(st.waitNs) / 1000.0 / static_cast<double>(st.waits) : 0.0);
+}
+
+// A debugger view of 32 instructions redrawn every frame: formatted again
+// each time, or taken from the disassembler's cache. The uncached run
+// alternates between two copies of the code 4 KiB apart, which share cache
+// slots, so every line misses. One operation is one line.
+static void benchDisassembler(BenchRunner& runner) {
+	TestRom rom;
+	const std::vector<uint8_t> sequence = {
+		0xBD, 0x00, 0x03, // LDA $0300,X
+		0x85, 0x10,       // STA $10
+		0xB1, 0x10,       // LDA ($10),Y
+		0x20, 0x00, 0x90, // JSR $9000
+		0xEA, 0xEA, 0xEA, // NOP
+		0xE8,             // INX
+		0xD0, 0xF0,       // BNE
+	};
+	rom.fill(sequence);
+	Emulator emu;
+	prepare(emu, rom);
+	for (bool cached : { false, true }) {
+		Disassembler disassembler;
+		runner.run("disasm", cached ? "view line, cached" : "view line", [&](uint64_t n) {
+			uint16_t address = 0x8000;
+			size_t length = 0;
+			for (uint64_t i = 0; i < n; i++) {
+				if (i % 32 == 0) address = cached || i % 64 == 0 ? 0x8000 : 0x9000;
+				const Disassembler::Line& line = disassembler.decode(emu, address);
+				length += line.text.size();
+				address = static_cast<uint16_t>(address + line.length);
+			}
+			sink = length;
+		});
+	}
+}
+
+// The PPU alone: 240 lines of scrolled background with 64 sprites, as
+// sprite-heavy games have them, some lines past the eight-sprite limit. The
+// sprite frame copies OAM in first like the usual per-frame DMA. One
+// operation is a frame.
+static void benchPpu(BenchRunner& runner) {
+	std::mt19937 random(43);
+	std::vector<uint8_t> chr(0x2000);
+	for (uint8_t& b : chr) b = static_cast<uint8_t>(random());
+	Ppu ppu;
+	ppu.setCartridge(chr.data(), chr.size(), true, false);
+	ppu.reset();
+	ppu.writeRegister(0x2006, 0x20);
+	ppu.writeRegister(0x2006, 0x00);
+	for (int i = 0; i < 0x800; i++) ppu.writeRegister(0x2007, static_cast<uint8_t>(random()));
+	ppu.writeRegister(0x2006, 0x3F);
+	ppu.writeRegister(0x2006, 0x00);
+	for (int i = 0; i < 32; i++) ppu.writeRegister(0x2007, static_cast<uint8_t>(i * 3));
+	ppu.writeRegister(0x2005, 13);
+	ppu.writeRegister(0x2005, 0);
+
+	std::array<uint8_t, 256> oam;
+	for (int i = 0; i < 64; i++) {
+		oam[i * 4] = static_cast<uint8_t>(i < 12 ? 100 : random() % 232);
+		oam[i * 4 + 1] = static_cast<uint8_t>(random());
+		oam[i * 4 + 2] = static_cast<uint8_t>(random() & 0xE3);
+		oam[i * 4 + 3] = static_cast<uint8_t>(random());
+	}
+	std::vector<uint8_t> frame(static_cast<size_t>(Ppu::kWidth) * Ppu::kHeight);
+	auto renderFrame = [&] {
+		ppu.startFrame();
+		for (int line = 0; line < Ppu::kHeight; line++) ppu.renderScanline(line, &frame[static_cast<size_t>(line) * Ppu::kWidth]);
+	};
+
+	ppu.writeRegister(0x2001, 0x0E);
+	runner.run("ppu", "background frame", [&](uint64_t n) {
+		for (uint64_t i = 0; i < n; i++) renderFrame();
+		sink = frame[1000];
+	}, 16);
+	for (bool tall : { false, true }) {
+		ppu.writeRegister(0x2000, tall ? 0x20 : 0x00);
+		ppu.writeRegister(0x2001, 0x1E);
+		runner.run("ppu", tall ? "64 sprites frame (8x16)" : "64 sprites frame", [&](uint64_t n) {
+			for (uint64_t i = 0; i < n; i++) {
+				ppu.writeRegister(0x2003, 0);
+				for (uint8_t b : oam) ppu.writeOam(b);
+				renderFrame();
+			}
+			sink = frame[1000];
+		}, 16);
+	}
+}
+
+// The ROM given with --rom, or a small game loop: read the controller and
+// count the pressed buttons, clear and sum a page, wait for VBlank.
+static std::vector<uint8_t> lockstepRom(const std::string& romPath) {
+	if (!romPath.empty()) {
+		std::ifstream file(romPath, std::ios::binary);
+		std::vector<uint8_t> image((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		if (image.empty()) std::cerr << "[Bench] Failed to read " << romPath << std::endl;
+		return image;
+	}
+	TestRom rom;
+	const uint8_t program[] = {
+		0xA9, 0x01, 0x8D, 0x16, 0x40,             // LDA #1 / STA $4016
+		0xA9, 0x00, 0x8D, 0x16, 0x40,             // LDA #0 / STA $4016
+		0xA2, 0x00,                               // LDX #0
+		0xAD, 0x16, 0x40, 0x29, 0x01, 0xF0, 0x03, // read: LDA $4016 / AND #1 / BEQ +3
+		0xFE, 0x00, 0x04,                         //   INC $0400,X
+		0xE8, 0xE0, 0x08, 0xD0, 0xF1,             //   INX / CPX #8 / BNE read
+		0xA2, 0x00,                               // LDX #0
+		0x9D, 0x00, 0x03, 0xE8, 0xD0, 0xFA,       // clr: STA $0300,X / INX / BNE clr
+		0xA0, 0x20,                               // LDY #$20
+		0x79, 0x00, 0x03, 0x88, 0xD0, 0xFA,       // sum: ADC $0300,Y / DEY / BNE sum
+		0x2C, 0x02, 0x20, 0x10, 0xFB,             // wait: BIT $2002 / BPL wait
+		0x4C, 0x00, 0x80,                         // JMP $8000
+	};
+	std::memcpy(&rom.at(0x8000), program, sizeof(program));
+	rom.setVector(0xFFFC, 0x8000);
+	return rom.image;
+}
+
+// Whole frames of a game loop that waits for VBlank, with idle loops run
+// and skipped. Both must end in the same state.
+static void benchIdleSkip(BenchRunner& runner, const std::vector<uint8_t>& image) {
+	Emulator emulators[2];
+	for (bool skip : { false, true }) {
+		Emulator& emu = emulators[skip];
+		emu.setTracing(false);
+		emu.setIdleSkip(skip);
+		emu.loadROM(image);
+		runner.run("frame", skip ? "idle loops skipped" : "idle loops run", [&](uint64_t n) {
+			for (uint64_t i = 0; i < n; i++) emu.runFrame();
+			sink = emu.stateHash();
+		}, 16);
+	}
+	const uint64_t frames = std::max(emulators[0].getFrameCount(), emulators[1].getFrameCount());
+	if (frames == 0) return; // Filtered out
+	for (Emulator& emu : emulators) {
+		while (emu.getFrameCount() < frames) emu.runFrame();
+	}
+	if (emulators[0].stateHash() != emulators[1].stateHash()) {
+		std::printf("%-12s skipping idle loops changed the result\n", "frame");
+		return;
+	}
+	const Emulator::IdleSkipStats& idle = emulators[1].idleSkipStatistics();
+	std::printf("%-12s %.1f%% of cycles skipped in idle loops\n", "frame",
+		100.0 * static_cast<double>(idle.cycles) / static_cast<double>(emulators[1].getCycleCount()));
+}
+
+// Many consoles of one game from the same state, each with its own inputs:
+// N Emulator objects against LockstepCore<N>, run lane by lane and in
+// lockstep. One operation is a frame of every instance.
+template <size_t N> static void benchLockstep(BenchRunner& runner, const std::vector<uint8_t>& image) {
+	Emulator start;
+	start.setTracing(false);
+	start.loadROM(image);
+	start.runFrame();
+	Emulator::State state;
+	start.saveState(state);
+
+	// Held buttons that change every few frames, different for each instance.
+	std::mt19937 random(N);
+	std::vector<std::array<uint8_t, N>> inputs(64);
+	for (size_t f = 0; f < inputs.size(); f++) {
+		for (size_t i = 0; i < N; i++)
+			inputs[f][i] = f % 8 == 0 ? static_cast<uint8_t>(random()) : inputs[f - 1][i];
+	}
+
+	std::vector<Emulator> emulators(N);
+	for (Emulator& emu : emulators) {
+		emu.setTracing(false);
+		emu.loadROM(image);
+		emu.loadState(state);
+	}
+	const std::string n = std::to_string(N);
+	bool measured = false;
+	// Emulator skips idle loops by default and LockstepCore does not, so
+	// both are shown.
+	for (bool skip : { true, false }) {
+		for (Emulator& emu : emulators) {
+			emu.setIdleSkip(skip);
+			emu.loadState(state);
+		}
+		uint64_t frame = 0;
+		measured |= runner.run("lockstep", n + (skip ? " emulators" : " emulators, idle loops run"), [&](uint64_t count) {
+			for (uint64_t k = 0; k < count; k++, frame++) {
+				for (size_t i = 0; i < N; i++) {
+					emulators[i].setInput(inputs[frame % inputs.size()][i], 0);
+					emulators[i].runFrame();
+				}
+			}
+			sink = emulators[0].stateHash();
+		}, 1);
+	}
+
+	auto runLanes = [&](LockstepCore<N>& core, uint64_t count) {
+		for (uint64_t k = 0; k < count; k++) {
+			const auto& frameInputs = inputs[core.getFrameCount() % inputs.size()];
+			for (size_t i = 0; i < N; i++) core.setInput(i, frameInputs[i], 0);
+			core.runFrame();
+		}
+	};
+	for (bool lockstep : { false, true }) {
+		auto core = std::make_unique<LockstepCore<N>>(image);
+		core->loadState(state);
+		core->setLockstep(lockstep);
+		measured |= runner.run("lockstep", n + (lockstep ? " lanes, lockstep" : " lanes, one at a time"),
+			[&](uint64_t count) {
+				runLanes(*core, count);
+				sink = core->laneHash(0);
+			}, 1);
+		if (lockstep && measured) {
+			const LockstepStats& st = core->statistics();
+			std::printf("%-12s %-28s %.2f lanes per decoded instruction, %.1f%% of instructions on the scalar path\n",
+				"lockstep", (n + " lanes").c_str(),
+				static_cast<double>(st.laneInstructions) / static_cast<double>(st.groupSteps + st.scalarSteps),
+				100.0 * static_cast<double>(st.scalarSteps) / static_cast<double>(st.laneInstructions));
+		}
+	}
+	if (!measured) return;
+
+	// Both lane modes must end in the same state for every lane.
+	auto scalar = std::make_unique<LockstepCore<N>>(image);
+	auto vector = std::make_unique<LockstepCore<N>>(image);
+	scalar->loadState(state);
+	vector->loadState(state);
+	scalar->setLockstep(false);
+	runLanes(*scalar, 120);
+	runLanes(*vector, 120);
+	for (size_t i = 0; i < N; i++) {
+		if (scalar->laneHash(i) != vector->laneHash(i)) {
+			std::printf("%-12s lane %zu differs between the lockstep and scalar runs\n", "lockstep", i);
+			return;
+		}
+	}
+
+	// And the same state as an Emulator given the same inputs.
+	for (size_t i = 0; i < N; i++) {
+		Emulator& emu = emulators[i];
+		emu.loadState(state);
+		while (emu.getFrameCount() < vector->getFrameCount()) {
+			emu.setInput(inputs[emu.getFrameCount() % inputs.size()][i], 0);
+			emu.runFrame();
+		}
+		const CpuRegisters r = emu.registers();
+		const CpuRegisters l = vector->registers(i);
+		bool same = r.pc == l.pc && r.a == l.a && r.x == l.x && r.y == l.y && r.sp == l.sp
+			&& ((r.p & 0xCF) | 0x20) == l.p && r.cycles == l.cycles && emu.isHalted() == vector->isHalted(i);
+		for (uint16_t addr = 0; same && addr < 0x0800; addr++) same = emu.ramData()[addr] == vector->peekRam(i, addr);
+		if (!same) {
+			std::printf("%-12s lane %zu differs from an Emulator run\n", "lockstep", i);
+			return;
+		}
+	}
+
+	std::printf("%-12s aggregate frames/s:", "lockstep");
+	for (const BenchResult& r : runner.results) {
+		if (r.group == "lockstep" && r.name.rfind(n + " ", 0) == 0)
+			std::printf("  %s %.0f", r.name.c_str(), static_cast<double>(N) * 1e9 / r.median);
+	}
+	std::printf("\n");
+}
+
+// Names include the --rom path, which may hold any character.
+static std::string jsonEscape(const std::string& text) {
+	std::string out;
+	for (char c : text) {
+		if (c == '"' || c == '\\') {
+			out += '\\';
+			out += c;
+		} else if (static_cast<unsigned char>(c) < 0x20) {
+			char escape[8];
+			std::snprintf(escape, sizeof(escape), "\\u%04x", static_cast<unsigned>(c));
+			out += escape;
+		} else {
+			out += c;
+		}
+	}
+	return out;
+}
+
+static void writeJson(const std::vector<BenchResult>& results, const std::string& path) {
+	std::ofstream out(path);
+	out << "{\n  \"benchmarks\": [\n";
+	for (size_t i = 0; i < results.size(); i++) {
+		const BenchResult& r = results[i];
+		char numbers[256];
+		std::snprintf(numbers, sizeof(numbers),
+			"\"ns_per_op\": %.3f, \"mean\": %.3f, \"stddev\": %.3f, \"min\": %.3f, \"iterations\": %llu}%s\n",
+			r.median, r.mean, r.stddev, r.min, static_cast<unsigned long long>(r.iterations),
+			i + 1 < results.size() ? "," : "");
+		out << "    {\"group\": \"" << jsonEscape(r.group) << "\", \"name\": \"" << jsonEscape(r.name) << "\", "
+			<< numbers;
+	}
+	out << "  ]\n}\n";
+}
+
+// Reads back files written by writeJson: one benchmark per line.
+static std::map<std::string, double> readJson(const std::string& path) {
+	std::map<std::string, double> values;
+	std::ifstream in(path);
+	std::string line;
+	auto field = [&](const std::string& key) -> std::string {
+		size_t pos = line.find("\"" + key + "\": ");
+		if (pos == std::string::npos) return {};
+		pos += key.size() + 4;
+		if (line[pos] != '"') return line.substr(pos, line.find_first_of(",}", pos) - pos);
+		std::string text;
+		for (pos++; pos < line.size() && line[pos] != '"'; pos++) {
+			if (line[pos] != '\\' || pos + 1 >= line.size()) {
+				text += line[pos];
+			} else if (line[++pos] == 'u') {
+				text += static_cast<char>(std::strtoul(line.substr(pos + 1, 4).c_str(), nullptr, 16));
+				pos += 4;
+			} else {
+				text += line[pos];
+			}
+		}
+		return text;
+	};
+	while (std::getline(in, line)) {
+		std::string group = field("group");
+		std::string name = field("name");
+		std::string value = field("ns_per_op");
+		if (!name.empty() && !value.empty()) values[group + "/" + name] = std::atof(value.c_str());
+	}
+	return values;
+}
+
+int main(int argc, char** argv) {
+	BenchRunner runner;
+	std::string romPath;
+	std::string jsonPath;
+	std::string comparePath;
+	for (int i = 1; i + 1 < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--filter") {
+			runner.filter = argv[++i];
+		} else if (arg == "--samples") {
+			runner.samples = std::max(1, std::atoi(argv[++i]));
+		} else if (arg == "--min-time") {
+			runner.minSampleSeconds = std::atof(argv[++i]) / 1000.0;
+		} else if (arg == "--rom") {
+			romPath = argv[++i];
+		} else if (arg == "--json") {
+			jsonPath = argv[++i];
+		} else if (arg == "--compare") {
+			comparePath = argv[++i];
+		}
+	}
+
+	benchOpcodes(runner);
+	benchAddressing(runner);
+	benchBus(runner);
+	benchFrames(runner, romPath);
+	benchPpuPipeline(runner, romPath);
+	benchPpu(runner);
+	benchDisassembler(runner);
+
+	std::vector<uint8_t> lockstepImage = lockstepRom(romPath);
+	if (!lockstepImage.empty()) {
+		benchIdleSkip(runner, lockstepImage);
+		benchLockstep<8>(runner, lockstepImage);
+		benchLockstep<32>(runner, lockstepImage);
+	}
+
+	if (!jsonPath.empty()) {
+		writeJson(runner.results, jsonPath);
+	}
+
+	if (!comparePath.empty()) {
+		std::map<std::string, double> baseline = readJson(comparePath);
+		std::printf("\n%-42s %10s %10s %8s\n", "benchmark", "before", "after", "change");
+		for (const BenchResult& r : runner.results) {
+			auto it = baseline.find(r.group + "/" + r.name);
+			if (it == baseline.end() || it->second <= 0) continue;
+			double change = 100.0 * (r.median - it->second) / it->second;
+			std::printf("%-42s %10.2f %10.2f %+7.1f%%\n", (r.group + "/" + r.name).c_str(), it->second, r.median, change);
+		}
+	}
+	return 0;
+}
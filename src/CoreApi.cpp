@@ -0,0 +1,257 @@
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "Emulator.hpp"
+#include "NESEmuCore.h"
+
+struct nesemu_instance {
+	Emulator emu;
+	std::unique_ptr<CodeDataLogger> cdl;
+};
+
+namespace {
+
+thread_local std::string lastError;
+
+static_assert(std::is_trivially_copyable_v<Emulator::State>, "save states are copied as bytes");
+
+// A save state blob: the ROM it belongs to, then the state itself.
+struct StateBlob {
+	uint64_t romHash;
+	Emulator::State state;
+};
+
+uint32_t stepFrames(Emulator& emu, uint32_t frames, const uint8_t* inputs) {
+	uint32_t done = 0;
+	for (; done < frames && !emu.isHalted(); done++) {
+		if (inputs) emu.setInput(inputs[2 * done], inputs[2 * done + 1]);
+		emu.runFrame();
+	}
+	return done;
+}
+
+// Threads that live as long as the library, so a batch call costs a wake-up
+// rather than thread creation. The calling thread works too.
+class BatchPool {
+public:
+	static BatchPool& instance() {
+		static BatchPool pool;
+		return pool;
+	}
+
+	~BatchPool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (std::thread& t : workers) t.join();
+	}
+
+	void run(nesemu_instance* const* instances, size_t count, uint32_t frames, const uint8_t* inputs, unsigned threads) {
+		std::lock_guard<std::mutex> serial(callMutex);
+		unsigned helpers = std::min<size_t>(threads - 1, count > 0 ? count - 1 : 0);
+		ensureWorkers(helpers);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			job = { instances, count, frames, inputs };
+			next = 0;
+			seats = helpers;
+			busy = helpers;
+			generation++;
+		}
+		wake.notify_all();
+		work();
+		std::unique_lock<std::mutex> lock(mutex);
+		finished.wait(lock, [this] { return busy == 0; });
+	}
+
+private:
+	struct Job {
+		nesemu_instance* const* instances = nullptr;
+		size_t count = 0;
+		uint32_t frames = 0;
+		const uint8_t* inputs = nullptr;
+	};
+
+	void ensureWorkers(unsigned wanted) {
+		while (workers.size() < wanted) workers.emplace_back([this] { loop(); });
+	}
+
+	void loop() {
+		uint64_t seen = 0;
+		std::unique_lock<std::mutex> lock(mutex);
+		for (;;) {
+			wake.wait(lock, [&] { return stopping || generation != seen; });
+			if (stopping) return;
+			seen = generation;
+			// Only the requested number of threads join a batch.
+			if (seats == 0) continue;
+			seats--;
+			lock.unlock();
+			work();
+			lock.lock();
+			if (--busy == 0) finished.notify_one();
+		}
+	}
+
+	void work() {
+		for (size_t i = next++; i < job.count; i = next++) {
+			const uint8_t* inputs = job.inputs ? job.inputs + i * job.frames * 2 : nullptr;
+			stepFrames(job.instances[i]->emu, job.frames, inputs);
+		}
+	}
+
+	std::mutex callMutex;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable finished;
+	std::vector<std::thread> workers;
+	Job job;
+	std::atomic<size_t> next{ 0 };
+	uint64_t generation = 0;
+	unsigned seats = 0;
+	unsigned busy = 0;
+	bool stopping = false;
+};
+
+}
+
+extern "C" {
+
+nesemu_instance* nesemu_create(const uint8_t* rom, size_t size) {
+	try {
+		auto* instance = new nesemu_instance;
+		instance->emu.setTracing(false);
+		try {
+			instance->emu.loadROM(std::vector<uint8_t>(rom, rom + size));
+		} catch (...) {
+			delete instance;
+			throw;
+		}
+		return instance;
+	} catch (const std::exception& e) {
+		lastError = e.what();
+		return nullptr;
+	}
+}
+
+void nesemu_destroy(nesemu_instance* instance) {
+	delete instance;
+}
+
+const char* nesemu_last_error(void) {
+	return lastError.c_str();
+}
+
+uint32_t nesemu_step_frames(nesemu_instance* instance, uint32_t frames, const uint8_t* inputs) {
+	return stepFrames(instance->emu, frames, inputs);
+}
+
+void nesemu_step_batch(nesemu_instance* const* instances, size_t count, uint32_t frames, const uint8_t* inputs, unsigned threads) {
+	if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+	if (threads == 1 || count <= 1) {
+		for (size_t i = 0; i < count; i++) {
+			stepFrames(instances[i]->emu, frames, inputs ? inputs + i * frames * 2 : nullptr);
+		}
+		return;
+	}
+	BatchPool::instance().run(instances, count, frames, inputs, threads);
+}
+
+uint8_t* nesemu_ram(nesemu_instance* instance) {
+	return instance->emu.ramData();
+}
+
+const uint8_t* nesemu_framebuffer(const nesemu_instance* instance) {
+	return instance->emu.getFrameBuffer();
+}
+
+const uint32_t* nesemu_palette(void) {
+	return kNesPalette;
+}
+
+uint64_t nesemu_frame_count(const nesemu_instance* instance) {
+	return instance->emu.getFrameCount();
+}
+
+int nesemu_halted(const nesemu_instance* instance) {
+	return instance->emu.isHalted() ? 1 : 0;
+}
+
+size_t nesemu_state_size(void) {
+	return sizeof(StateBlob);
+}
+
+void nesemu_save_state(const nesemu_instance* instance, void* buffer) {
+	auto* blob = static_cast<StateBlob*>(buffer);
+	blob->romHash = instance->emu.getRomHash();
+	instance->emu.saveState(blob->state);
+}
+
+int nesemu_load_state(nesemu_instance* instance, const void* buffer) {
+	StateBlob blob;
+	std::memcpy(&blob, buffer, sizeof(blob));
+	if (blob.romHash != instance->emu.getRomHash()) {
+		lastError = "The state was saved with another ROM.";
+		return 0;
+	}
+	instance->emu.loadState(blob.state);
+	return 1;
+}
+
+void nesemu_cdl_enable(nesemu_instance* instance, int enabled) {
+	if (enabled && !instance->cdl) {
+		instance->cdl = std::make_unique<CodeDataLogger>();
+		instance->emu.attachCodeDataLogger(instance->cdl.get());
+	} else if (!enabled && instance->cdl) {
+		instance->emu.attachCodeDataLogger(nullptr);
+		instance->cdl.reset();
+	}
+}
+
+const uint8_t* nesemu_cdl(const nesemu_instance* instance, size_t* size) {
+	if (!instance->cdl) {
+		*size = 0;
+		return nullptr;
+	}
+	*size = instance->cdl->prgFlags().size();
+	return instance->cdl->prgFlags().data();
+}
+
+int nesemu_cdl_save(nesemu_instance* const* instances, size_t count, const char* path) {
+	try {
+		CodeDataLogger merged;
+		bool first = true;
+		for (size_t i = 0; i < count; i++) {
+			if (!instances[i]->cdl) continue;
+			if (first) {
+				merged = *instances[i]->cdl;
+				first = false;
+			} else {
+				merged.merge(*instances[i]->cdl);
+			}
+		}
+		if (first) {
+			lastError = "Code/data logging is not enabled.";
+			return 0;
+		}
+		merged.mergeFile(path);
+		merged.save(path);
+		return 1;
+	} catch (const std::exception& e) {
+		lastError = e.what();
+		return 0;
+	}
+}
+
+}
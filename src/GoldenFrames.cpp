@@ -0,0 +1,192 @@
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Emulator.hpp"
+#include "Movie.hpp"
+
+// Golden-frame regression check: runs ROMs headless and compares the hash of
+// every frame's picture with a stored list.
+//
+//   nesemu-golden [--write] [--frames <n>] [--movie <file>] [--jobs <n>]
+//                 [--golden-dir <dir>] <rom>...
+//
+// Each ROM's list is <rom>.golden, or <dir>/<rom file name>.golden, with one
+// "<frame> <hash>" line per frame. --write records the first <n> frames (600
+// by default, or the length of the movie). Without it the lists are checked.
+// The first mismatching frame of each ROM is written next to its list as a
+// PPM image. ROMs run in parallel, one per thread.
+
+struct Options {
+	bool write = false;
+	uint32_t frames = 600;
+	bool framesGiven = false;
+	std::string moviePath;
+	std::string goldenDir;
+	unsigned jobs = 0;
+};
+
+struct Result {
+	bool ok = false;
+	std::string message;
+};
+
+static std::string goldenPath(const Options& options, const std::string& romPath) {
+	if (options.goldenDir.empty()) return romPath + ".golden";
+	size_t slash = romPath.find_last_of("/\\");
+	return options.goldenDir + "/" + (slash == std::string::npos ? romPath : romPath.substr(slash + 1)) + ".golden";
+}
+
+static std::map<uint32_t, uint64_t> readGolden(const std::string& path) {
+	std::ifstream in(path);
+	if (!in) throw std::runtime_error("No golden list at " + path + ", run with --write first.");
+	std::map<uint32_t, uint64_t> hashes;
+	std::string line;
+	while (std::getline(in, line)) {
+		if (line.empty() || line[0] == '#') continue;
+		std::istringstream fields(line);
+		uint32_t frame;
+		std::string hash;
+		if (fields >> frame >> hash) hashes[frame] = std::strtoull(hash.c_str(), nullptr, 16);
+	}
+	return hashes;
+}
+
+static void dumpFrame(const Emulator& emu, const std::string& path) {
+	std::ofstream out(path, std::ios::binary);
+	out << "P6\n" << Ppu::kWidth << " " << Ppu::kHeight << "\n255\n";
+	const uint8_t* indices = emu.getFrameBuffer();
+	for (int i = 0; i < Ppu::kWidth * Ppu::kHeight; i++) {
+		uint32_t rgb = kNesPalette[indices[i] & 0x3F];
+		const char pixel[] = { static_cast<char>(rgb >> 16), static_cast<char>(rgb >> 8), static_cast<char>(rgb) };
+		out.write(pixel, 3);
+	}
+}
+
+static Result runRom(const Options& options, const Movie* movie, const std::string& romPath) {
+	Result result;
+	try {
+		Emulator emu;
+		emu.setTracing(false);
+		emu.loadROM(romPath.c_str());
+
+		const std::string listPath = goldenPath(options, romPath);
+		uint32_t frames = options.frames;
+		if (movie && !options.framesGiven) frames = static_cast<uint32_t>(movie->frames.size());
+
+		std::map<uint32_t, uint64_t> expected;
+		if (!options.write) {
+			expected = readGolden(listPath);
+			frames = expected.empty() ? 0 : expected.rbegin()->first + 1;
+		}
+
+		std::ostringstream written;
+		uint32_t mismatches = 0;
+		std::string firstMismatch;
+		for (uint32_t f = 0; f < frames && !emu.isHalted(); f++) {
+			if (movie && f < movie->frames.size()) emu.setInput(movie->frames[f].port1, movie->frames[f].port2);
+			emu.runFrame();
+			const uint64_t hash = emu.frameHash();
+			if (options.write) {
+				char line[40];
+				std::snprintf(line, sizeof(line), "%u %016" PRIx64 "\n", f, hash);
+				written << line;
+				continue;
+			}
+			auto it = expected.find(f);
+			if (it == expected.end() || it->second == hash) continue;
+			if (mismatches++ == 0) {
+				firstMismatch = listPath + "." + std::to_string(f) + ".ppm";
+				dumpFrame(emu, firstMismatch);
+				result.message = "frame " + std::to_string(f) + " differs, written to " + firstMismatch;
+			}
+		}
+
+		if (options.write) {
+			std::ofstream out(listPath);
+			if (!out) throw std::runtime_error("Failed to write " + listPath + ".");
+			out << written.str();
+			result.ok = true;
+			result.message = std::to_string(frames) + " frames written to " + listPath;
+		} else if (mismatches == 0) {
+			result.ok = true;
+			result.message = std::to_string(expected.size()) + " frames match";
+		} else {
+			result.message += " (" + std::to_string(mismatches) + " of " + std::to_string(expected.size()) + " frames differ)";
+		}
+	} catch (const std::exception& e) {
+		result.message = e.what();
+	}
+	return result;
+}
+
+int main(int argc, char** argv) {
+	Options options;
+	std::vector<std::string> roms;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--write") {
+			options.write = true;
+		} else if (arg == "--frames" && i + 1 < argc) {
+			options.frames = static_cast<uint32_t>(std::max(1, std::atoi(argv[++i])));
+			options.framesGiven = true;
+		} else if (arg == "--movie" && i + 1 < argc) {
+			options.moviePath = argv[++i];
+		} else if (arg == "--golden-dir" && i + 1 < argc) {
+			options.goldenDir = argv[++i];
+		} else if (arg == "--jobs" && i + 1 < argc) {
+			options.jobs = static_cast<unsigned>(std::max(1, std::atoi(argv[++i])));
+		} else {
+			roms.push_back(arg);
+		}
+	}
+	if (roms.empty()) {
+		std::cerr << "usage: nesemu-golden [--write] [--frames <n>] [--movie <file>] [--jobs <n>] "
+			"[--golden-dir <dir>] <rom>..." << std::endl;
+		return 2;
+	}
+
+	Movie movie;
+	if (!options.moviePath.empty()) {
+		try {
+			movie = Movie::load(options.moviePath.c_str());
+		} catch (const std::exception& e) {
+			std::cerr << "[Golden] " << e.what() << std::endl;
+			return 1;
+		}
+	}
+	const Movie* moviePtr = options.moviePath.empty() ? nullptr : &movie;
+
+	unsigned jobs = options.jobs ? options.jobs : std::max(1u, std::thread::hardware_concurrency());
+	jobs = static_cast<unsigned>(std::min<size_t>(jobs, roms.size()));
+
+	std::atomic<size_t> next{ 0 };
+	std::atomic<size_t> failures{ 0 };
+	std::mutex printMutex;
+	auto worker = [&] {
+		for (size_t i = next++; i < roms.size(); i = next++) {
+			Result result = runRom(options, moviePtr, roms[i]);
+			if (!result.ok) failures++;
+			std::lock_guard<std::mutex> lock(printMutex);
+			std::cout << "[Golden] " << (result.ok ? "ok   " : "FAIL ") << roms[i] << ": " << result.message << std::endl;
+		}
+	};
+	std::vector<std::thread> threads;
+	for (unsigned t = 1; t < jobs; t++) threads.emplace_back(worker);
+	worker();
+	for (std::thread& t : threads) t.join();
+
+	std::cout << "[Golden] " << roms.size() - failures << " of " << roms.size() << " ROMs passed." << std::endl;
+	return failures == 0 ? 0 : 1;
+}
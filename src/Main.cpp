@@ -1,12 +1,25 @@
 #include <SDL3/SDL.h>
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
 #include <vector>
 #include <functional>
+#include "Capture.hpp"
+#include "DebugConsole.hpp"
 #include "Emulator.hpp"
+#include "Movie.hpp"
+#include "Netplay.hpp"
+#include "RomLibrary.hpp"
 
 constexpr int NES_WIDTH = 256;
 constexpr int NES_HEIGHT = 240;
 constexpr int MENU_HEIGHT = 32;
+constexpr double NES_FPS = 60.0988;
 
 class FrameBuffer {
 public:
@@ -25,10 +38,33 @@ public:
 				pixels[y * NES_WIDTH + x] = ((x ^ y) & 0x10) ? 0xFF808080 : 0xFF202020;
 			}
 		}
+		converted = false;
+		stale = true;
 	}
 
+	// Converts a frame of NES colour indices to the texture's RGBA. A frame
+	// with the same hash as the last one is skipped; returns whether the
+	// picture changed.
+	bool update(const uint8_t* indices, uint64_t hash) {
+		if (converted && hash == convertedHash) return false;
+		for (int i = 0; i < NES_WIDTH * NES_HEIGHT; i++) {
+			uint32_t rgb = kNesPalette[indices[i] & 0x3F];
+			pixels[i] = 0xFF000000 | (rgb & 0xFF) << 16 | (rgb & 0xFF00) | rgb >> 16;
+		}
+		convertedHash = hash;
+		converted = true;
+		stale = true;
+		return true;
+	}
+
+	// The texture must be uploaded again, e.g. after the render device was reset.
+	void invalidate() { stale = true; }
+
 	void render(int x, int y, int width, int height) {
-		SDL_UpdateTexture(texture, nullptr, pixels.data(), NES_WIDTH * sizeof(Uint32));
+		if (stale) {
+			SDL_UpdateTexture(texture, nullptr, pixels.data(), NES_WIDTH * sizeof(Uint32));
+			stale = false;
+		}
 		SDL_FRect dst = { (float)x, (float)y, (float)width, (float)height };
 		SDL_RenderTexture(renderer, texture, nullptr, &dst);
 	}
@@ -39,6 +75,336 @@ private:
 	SDL_Renderer* renderer = nullptr;
 	SDL_Texture* texture = nullptr;
 	std::vector<Uint32> pixels;
+	uint64_t convertedHash = 0;
+	bool converted = false;
+	bool stale = true; // The pixels are newer than the texture
+};
+
+// Maps the keyboard and up to two gamepads to the standard controllers and
+// publishes every change to the emulator.
+//   Keyboard (port 1): X = A, Z = B, Right Shift = Select, Enter = Start,
+//   arrows = D-pad. Gamepads take ports in the order they are connected.
+class ControllerMapper {
+public:
+	explicit ControllerMapper(InputState& state) : state(state) {}
+
+	~ControllerMapper() {
+		for (Pad& pad : pads) {
+			if (pad.gamepad) SDL_CloseGamepad(pad.gamepad);
+		}
+	}
+
+	// Returns true when the event was controller input.
+	bool handleEvent(const SDL_Event& e) {
+		switch (e.type) {
+		case SDL_EVENT_KEY_DOWN:
+		case SDL_EVENT_KEY_UP: {
+			uint8_t bit = keyBit(e.key.key);
+			if (!bit || e.key.repeat) return bit != 0;
+			setBit(keyboard, bit, e.type == SDL_EVENT_KEY_DOWN);
+			publish(e.key.timestamp);
+			return true;
+		}
+		case SDL_EVENT_GAMEPAD_ADDED:
+			for (Pad& pad : pads) {
+				if (!pad.gamepad) {
+					pad.gamepad = SDL_OpenGamepad(e.gdevice.which);
+					pad.id = e.gdevice.which;
+					pad.buttons = 0;
+					break;
+				}
+			}
+			return true;
+		case SDL_EVENT_GAMEPAD_REMOVED:
+			for (Pad& pad : pads) {
+				if (pad.gamepad && pad.id == e.gdevice.which) {
+					SDL_CloseGamepad(pad.gamepad);
+					pad = Pad{};
+				}
+			}
+			publish(e.gdevice.timestamp);
+			return true;
+		case SDL_EVENT_GAMEPAD_BUTTON_DOWN:
+		case SDL_EVENT_GAMEPAD_BUTTON_UP:
+			for (Pad& pad : pads) {
+				if (pad.gamepad && pad.id == e.gbutton.which) {
+					setBit(pad.buttons, buttonBit(e.gbutton.button), e.gbutton.down);
+				}
+			}
+			publish(e.gbutton.timestamp);
+			return true;
+		default:
+			return false;
+		}
+	}
+
+private:
+	struct Pad {
+		SDL_Gamepad* gamepad = nullptr;
+		SDL_JoystickID id = 0;
+		uint8_t buttons = 0;
+	};
+
+	static uint8_t keyBit(SDL_Keycode key) {
+		switch (key) {
+		case SDLK_X: return 0x01;
+		case SDLK_Z: return 0x02;
+		case SDLK_RSHIFT: return 0x04;
+		case SDLK_RETURN: return 0x08;
+		case SDLK_UP: return 0x10;
+		case SDLK_DOWN: return 0x20;
+		case SDLK_LEFT: return 0x40;
+		case SDLK_RIGHT: return 0x80;
+		default: return 0;
+		}
+	}
+
+	// Follows the NES pad's layout: A on the right, B on the left.
+	static uint8_t buttonBit(Uint8 button) {
+		switch (button) {
+		case SDL_GAMEPAD_BUTTON_EAST: return 0x01;
+		case SDL_GAMEPAD_BUTTON_SOUTH: return 0x02;
+		case SDL_GAMEPAD_BUTTON_BACK: return 0x04;
+		case SDL_GAMEPAD_BUTTON_START: return 0x08;
+		case SDL_GAMEPAD_BUTTON_DPAD_UP: return 0x10;
+		case SDL_GAMEPAD_BUTTON_DPAD_DOWN: return 0x20;
+		case SDL_GAMEPAD_BUTTON_DPAD_LEFT: return 0x40;
+		case SDL_GAMEPAD_BUTTON_DPAD_RIGHT: return 0x80;
+		default: return 0;
+		}
+	}
+
+	static void setBit(uint8_t& buttons, uint8_t bit, bool down) {
+		buttons = down ? (buttons | bit) : (buttons & ~bit);
+	}
+
+	void publish(Uint64 timestampNs) {
+		state.publish(keyboard | pads[0].buttons, pads[1].buttons, timestampNs / 1000);
+	}
+
+	InputState& state;
+	uint8_t keyboard = 0;
+	Pad pads[2];
+};
+
+// ROM list shown in place of the game while open. Directory scans run on a
+// worker thread and report back with an SDL user event.
+class LibraryView {
+public:
+	static constexpr int ROW_HEIGHT = 12;
+
+	LibraryView(SDL_Renderer* renderer, std::string cachePath) : renderer(renderer), cachePath(std::move(cachePath)) {}
+
+	~LibraryView() {
+		if (worker.joinable()) worker.join();
+	}
+
+	bool scanning() const { return worker.joinable(); }
+
+	void startScan(std::string directory) {
+		if (scanning()) return;
+		worker = std::thread([this, directory] {
+			RomLibrary library(cachePath);
+			library.scan({ directory });
+			scanned = library.entries();
+			SDL_Log("Library: %zu ROMs, %zu hashed, %zu from cache", scanned.size(), library.hashedCount, library.reusedCount);
+
+			SDL_Event ev;
+			SDL_memset(&ev, 0, sizeof(ev));
+			ev.type = SDL_EVENT_USER;
+			ev.user.code = 3;
+			SDL_PushEvent(&ev);
+		});
+	}
+
+	// Called on the main thread once the worker posted its event.
+	void finishScan() {
+		if (worker.joinable()) worker.join();
+		entries = std::move(scanned);
+		scanned.clear();
+		firstRow = 0;
+		visible = true;
+	}
+
+	void scroll(int rows) {
+		firstRow = std::clamp(firstRow + rows, 0, std::max(0, static_cast<int>(entries.size()) - 1));
+	}
+
+	void render(int x, int y, int width, int height) const {
+		SDL_FRect area{ (float)x, (float)y, (float)width, (float)height };
+		SDL_SetRenderDrawColor(renderer, 16, 16, 24, 255);
+		SDL_RenderFillRect(renderer, &area);
+		SDL_SetRenderDrawColor(renderer, 220, 220, 220, 255);
+
+		if (entries.empty()) {
+			SDL_RenderDebugText(renderer, (float)x + 8, (float)y + 8, "No ROM found.");
+			return;
+		}
+
+		const size_t columns = static_cast<size_t>(std::max(1, (width - 16) / 8));
+		for (int row = 0; row * ROW_HEIGHT < height - ROW_HEIGHT; row++) {
+			size_t i = static_cast<size_t>(firstRow + row);
+			if (i >= entries.size()) break;
+			const RomEntry& e = entries[i];
+			char line[256];
+			if (e.header.valid) {
+				SDL_snprintf(line, sizeof(line), "%-32.32s  mapper %3u  PRG %4uK  CHR %4uK  %-5s  %08X",
+					e.name().c_str(), e.header.mapper, e.header.prgSize / 1024, e.header.chrSize / 1024,
+					RomHeader::regionName(e.header.region), e.crc32);
+			} else {
+				SDL_snprintf(line, sizeof(line), "%-32.32s  (not an iNES file)", e.name().c_str());
+			}
+			std::string text(line);
+			if (text.size() > columns) text.resize(columns);
+			SDL_RenderDebugText(renderer, (float)x + 8, (float)(y + 4 + row * ROW_HEIGHT), text.c_str());
+		}
+	}
+
+	const RomEntry* entryAt(int y, int top) const {
+		int row = (y - top - 4) / ROW_HEIGHT;
+		size_t i = static_cast<size_t>(firstRow + row);
+		if (y < top || i >= entries.size()) return nullptr;
+		return &entries[i];
+	}
+
+	bool visible = false;
+
+private:
+	SDL_Renderer* renderer;
+	std::string cachePath;
+	std::thread worker;
+	std::vector<RomEntry> scanned;
+	std::vector<RomEntry> entries;
+	int firstRow = 0;
+};
+
+// Reads and checks ROMs on a worker thread, so the running game keeps going
+// meanwhile. The result comes back with an SDL user event and the main loop
+// inserts it between two frames.
+class RomLoader {
+public:
+	struct Result {
+		std::string path;
+		std::unique_ptr<Cartridge> cartridge; // Null on failure
+		std::string error;
+	};
+
+	~RomLoader() {
+		if (worker.joinable()) worker.join();
+	}
+
+	void start(std::string path) {
+		if (worker.joinable()) worker.join();
+		worker = std::thread([path = std::move(path)] {
+			auto* result = new Result{ path, nullptr, {} };
+			try {
+				result->cartridge = std::make_unique<Cartridge>(Cartridge::fromFile(path.c_str()));
+			} catch (const std::exception& e) {
+				result->error = e.what();
+			}
+
+			SDL_Event ev;
+			SDL_memset(&ev, 0, sizeof(ev));
+			ev.type = SDL_EVENT_USER;
+			ev.user.code = 4;
+			ev.user.data1 = result;
+			if (!SDL_PushEvent(&ev)) delete result;
+		});
+	}
+
+	// Called on the main thread with the event's data; takes ownership.
+	static std::unique_ptr<Result> finish(void* data) {
+		return std::unique_ptr<Result>(static_cast<Result*>(data));
+	}
+
+private:
+	std::thread worker;
+};
+
+// Live performance figures drawn over the status text in the menu bar,
+// toggled with F3: emulated frame rate, host loop time, emulated CPU clock,
+// where each host frame went, and a graph of recent host frame times.
+// The main loop feeds it clock readings around each phase; while hidden,
+// the emulator is not asked to time its scanlines. There is no audio buffer
+// fill figure: the emulator has no APU and opens no audio stream.
+class PerfOverlay {
+public:
+	enum Phase { Emulation, Ppu, Upload, Present, PhaseCount };
+
+	bool visible = false;
+
+	void add(Phase phase, Uint64 ns) { phaseNs[phase] += ns; }
+
+	void endLoop(Uint64 loopNs) {
+		history[next] = loopNs;
+		next = (next + 1) % HISTORY;
+		loops++;
+		loopTotalNs += loopNs;
+	}
+
+	// Averages the counters over a window of `seconds`, then starts a new one.
+	// `ppuNs` is the emulator's scanline time, or the renderer thread's. The
+	// former is taken out of the emulation time, which it is part of.
+	void update(double seconds, uint64_t frames, uint64_t cycles, uint64_t ppuNs, bool ppuThread) {
+		fps = static_cast<double>(frames) / seconds;
+		mhz = static_cast<double>(cycles) / seconds / 1e6;
+		const double perLoop = loops ? 1e-6 / static_cast<double>(loops) : 0.0;
+		loopMs = static_cast<double>(loopTotalNs) * perLoop;
+		phaseNs[Ppu] = ppuNs;
+		if (!ppuThread) phaseNs[Emulation] -= std::min(phaseNs[Emulation], ppuNs);
+		for (int i = 0; i < PhaseCount; i++) phaseMs[i] = static_cast<double>(phaseNs[i]) * perLoop;
+		threaded = ppuThread;
+		loops = 0;
+		loopTotalNs = 0;
+		phaseNs.fill(0);
+	}
+
+	void render(SDL_Renderer* renderer, int x, int windowWidth) const {
+		SDL_FRect area{ (float)x, 0, (float)(windowWidth - x), (float)MENU_HEIGHT };
+		SDL_SetRenderDrawColor(renderer, 40, 40, 40, 255);
+		SDL_RenderFillRect(renderer, &area);
+
+		char text[96];
+		SDL_SetRenderDrawColor(renderer, 230, 230, 230, 255);
+		SDL_snprintf(text, sizeof(text), "%5.1f fps %5.1f ms %5.2f MHz", fps, loopMs, mhz);
+		SDL_RenderDebugText(renderer, (float)x, 5, text);
+		// With the PPU thread, its time is spent next to the emulation thread's.
+		SDL_snprintf(text, sizeof(text), "emu %.2f %s %.2f up %.2f pres %.2f", phaseMs[Emulation],
+			threaded ? "ppu||" : "ppu", phaseMs[Ppu], phaseMs[Upload], phaseMs[Present]);
+		SDL_RenderDebugText(renderer, (float)x, 19, text);
+
+		// One column per loop, oldest on the left; the line is one NES frame.
+		const int graphX = windowWidth - HISTORY - 8;
+		if (graphX < x + 300) return;
+		constexpr float HEIGHT = 24, FULL_NS = 2 * SDL_NS_PER_SECOND / NES_FPS;
+		SDL_FRect graph{ (float)graphX, 4, (float)HISTORY, HEIGHT };
+		SDL_SetRenderDrawColor(renderer, 20, 20, 20, 255);
+		SDL_RenderFillRect(renderer, &graph);
+		for (int i = 0; i < HISTORY; i++) {
+			const Uint64 ns = history[(next + i) % HISTORY];
+			const float h = std::min(HEIGHT, HEIGHT * (float)ns / FULL_NS);
+			if (ns * 2 > FULL_NS) SDL_SetRenderDrawColor(renderer, 230, 90, 70, 255);
+			else SDL_SetRenderDrawColor(renderer, 90, 200, 110, 255);
+			SDL_RenderLine(renderer, (float)(graphX + i), 4 + HEIGHT, (float)(graphX + i), 4 + HEIGHT - h);
+		}
+		SDL_SetRenderDrawColor(renderer, 120, 120, 120, 255);
+		SDL_RenderLine(renderer, (float)graphX, 4 + HEIGHT / 2, (float)(graphX + HISTORY), 4 + HEIGHT / 2);
+	}
+
+private:
+	static constexpr int HISTORY = 120;
+
+	std::array<Uint64, HISTORY> history{};
+	int next = 0;
+	uint64_t loops = 0;
+	Uint64 loopTotalNs = 0;
+	std::array<Uint64, PhaseCount> phaseNs{};
+
+	double fps = 0;
+	double loopMs = 0;
+	double mhz = 0;
+	std::array<double, PhaseCount> phaseMs{};
+	bool threaded = false;
 };
 
 class EmulatorUI {
@@ -53,10 +419,45 @@ public:
 		SDL_FRect loadBtn{ 10,4,80,24 };
 		SDL_FRect resetBtn{ 100,4,80,24 };
 		SDL_FRect debugBtn { 190, 4, 80, 24 };
+		SDL_FRect libraryBtn { 280, 4, 80, 24 };
 		SDL_SetRenderDrawColor(renderer, 80, 80, 220, 255);
 		SDL_RenderFillRect(renderer, &loadBtn);
 		SDL_RenderFillRect(renderer, &resetBtn);
 		SDL_RenderFillRect(renderer, &debugBtn);
+		SDL_RenderFillRect(renderer, &libraryBtn);
+
+		if (SDL_GetTicksNS() < messageUntil) {
+			SDL_SetRenderDrawColor(renderer, 255, 140, 120, 255);
+			SDL_RenderDebugText(renderer, 380, 12, message.c_str());
+		} else if (!status.empty()) {
+			SDL_SetRenderDrawColor(renderer, 230, 230, 230, 255);
+			SDL_RenderDebugText(renderer, 380, 12, status.c_str());
+		}
+	}
+
+	// Short text drawn in the menu bar, right of the buttons.
+	void setStatus(std::string text) {
+		if (text == status) return;
+		status = std::move(text);
+		dirty = true;
+	}
+
+	// Shown in place of the status for a few seconds.
+	void showMessage(std::string text) {
+		message = std::move(text);
+		messageUntil = SDL_GetTicksNS() + 4 * SDL_NS_PER_SECOND;
+		dirty = true;
+	}
+
+	// Whether the menu bar looks different since the last call.
+	bool takeDirty() {
+		if (messageUntil != 0 && SDL_GetTicksNS() >= messageUntil) {
+			messageUntil = 0;
+			dirty = true;
+		}
+		bool wasDirty = dirty;
+		dirty = false;
+		return wasDirty;
 	}
 
 	void handleClick(int x, int y) {
@@ -72,17 +473,45 @@ public:
 		} else if (x >= 190 && x <= 270) {
 			std::cout << "[Debug] Debug info in console" << std::endl;
 			onDebug();
+		} else if (x >= 280 && x <= 360) {
+			std::cout << "[UI] Library clicked" << std::endl;
+			onLibrary();
 		}
 	}
 
-	// Called on the main thread when an open-file path arrives
+	// Called on the main thread when an open-file path arrives. The current
+	// game runs on until the new one is ready.
 	void handleFileOpen(const char* path) {
 		if (!path) return;
-		SDL_Log("Processing ROM on main thread: %s", path);
-		emu.reset(path);
+		SDL_Log("Loading ROM: %s", path);
+		showMessage("Loading...");
+		loader.start(path);
+	}
+
+	// Called on the main thread, between frames, once the loader is done.
+	void handleLoaded(void* data) {
+		std::unique_ptr<RomLoader::Result> result = RomLoader::finish(data);
+		if (!result->cartridge) {
+			SDL_Log("Failed to load %s: %s", result->path.c_str(), result->error.c_str());
+			showMessage("Load failed: " + result->error);
+			return;
+		}
+		emu.insert(std::move(*result->cartridge));
+		messageUntil = 0;
+		dirty = true;
+		onROMLoaded();
 	}
 
 	static void emu_reset_callback(void *userdata, const char* const* filelist, int filters) {
+		push_paths(filelist, 1);
+	}
+
+	static void library_folder_callback(void *userdata, const char* const* filelist, int filters) {
+		push_paths(filelist, 2);
+	}
+
+	// For each selected path, duplicate the C-string and push an SDL user event.
+	static void push_paths(const char* const* filelist, int code) {
 		if (!filelist) {
 			SDL_Log("An error occured: %s", SDL_GetError());
 			return;
@@ -91,7 +520,6 @@ public:
 			return;
 		}
 
-		// For each selected file, duplicate the C-string and push an SDL user event.
 		while (*filelist) {
 			char* dup = SDL_strdup(*filelist); // allocate with SDL_strdup so we can SDL_free later
 			if (!dup) {
@@ -100,7 +528,7 @@ public:
 				SDL_Event ev;
 				SDL_memset(&ev, 0, sizeof(ev));
 				ev.type = SDL_EVENT_USER;
-				ev.user.code = 1;            // application-defined code
+				ev.user.code = code;         // application-defined code
 				ev.user.data1 = dup;        // pass the duplicated string
 				if (!SDL_PushEvent(&ev)) {
 					SDL_free(dup);
@@ -115,17 +543,149 @@ public:
 	std::function<void()> onLoadROM = [] {};
 	std::function<void()> onReset = [] {};
 	std::function<void()> onDebug = [] {};
+	std::function<void()> onLibrary = [] {};
+	std::function<void()> onROMLoaded = [] {};
+
+	Emulator& emulator() { return emu; }
 
 private:
 	SDL_Renderer* renderer;
 	Emulator emu;
+	RomLoader loader;
+	std::string status;
+	std::string message;
+	Uint64 messageUntil = 0;
+	bool dirty = true;
 };
 
-int main(int argc, char** argv) {
+// Replays a movie headless and checks every frame's state hash.
+static int verifyMovieFile(const std::string& moviePath, const std::string& romPath, Stepping stepping,
+	PpuPipeline* pipeline) {
+	try {
+		Movie movie = Movie::load(moviePath.c_str());
+		Emulator emu;
+		emu.setTracing(false);
+		emu.setStepping(stepping);
+		emu.attachPpuPipeline(pipeline);
+		emu.loadROM(romPath.c_str());
+		MovieVerifyResult result = verifyMovie(emu, movie);
+
+		std::cout << "[Verify] " << result.frames << " frames in " << result.seconds << " s ("
+			<< (result.seconds > 0 ? static_cast<double>(result.frames) / result.seconds : 0.0)
+			<< " fps)" << std::endl;
+		const Emulator::IdleSkipStats& idle = emu.idleSkipStatistics();
+		if (emu.getCycleCount() != 0) {
+			std::cout << "[Verify] " << 100.0 * static_cast<double>(idle.cycles) / static_cast<double>(emu.getCycleCount())
+				<< "% of cycles skipped in " << idle.loops << " idle loops" << std::endl;
+		}
+		if (result.mismatches != 0) {
+			std::cout << "[Verify] " << result.mismatches << " mismatching frames, first at frame "
+				<< result.firstMismatch << std::endl;
+			return 1;
+		}
+		std::cout << "[Verify] All frames match." << std::endl;
+		return 0;
+	} catch (const std::exception& e) {
+		std::cerr << "[Verify] " << e.what() << std::endl;
+		return 1;
+	}
+}
+
+static void printPipelineStatistics(const PpuPipeline* pipeline) {
+	if (!pipeline) return;
+	PpuPipeline::Stats st = pipeline->statistics();
+	if (st.frames == 0) return;
+	std::cout << "[PPU] The emulation thread waited for the renderer at " << st.waits << " of " << st.frames
+		<< " frames, " << (st.waits ? static_cast<double>(st.waitNs) / 1000.0 / static_cast<double>(st.waits) : 0.0)
+		<< " us on average" << std::endl;
+}
 
+int main(int argc, char** argv) {
+	// --profile <out.folded> writes collapsed call stacks on exit,
+	// --labels <file.nl|file.dbg> names addresses in the profile and the disassembly.
+	// --record <movie> / --play <movie> record or replay input,
+	// --verify <movie> --rom <rom> replays headless as fast as possible.
+	// --trace-bin <file> writes a binary trace, see nesemu-trace.
+	// --turbo <n> sets the fast-forward speed, 0 (the default) is uncapped.
+	// --stepping <instruction|cycle> selects the CPU core granularity.
+	// --netplay <local-port>:<peer-host>:<peer-port> plays against a peer,
+	// --player <1|2> picks this side's controller port.
+	// --capture <file.y4m|file.rgb> records every frame, see Capture.hpp.
+	// --cdl <file.cdl> logs PRG code/data bytes, merged into the file on exit.
+	// --ppu <frame|thread> draws the picture in the emulation loop or on its own thread.
+	std::unique_ptr<Profiler> profiler;
+	std::string profilePath;
+	std::string labelPath;
+	std::string recordPath;
+	std::string playPath;
+	std::string verifyPath;
+	std::string romPath;
+	std::string traceBinPath;
+	int turboMultiplier = 0;
+	Stepping stepping = Stepping::Instruction;
+	std::string netplayAddress;
+	int player = 1;
+	std::string capturePath;
+	std::string cdlPath;
+	bool ppuThread = false;
+	for (int i = 1; i + 1 < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--profile") {
+			profilePath = argv[++i];
+		} else if (arg == "--labels") {
+			labelPath = argv[++i];
+		} else if (arg == "--record") {
+			recordPath = argv[++i];
+		} else if (arg == "--play") {
+			playPath = argv[++i];
+		} else if (arg == "--verify") {
+			verifyPath = argv[++i];
+		} else if (arg == "--rom") {
+			romPath = argv[++i];
+		} else if (arg == "--trace-bin") {
+			traceBinPath = argv[++i];
+		} else if (arg == "--turbo") {
+			turboMultiplier = std::max(0, std::atoi(argv[++i]));
+		} else if (arg == "--stepping") {
+			stepping = std::string(argv[++i]) == "cycle" ? Stepping::Cycle : Stepping::Instruction;
+		} else if (arg == "--netplay") {
+			netplayAddress = argv[++i];
+		} else if (arg == "--player") {
+			player = std::atoi(argv[++i]) == 2 ? 2 : 1;
+		} else if (arg == "--capture") {
+			capturePath = argv[++i];
+		} else if (arg == "--cdl") {
+			cdlPath = argv[++i];
+		} else if (arg == "--ppu") {
+			ppuThread = std::string(argv[++i]) == "thread";
+		}
+	}
 
+	std::unique_ptr<PpuPipeline> pipeline;
+	if (ppuThread) {
+		pipeline = std::make_unique<PpuPipeline>();
+		if (std::thread::hardware_concurrency() < 2)
+			std::cerr << "[PPU] Only one CPU core: the PPU thread will slow emulation down." << std::endl;
+	}
+	if (!verifyPath.empty()) {
+		int result = verifyMovieFile(verifyPath, romPath, stepping, pipeline.get());
+		printPipelineStatistics(pipeline.get());
+		return result;
+	}
+	Labels labels;
+	if (!labelPath.empty()) {
+		try {
+			labels.load(labelPath.c_str());
+		} catch (const std::exception& e) {
+			std::cerr << "[Labels] " << e.what() << std::endl;
+		}
+	}
+	if (!profilePath.empty()) {
+		profiler = std::make_unique<Profiler>();
+		profiler->setLabels(labels);
+	}
 
-	if (!SDL_Init(SDL_INIT_VIDEO)) {
+	if (!SDL_Init(SDL_INIT_VIDEO | SDL_INIT_GAMEPAD)) {
 		std::cerr << "SDL init failed: " << SDL_GetError() << std::endl;
 		return 1;
 	}
@@ -137,15 +697,161 @@ int main(int argc, char** argv) {
 	framebuffer.fillTestPattern();
 
 	EmulatorUI ui(renderer);
+	ui.emulator().attachProfiler(profiler.get());
+	std::unique_ptr<CodeDataLogger> cdl;
+	if (!cdlPath.empty()) {
+		cdl = std::make_unique<CodeDataLogger>();
+		ui.emulator().attachCodeDataLogger(cdl.get());
+	}
+
+	Debugger debugger;
+	ui.emulator().attachDebugger(&debugger);
+
+	Emulator& emu = ui.emulator();
+	emu.setStepping(stepping);
+	emu.attachPpuPipeline(pipeline.get());
+	emu.getDisassembler().setLabels(&labels);
+
+	InputState input;
+	ControllerMapper controllers(input);
+
+	// Netplay needs the input fixed for a whole frame, so it is passed to the
+	// session once per frame instead of being latched on strobe.
+	std::unique_ptr<UdpTransport> transport;
+	std::unique_ptr<RollbackSession> session;
+	if (!netplayAddress.empty()) {
+		size_t first = netplayAddress.find(':');
+		size_t last = netplayAddress.rfind(':');
+		try {
+			if (first == std::string::npos || first == last)
+				throw std::runtime_error("Expected <local-port>:<peer-host>:<peer-port>.");
+			transport = std::make_unique<UdpTransport>(
+				static_cast<uint16_t>(std::atoi(netplayAddress.substr(0, first).c_str())),
+				netplayAddress.substr(first + 1, last - first - 1),
+				static_cast<uint16_t>(std::atoi(netplayAddress.substr(last + 1).c_str())));
+		} catch (const std::exception& e) {
+			std::cerr << "[Netplay] " << e.what() << std::endl;
+		}
+	}
+
+	Movie movie;
+	size_t moviePosition = 0;
+	if (!playPath.empty()) {
+		try {
+			movie = Movie::load(playPath.c_str());
+		} catch (const std::exception& e) {
+			std::cerr << "[Movie] " << e.what() << std::endl;
+			playPath.clear();
+		}
+	}
+
+	// A recorded movie holds one input per frame, so recording samples the
+	// input once per frame as well; otherwise it is latched on every strobe.
+	emu.attachInput(playPath.empty() && recordPath.empty() && !transport ? &input : nullptr);
+
+	std::unique_ptr<BinaryTraceWriter> traceWriter;
+	if (!traceBinPath.empty()) {
+		try {
+			traceWriter = std::make_unique<BinaryTraceWriter>(traceBinPath.c_str());
+			emu.attachTraceWriter(traceWriter.get());
+		} catch (const std::exception& e) {
+			std::cerr << "[Trace] " << e.what() << std::endl;
+		}
+	}
+
+	std::unique_ptr<FrameCapture> capture;
+	if (!capturePath.empty()) {
+		try {
+			capture = std::make_unique<FrameCapture>(capturePath, FrameCapture::formatFor(capturePath));
+		} catch (const std::exception& e) {
+			std::cerr << "[Capture] " << e.what() << std::endl;
+		}
+	}
+
+	ui.onROMLoaded = [&]() {
+		if (transport) {
+			// Re-simulated frames would print their trace again.
+			emu.setTracing(false);
+			session = std::make_unique<RollbackSession>(emu, *transport, player - 1);
+		}
+		if (!recordPath.empty()) {
+			movie.begin(emu);
+		} else if (!playPath.empty()) {
+			moviePosition = 0;
+			if (movie.romHash != emu.getRomHash())
+				std::cerr << "[Movie] Warning: the movie was recorded with another ROM." << std::endl;
+		}
+	};
+
+	auto stepFrame = [&](bool picture) {
+		if (!playPath.empty() && moviePosition < movie.frames.size()) {
+			const Movie::Frame& f = movie.frames[moviePosition++];
+			emu.setInput(f.port1, f.port2);
+		}
+		if (session) {
+			session->advance(static_cast<uint8_t>(input.latch()));
+		} else {
+			if (!recordPath.empty() && playPath.empty()) {
+				const uint16_t buttons = input.latch();
+				emu.setInput(static_cast<uint8_t>(buttons), static_cast<uint8_t>(buttons >> 8));
+			}
+			emu.runFrame(picture);
+		}
+		if (!recordPath.empty()) {
+			movie.record(emu.getInput(0), emu.getInput(1), emu.stateHash());
+		}
+		if (capture) {
+			capture->submit(emu.getFrameBuffer());
+		}
+	};
+
+	// Fast-forward: hold Tab, or toggle it with the key left of 1.
+	bool fastForwardHeld = false;
+	bool fastForwardToggled = false;
+
+	// Achieved speed, measured over half-second windows.
+	Uint64 speedWindowStart = SDL_GetTicksNS();
+	uint64_t speedWindowFrames = 0;
+	double speed = 0.0;
+
+	// F3 shows the performance overlay. Its counters use the same windows.
+	PerfOverlay overlay;
+	uint64_t windowCycles = emu.getCycleCount();
+	uint64_t windowPpuNs = 0;
+	auto ppuNanoseconds = [&]() {
+		return pipeline ? pipeline->statistics().renderNs : emu.ppuNanoseconds();
+	};
 
 	bool running = true;
 
+	// The window is only drawn again when something in it changed: a new
+	// picture, the menu bar text, or an event such as a resize or a click.
+	bool redraw = true;
+	uint64_t loops = 0;
+	uint64_t presents = 0;
+
 	ui.onLoadROM = [&]() {
 		std::cout << "[Emulator] TODO" << std::endl;
 	};
 
 	ui.onDebug = [&]() {
-		std::cout << "[Debug] Current " << std::endl;
+		DebugConsole console(ui.emulator(), debugger);
+		console.run();
+	};
+
+	std::string libraryCache = "library.idx";
+	if (char* prefPath = SDL_GetPrefPath("bapoDev", "NESEmu")) {
+		libraryCache = std::string(prefPath) + libraryCache;
+		SDL_free(prefPath);
+	}
+	LibraryView library(renderer, libraryCache);
+
+	ui.onLibrary = [&]() {
+		if (library.visible) {
+			library.visible = false;
+		} else if (!library.scanning()) {
+			SDL_ShowOpenFolderDialog(EmulatorUI::library_folder_callback, &ui, window, "~/", false);
+		}
 	};
 
 	ui.onReset = [&]() {
@@ -157,30 +863,186 @@ int main(int argc, char** argv) {
 	};
 
 	while (running) {
+		const Uint64 iterationStart = SDL_GetTicksNS();
 		SDL_Event e;
 		while (SDL_PollEvent(&e)) {
 			if (e.type == SDL_EVENT_QUIT) {
 				running = false;
+			} else if (controllers.handleEvent(e)) {
+				continue;
+			} else if (e.type == SDL_EVENT_KEY_DOWN || e.type == SDL_EVENT_KEY_UP) {
+				bool down = e.type == SDL_EVENT_KEY_DOWN;
+				if (e.key.key == SDLK_TAB) {
+					fastForwardHeld = down;
+				} else if (e.key.key == SDLK_GRAVE && down && !e.key.repeat) {
+					fastForwardToggled = !fastForwardToggled;
+				} else if (e.key.key == SDLK_F3 && down && !e.key.repeat) {
+					overlay.visible = !overlay.visible;
+					emu.setPpuTiming(overlay.visible && !pipeline);
+				}
 			} else if (e.type == SDL_EVENT_MOUSE_BUTTON_DOWN) {
-				ui.handleClick(e.button.x, e.button.y);
+				if (library.visible && e.button.y > MENU_HEIGHT) {
+					if (const RomEntry* rom = library.entryAt((int)e.button.y, MENU_HEIGHT)) {
+						library.visible = false;
+						ui.handleFileOpen(rom->path.c_str());
+					}
+				} else {
+					ui.handleClick(e.button.x, e.button.y);
+				}
+			} else if (e.type == SDL_EVENT_MOUSE_WHEEL && library.visible) {
+				library.scroll(e.wheel.y > 0 ? -3 : 3);
 			} else if (e.type == SDL_EVENT_USER && e.user.code == 1) {
 				char* path = static_cast<char*>(e.user.data1);
 				ui.handleFileOpen(path);
 				SDL_free(path); // free the SDL_strdup'd buffer
+			} else if (e.type == SDL_EVENT_USER && e.user.code == 2) {
+				char* path = static_cast<char*>(e.user.data1);
+				ui.setStatus("Scanning...");
+				library.startScan(path);
+				SDL_free(path);
+			} else if (e.type == SDL_EVENT_USER && e.user.code == 3) {
+				library.finishScan();
+			} else if (e.type == SDL_EVENT_USER && e.user.code == 4) {
+				ui.handleLoaded(e.user.data1);
+			} else if (e.type == SDL_EVENT_RENDER_TARGETS_RESET || e.type == SDL_EVENT_RENDER_DEVICE_RESET) {
+				framebuffer.invalidate();
+			}
+			if (e.type != SDL_EVENT_MOUSE_MOTION) redraw = true;
+		}
+
+		// In fast-forward several frames run per loop and only the last one is
+		// presented, so only that one is drawn (all of them while capturing);
+		// uncapped mode fills a host frame's worth of time.
+		const bool fastForward = fastForwardHeld || fastForwardToggled;
+		const Uint64 loopStart = SDL_GetTicksNS();
+		if (emu.isLoaded() && !emu.isHalted()) {
+			int frames = 0;
+			bool last = !fastForward;
+			while (!emu.isPaused() && !emu.isHalted()) {
+				if (!last) {
+					const Uint64 elapsed = SDL_GetTicksNS() - loopStart;
+					last = turboMultiplier > 0 ? frames + 1 >= turboMultiplier
+						: frames > 0 && elapsed + elapsed / frames >= SDL_NS_PER_SECOND / 60;
+				}
+				stepFrame(last || capture);
+				frames++;
+				if (last) break;
+			}
+			speedWindowFrames += frames;
+			const Uint64 converting = SDL_GetTicksNS();
+			overlay.add(PerfOverlay::Emulation, converting - loopStart);
+			if (framebuffer.update(emu.getFrameBuffer(), emu.frameHash())) redraw = true;
+			overlay.add(PerfOverlay::Upload, SDL_GetTicksNS() - converting);
+		}
+
+		const Uint64 now = SDL_GetTicksNS();
+		if (now - speedWindowStart >= SDL_NS_PER_SECOND / 2) {
+			double seconds = static_cast<double>(now - speedWindowStart) / SDL_NS_PER_SECOND;
+			speed = static_cast<double>(speedWindowFrames) / seconds / NES_FPS;
+			// Power-on and loaded states reset the cycle counter.
+			const uint64_t cycles = emu.getCycleCount();
+			const uint64_t ppuNs = ppuNanoseconds();
+			overlay.update(seconds, speedWindowFrames, cycles >= windowCycles ? cycles - windowCycles : cycles,
+				ppuNs - windowPpuNs, pipeline != nullptr);
+			windowCycles = cycles;
+			windowPpuNs = ppuNs;
+			speedWindowStart = now;
+			speedWindowFrames = 0;
+			char text[64];
+			int length = SDL_snprintf(text, sizeof(text), fastForward ? ">> x%.1f" : "x%.2f", speed);
+			InputState::LatencyStats latency = input.latency();
+			if (latency.count != 0 && length > 0) {
+				SDL_snprintf(text + length, sizeof(text) - length, "  input %.1f ms", latency.lastUs / 1000.0);
 			}
+			ui.setStatus(emu.isLoaded() ? text : "");
 		}
 
-		int winW, winH;
-		SDL_GetWindowSize(window, &winW, &winH);
+		if (ui.takeDirty() || overlay.visible) redraw = true;
+		loops++;
+		if (redraw) {
+			const Uint64 drawStart = SDL_GetTicksNS();
+			int winW, winH;
+			SDL_GetWindowSize(window, &winW, &winH);
 
-		SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-		SDL_RenderClear(renderer);
+			SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+			SDL_RenderClear(renderer);
+
+			ui.renderMenu(winW);
+			if (overlay.visible) overlay.render(renderer, 380, winW);
+			if (library.visible) {
+				library.render(0, MENU_HEIGHT, winW, winH - MENU_HEIGHT);
+			} else {
+				framebuffer.render(0, MENU_HEIGHT, winW, winH - MENU_HEIGHT);
+			}
 
-		ui.renderMenu(winW);
-		framebuffer.render(0, MENU_HEIGHT, winW, winH - MENU_HEIGHT);
+			const Uint64 presentStart = SDL_GetTicksNS();
+			overlay.add(PerfOverlay::Upload, presentStart - drawStart);
+			SDL_RenderPresent(renderer);
+			overlay.add(PerfOverlay::Present, SDL_GetTicksNS() - presentStart);
+			input.presented(SDL_GetTicksNS() / 1000);
+			redraw = false;
+			presents++;
+		}
+		if (!fastForward) {
+			SDL_Delay(16);
+		}
+		overlay.endLoop(SDL_GetTicksNS() - iterationStart);
+	}
+
+	if (!recordPath.empty() && emu.isLoaded()) {
+		try {
+			movie.save(recordPath.c_str());
+		} catch (const std::exception& e) {
+			std::cerr << "[Movie] " << e.what() << std::endl;
+		}
+	}
 
-		SDL_RenderPresent(renderer);
-		SDL_Delay(16);
+	if (session) {
+		const NetplayStats& st = session->statistics();
+		std::cout << "[Netplay] " << st.frames << " frames, " << st.rollbacks << " rollbacks, "
+			<< st.resimulatedFrames << " frames re-simulated (max depth " << st.maxRollbackDepth << "), "
+			<< st.stalls << " stalls" << std::endl;
+	}
+
+	std::cout << "[Display] " << presents << " of " << loops << " loop iterations presented a new picture" << std::endl;
+
+	if (capture) {
+		capture->stop();
+		FrameCapture::Stats st = capture->statistics();
+		std::cout << "[Capture] " << st.written << " frames written, " << st.dropped << " dropped"
+			<< (st.failed ? " (the output stopped accepting data)" : "") << std::endl;
+	}
+
+	InputState::LatencyStats latency = input.latency();
+	if (latency.count != 0) {
+		std::cout << "[Input] " << latency.count << " changes, input-to-present latency median "
+			<< latency.medianUs / 1000.0 << " ms, p99 " << latency.p99Us / 1000.0 << " ms, max "
+			<< latency.maxUs / 1000.0 << " ms" << std::endl;
+	}
+
+	emu.attachPpuPipeline(nullptr);
+	printPipelineStatistics(pipeline.get());
+
+	if (cdl && emu.isLoaded()) {
+		try {
+			cdl->mergeFile(cdlPath);
+			cdl->save(cdlPath);
+			std::cout << "[CDL] " << cdl->count(CodeDataLogger::Code) << " code and " << cdl->count(CodeDataLogger::Data)
+				<< " data bytes of " << cdl->prgFlags().size() << " logged" << std::endl;
+		} catch (const std::exception& e) {
+			std::cerr << "[CDL] " << e.what() << std::endl;
+		}
+	}
+
+	if (profiler) {
+		std::ofstream out(profilePath);
+		profiler->writeCollapsed(out);
+		std::cout << "[Profiler] Hottest instructions:" << std::endl;
+		profiler->writeFlat(std::cout, 20);
+		if (profiler->total() != 0) {
+			std::cout << "[Profiler] " << profiler->idle() << " cycles (" << 100.0 * static_cast<double>(profiler->idle()) / static_cast<double>(profiler->total())
+				<< "%) skipped in idle loops" << std::endl;
+		}
 	}
 
 	SDL_DestroyRenderer(renderer);
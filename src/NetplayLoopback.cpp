@@ -0,0 +1,148 @@
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Netplay.hpp"
+
+// Runs two rollback netplay sessions in one process over a simulated link,
+// checks that both end in the same state as a plain run with the same inputs,
+// and reports how much re-simulation the link caused.
+//
+//   nesemu-netplay [--rom <file.nes>] [--frames <n>] [--delay <ms>] [--jitter <ms>]
+//                  [--loss <0-1>] [--input-delay <frames>] [--rollback <frames>] [--seed <n>]
+
+static constexpr double kFrameMs = 1000.0 / 60.0988;
+
+// Strobes the controllers, then counts in $0400-$040F how often each button
+// of each port reads as pressed. Any misapplied input changes the RAM.
+static std::vector<uint8_t> syntheticRom() {
+	std::vector<uint8_t> image(16 + 0x8000, 0);
+	const uint8_t program[] = {
+		0xA9, 0x01, 0x8D, 0x16, 0x40,             // LDA #1 / STA $4016
+		0xA9, 0x00, 0x8D, 0x16, 0x40,             // LDA #0 / STA $4016
+		0xA2, 0x00,                               // LDX #0
+		0xAD, 0x16, 0x40, 0x29, 0x01, 0xF0, 0x03, // read: LDA $4016 / AND #1 / BEQ +3
+		0xFE, 0x00, 0x04,                         //   INC $0400,X
+		0xAD, 0x17, 0x40, 0x29, 0x01, 0xF0, 0x03, //   LDA $4017 / AND #1 / BEQ +3
+		0xFE, 0x08, 0x04,                         //   INC $0408,X
+		0xE8, 0xE0, 0x08, 0xD0, 0xE7,             //   INX / CPX #8 / BNE read
+		0x4C, 0x00, 0x80,                         // JMP $8000
+	};
+	std::copy(std::begin(program), std::end(program), image.begin() + 16);
+	image[16 + 0x7FFD] = 0x80;
+	return image;
+}
+
+// Button states held for a random number of frames, like a player would.
+static std::vector<uint8_t> playerInputs(size_t frames, uint32_t idleFrames, std::mt19937& random) {
+	std::vector<uint8_t> inputs(frames, 0);
+	std::uniform_int_distribution<int> hold(2, 30);
+	std::uniform_int_distribution<int> buttons(0, 255);
+	size_t f = idleFrames;
+	while (f < frames) {
+		auto value = static_cast<uint8_t>(buttons(random));
+		for (int i = hold(random); i > 0 && f < frames; i--) inputs[f++] = value;
+	}
+	return inputs;
+}
+
+static void load(Emulator& emu, const std::string& romPath) {
+	emu.setTracing(false);
+	if (romPath.empty()) emu.loadROM(syntheticRom());
+	else emu.loadROM(romPath.c_str());
+}
+
+int main(int argc, char** argv) {
+	std::string romPath;
+	uint32_t frames = 3600;
+	uint32_t inputDelay = 0;
+	uint32_t maxRollback = 8;
+	uint32_t seed = 1;
+	LoopbackTransport::Link link;
+	link.delayMs = 40;
+	link.jitterMs = 20;
+	for (int i = 1; i + 1 < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--rom") {
+			romPath = argv[++i];
+		} else if (arg == "--frames") {
+			frames = static_cast<uint32_t>(std::max(1, std::atoi(argv[++i])));
+		} else if (arg == "--delay") {
+			link.delayMs = std::atof(argv[++i]);
+		} else if (arg == "--jitter") {
+			link.jitterMs = std::atof(argv[++i]);
+		} else if (arg == "--loss") {
+			link.lossRate = std::atof(argv[++i]);
+		} else if (arg == "--input-delay") {
+			inputDelay = static_cast<uint32_t>(std::max(0, std::atoi(argv[++i])));
+		} else if (arg == "--rollback") {
+			maxRollback = static_cast<uint32_t>(std::max(1, std::atoi(argv[++i])));
+		} else if (arg == "--seed") {
+			seed = static_cast<uint32_t>(std::atoi(argv[++i]));
+		}
+	}
+	link.random.seed(seed);
+
+	try {
+		Emulator emuA, emuB, reference;
+		load(emuA, romPath);
+		load(emuB, romPath);
+		load(reference, romPath);
+
+		std::mt19937 random(seed);
+		std::vector<uint8_t> inputsA = playerInputs(frames + inputDelay, inputDelay, random);
+		std::vector<uint8_t> inputsB = playerInputs(frames + inputDelay, inputDelay, random);
+
+		LoopbackTransport linkA(link), linkB(link);
+		LoopbackTransport::connect(linkA, linkB);
+		RollbackSession a(emuA, linkA, 0, inputDelay, maxRollback);
+		RollbackSession b(emuB, linkB, 1, inputDelay, maxRollback);
+
+		uint64_t hostFrames = 0;
+		while (a.currentFrame() < frames || b.currentFrame() < frames) {
+			link.nowMs += kFrameMs;
+			if (a.currentFrame() < frames) a.advance(inputsA[a.nextInputFrame()]);
+			if (b.currentFrame() < frames) b.advance(inputsB[b.nextInputFrame()]);
+			hostFrames++;
+		}
+		// Let the last inputs arrive so both sides confirm every frame.
+		for (int i = 0; a.confirmedFrame() < frames || b.confirmedFrame() < frames; i++) {
+			if (i == 10000) throw std::runtime_error("The sessions never confirmed the last frames.");
+			link.nowMs += kFrameMs;
+			a.poll();
+			b.poll();
+			a.resend();
+			b.resend();
+		}
+
+		for (uint32_t f = 0; f < frames; f++) {
+			reference.setInput(inputsA[f], inputsB[f]);
+			reference.runFrame();
+		}
+
+		std::cout << "[Netplay] " << frames << " frames in " << hostFrames << " host frames, link "
+			<< link.delayMs << " ms +" << link.jitterMs << " ms jitter, " << link.lossRate * 100 << "% loss" << std::endl;
+		for (const RollbackSession* s : { &a, &b }) {
+			const NetplayStats& st = s->statistics();
+			std::cout << "[Netplay] Player " << (s == &a ? 1 : 2) << ": " << st.rollbacks << " rollbacks, "
+				<< st.resimulatedFrames << " frames re-simulated (max depth " << st.maxRollbackDepth << "), "
+				<< st.stalls << " stalls" << std::endl;
+			if (st.rollbacks != 0) {
+				std::cout << "[Netplay]   rollback cost: " << st.rollbackSeconds * 1e3 / st.rollbacks << " ms mean, "
+					<< st.maxRollbackSeconds * 1e3 << " ms max (frame budget " << kFrameMs << " ms), "
+					<< st.rollbackSeconds * 1e6 / st.resimulatedFrames << " us per re-simulated frame" << std::endl;
+			}
+		}
+
+		const uint64_t expected = reference.stateHash();
+		bool ok = emuA.stateHash() == expected && emuB.stateHash() == expected;
+		std::cout << "[Netplay] " << (ok ? "Both players match the reference run." : "DESYNC: the states differ.") << std::endl;
+		return ok ? 0 : 1;
+	} catch (const std::exception& e) {
+		std::cerr << "[Netplay] " << e.what() << std::endl;
+		return 1;
+	}
+}
@@ -0,0 +1,505 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "Emulator.hpp"
+#include "FlatBus.hpp"
+
+// CPU conformance check against the single-step test suites (the nes6502 set
+// of SingleStepTests/ProcessorTests): one JSON file per opcode, each an array
+// of cases with the registers and memory before and after one instruction
+// and every bus access it makes.
+//
+//   nesemu-singlestep [--state-only] [--jobs <n>] <dir or file>...
+//
+// Each case runs on a FlatBus. The registers and memory afterwards, the
+// number of cycles and the bus accesses are compared with the case;
+// --state-only compares the registers and memory only. Files are parsed in
+// place as they are read, without building a document, and run in parallel,
+// one per thread.
+
+struct Options {
+	bool stateOnly = false;
+	unsigned jobs = 0;
+};
+
+struct CpuState {
+	uint16_t pc = 0;
+	uint8_t s = 0;
+	uint8_t a = 0;
+	uint8_t x = 0;
+	uint8_t y = 0;
+	uint8_t p = 0;
+	std::vector<std::pair<uint16_t, uint8_t>> ram;
+};
+
+struct Cycle {
+	uint16_t addr;
+	int value; // -1 where the suite leaves it open
+	bool write;
+};
+
+struct TestCase {
+	std::string_view name;
+	CpuState initial;
+	CpuState final;
+	std::vector<Cycle> cycles;
+};
+
+struct Result {
+	std::string path;
+	int opcode = -1;
+	bool halts = false;
+	size_t cases = 0;
+	size_t stateFailures = 0;
+	size_t cycleFailures = 0;
+	size_t busFailures = 0;
+	std::string firstFailure;
+	std::string error;
+
+	bool ok() const { return error.empty() && !halts && stateFailures + cycleFailures + busFailures == 0; }
+};
+
+class MappedFile {
+public:
+	explicit MappedFile(const std::string& path) {
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) throw std::runtime_error("Failed to open " + path + ".");
+		struct stat st;
+		if (::fstat(fd, &st) != 0 || st.st_size == 0) {
+			::close(fd);
+			throw std::runtime_error("Failed to read " + path + ".");
+		}
+		length = static_cast<size_t>(st.st_size);
+		void* mapped = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if (mapped == MAP_FAILED) throw std::runtime_error("Failed to read " + path + ".");
+		::madvise(mapped, length, MADV_SEQUENTIAL);
+		bytes = static_cast<const char*>(mapped);
+	}
+
+	~MappedFile() { ::munmap(const_cast<char*>(bytes), length); }
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	const char* data() const { return bytes; }
+	size_t size() const { return length; }
+
+private:
+	const char* bytes = nullptr;
+	size_t length = 0;
+};
+
+// Reads the cases one at a time. The parser knows the layout of a case and
+// fills a TestCase straight from the text; the vectors keep their capacity
+// from one case to the next, so a file is read without allocating.
+class CaseReader {
+public:
+	CaseReader(const char* data, size_t size) : begin(data), p(data), end(data + size) {}
+
+	bool next(TestCase& test) {
+		if (!started) {
+			expect('[');
+			started = true;
+			if (consume(']')) return false;
+		} else if (!consume(',')) {
+			expect(']');
+			return false;
+		}
+		readCase(test);
+		return true;
+	}
+
+private:
+	void fail(const char* what) const {
+		throw std::runtime_error(std::string(what) + " at byte " + std::to_string(p - begin) + ".");
+	}
+
+	void skipSpace() {
+		while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')) p++;
+	}
+
+	bool consume(char c) {
+		skipSpace();
+		if (p < end && *p == c) {
+			p++;
+			return true;
+		}
+		return false;
+	}
+
+	void expect(char c) {
+		if (!consume(c)) fail((std::string("Expected '") + c + "'").c_str());
+	}
+
+	std::string_view string() {
+		expect('"');
+		const char* start = p;
+		while (p < end && *p != '"') p += *p == '\\' ? 2 : 1;
+		if (p >= end) fail("Unterminated string");
+		return { start, static_cast<size_t>(p++ - start) };
+	}
+
+	uint32_t number() {
+		skipSpace();
+		if (p >= end || *p < '0' || *p > '9') fail("Expected a number");
+		uint32_t value = 0;
+		while (p < end && *p >= '0' && *p <= '9') value = value * 10 + static_cast<uint32_t>(*p++ - '0');
+		return value;
+	}
+
+	bool null() {
+		skipSpace();
+		if (end - p >= 4 && std::string_view(p, 4) == "null") {
+			p += 4;
+			return true;
+		}
+		return false;
+	}
+
+	// Anything the case layout does not name.
+	void skipValue() {
+		skipSpace();
+		if (p >= end) fail("Unexpected end");
+		if (*p == '"') {
+			string();
+			return;
+		}
+		if (*p == '{' || *p == '[') {
+			int depth = 0;
+			do {
+				if (*p == '"') {
+					string();
+					continue;
+				}
+				if (*p == '{' || *p == '[') depth++;
+				else if (*p == '}' || *p == ']') depth--;
+				p++;
+			} while (depth > 0 && p < end);
+			return;
+		}
+		while (p < end && *p != ',' && *p != '}' && *p != ']') p++;
+	}
+
+	template <class Field> void object(Field field) {
+		expect('{');
+		if (consume('}')) return;
+		do {
+			const std::string_view key = string();
+			expect(':');
+			field(key);
+		} while (consume(','));
+		expect('}');
+	}
+
+	template <class Element> void array(Element element) {
+		expect('[');
+		if (consume(']')) return;
+		do {
+			element();
+		} while (consume(','));
+		expect(']');
+	}
+
+	void readState(CpuState& state) {
+		state.ram.clear();
+		object([&](std::string_view key) {
+			if (key == "pc") state.pc = static_cast<uint16_t>(number());
+			else if (key == "s") state.s = static_cast<uint8_t>(number());
+			else if (key == "a") state.a = static_cast<uint8_t>(number());
+			else if (key == "x") state.x = static_cast<uint8_t>(number());
+			else if (key == "y") state.y = static_cast<uint8_t>(number());
+			else if (key == "p") state.p = static_cast<uint8_t>(number());
+			else if (key == "ram") {
+				array([&] {
+					expect('[');
+					const auto addr = static_cast<uint16_t>(number());
+					expect(',');
+					const auto value = static_cast<uint8_t>(number());
+					expect(']');
+					state.ram.emplace_back(addr, value);
+				});
+			} else skipValue();
+		});
+	}
+
+	void readCase(TestCase& test) {
+		test.cycles.clear();
+		object([&](std::string_view key) {
+			if (key == "name") test.name = string();
+			else if (key == "initial") readState(test.initial);
+			else if (key == "final") readState(test.final);
+			else if (key == "cycles") {
+				array([&] {
+					expect('[');
+					Cycle cycle;
+					cycle.addr = static_cast<uint16_t>(number());
+					expect(',');
+					cycle.value = null() ? -1 : static_cast<int>(number());
+					expect(',');
+					cycle.write = string() == "write";
+					expect(']');
+					test.cycles.push_back(cycle);
+				});
+			} else skipValue();
+		});
+	}
+
+	const char* begin;
+	const char* p;
+	const char* end;
+	bool started = false;
+};
+
+static std::string hex(unsigned value, int digits) {
+	char buffer[16];
+	std::snprintf(buffer, sizeof(buffer), "$%0*X", digits, value);
+	return buffer;
+}
+
+static std::string describeAccess(bool write, uint16_t addr, int value) {
+	return std::string(write ? "write " : "read ") + hex(addr, 4) + (value < 0 ? "" : " = " + hex(static_cast<unsigned>(value), 2));
+}
+
+// What differs in the registers and memory, or an empty string.
+static std::string compareState(const CpuRegisters& r, const FlatBus& bus, const CpuState& expected) {
+	std::string diff;
+	auto check = [&](const char* name, unsigned actual, unsigned wanted, int digits) {
+		if (actual == wanted) return;
+		diff += std::string(diff.empty() ? "" : ", ") + name + " " + hex(actual, digits) + " (expected " + hex(wanted, digits) + ")";
+	};
+	check("PC", r.pc, expected.pc, 4);
+	check("A", r.a, expected.a, 2);
+	check("X", r.x, expected.x, 2);
+	check("Y", r.y, expected.y, 2);
+	check("SP", r.sp, expected.s, 2);
+	// Bits 4 and 5 only exist on the stack.
+	check("P", r.p & 0xCF, expected.p & 0xCF, 2);
+	for (const auto& [addr, value] : expected.ram) {
+		const std::string name = hex(addr, 4);
+		check(name.c_str(), bus.memory[addr], value, 2);
+	}
+	return diff;
+}
+
+static std::string compareBus(const FlatBus& bus, const std::vector<Cycle>& expected) {
+	const size_t n = std::min(bus.log.size(), expected.size());
+	for (size_t i = 0; i < n; i++) {
+		const FlatBus::Access& a = bus.log[i];
+		const Cycle& e = expected[i];
+		if (a.addr != e.addr || a.write != e.write || (e.value >= 0 && a.value != e.value)) {
+			return "access " + std::to_string(i + 1) + ": " + describeAccess(a.write, a.addr, a.value) + " (expected " +
+				describeAccess(e.write, e.addr, e.value) + ")";
+		}
+	}
+	if (bus.log.size() != expected.size()) {
+		const bool missing = bus.log.size() < expected.size();
+		const size_t i = n;
+		return std::to_string(bus.log.size()) + " accesses (expected " + std::to_string(expected.size()) + "), " +
+			(missing ? "missing " + describeAccess(expected[i].write, expected[i].addr, expected[i].value)
+				: "extra " + describeAccess(bus.log[i].write, bus.log[i].addr, bus.log[i].value));
+	}
+	return {};
+}
+
+static int opcodeOf(const CpuState& state) {
+	for (const auto& [addr, value] : state.ram) {
+		if (addr == state.pc) return value;
+	}
+	return -1;
+}
+
+// One instruction of each opcode on zeroed memory, to find the ones the core
+// does not implement: it halts on them.
+static std::vector<bool> haltingOpcodes() {
+	std::vector<bool> halts(256);
+	for (int opcode = 0; opcode < 256; opcode++) {
+		Emulator emu;
+		FlatBus bus;
+		emu.setTracing(false);
+		emu.attachFlatBus(&bus);
+		bus.memory[0x0200] = static_cast<uint8_t>(opcode);
+		emu.setRegisters({ 0x0200, 0, 0, 0, 0xFD, 0x24, 0 });
+		emu.emulate_cpu<false, Stepping::Flat>();
+		halts[opcode] = emu.isHalted();
+	}
+	return halts;
+}
+
+static Result runFile(const Options& options, const std::vector<bool>& halts, const std::string& path) {
+	Result result;
+	result.path = path;
+	try {
+		MappedFile file(path);
+		CaseReader reader(file.data(), file.size());
+		Emulator emu;
+		FlatBus bus;
+		bus.log.reserve(16);
+		emu.attachFlatBus(&bus);
+
+		TestCase test;
+		while (reader.next(test)) {
+			if (result.cases++ == 0) {
+				result.opcode = opcodeOf(test.initial);
+				if (result.opcode >= 0 && halts[result.opcode]) {
+					result.halts = true;
+					result.cases = 0;
+					return result;
+				}
+			}
+			const CpuState& in = test.initial;
+			for (const auto& [addr, value] : in.ram) bus.memory[addr] = value;
+			bus.log.clear();
+			emu.setRegisters({ in.pc, in.a, in.x, in.y, in.s, in.p, 0 });
+			emu.emulate_cpu<false, Stepping::Flat>();
+
+			std::string failure;
+			const std::string state = compareState(emu.registers(), bus, test.final);
+			if (!state.empty()) {
+				result.stateFailures++;
+				failure = state;
+			}
+			if (!options.stateOnly) {
+				if (emu.getCycleCount() != test.cycles.size()) {
+					result.cycleFailures++;
+					if (failure.empty()) {
+						failure = std::to_string(emu.getCycleCount()) + " cycles (expected " +
+							std::to_string(test.cycles.size()) + ")";
+					}
+				}
+				const std::string accesses = compareBus(bus, test.cycles);
+				if (!accesses.empty()) {
+					result.busFailures++;
+					if (failure.empty()) failure = accesses;
+				}
+			}
+			if (!failure.empty() && result.firstFailure.empty()) {
+				result.firstFailure = "\"" + std::string(test.name) + "\": " + failure;
+			}
+
+			// Back to zero for the next case: everything it set or touched.
+			for (const auto& entry : in.ram) bus.memory[entry.first] = 0;
+			for (const auto& entry : test.final.ram) bus.memory[entry.first] = 0;
+			for (const FlatBus::Access& a : bus.log) bus.memory[a.addr] = 0;
+		}
+	} catch (const std::exception& e) {
+		result.error = e.what();
+	}
+	return result;
+}
+
+static void printResult(const Result& result, bool stateOnly) {
+	std::string name = std::filesystem::path(result.path).filename().string();
+	if (result.opcode >= 0) {
+		char label[16];
+		std::snprintf(label, sizeof(label), "%02X %s", result.opcode, kOpcodeMnemonics[result.opcode]);
+		name = label;
+	}
+	if (!result.error.empty()) {
+		std::cout << "[SingleStep] FAIL " << name << ": " << result.error << std::endl;
+	} else if (result.halts) {
+		std::cout << "[SingleStep] skip " << name << ": the CPU halts on it" << std::endl;
+	} else if (result.ok()) {
+		std::cout << "[SingleStep] ok   " << name << ": " << result.cases << " cases" << std::endl;
+	} else {
+		std::cout << "[SingleStep] FAIL " << name << ": " << result.stateFailures << " state";
+		if (!stateOnly) std::cout << ", " << result.cycleFailures << " cycle count, " << result.busFailures << " bus";
+		std::cout << " mismatches in " << result.cases << " cases; first " << result.firstFailure << std::endl;
+	}
+}
+
+int main(int argc, char** argv) {
+	Options options;
+	std::vector<std::string> paths;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--state-only") {
+			options.stateOnly = true;
+		} else if (arg == "--jobs" && i + 1 < argc) {
+			options.jobs = static_cast<unsigned>(std::max(1, std::atoi(argv[++i])));
+		} else {
+			paths.push_back(arg);
+		}
+	}
+
+	std::vector<std::string> files;
+	for (const std::string& path : paths) {
+		std::error_code error;
+		if (!std::filesystem::is_directory(path, error)) {
+			files.push_back(path);
+			continue;
+		}
+		std::vector<std::string> found;
+		for (const auto& entry : std::filesystem::directory_iterator(path, error)) {
+			if (entry.is_regular_file() && entry.path().extension() == ".json") found.push_back(entry.path().string());
+		}
+		std::sort(found.begin(), found.end());
+		files.insert(files.end(), found.begin(), found.end());
+	}
+	if (files.empty()) {
+		std::cerr << "usage: nesemu-singlestep [--state-only] [--jobs <n>] <dir or file>..." << std::endl;
+		return 2;
+	}
+
+	const auto begin = std::chrono::steady_clock::now();
+	const std::vector<bool> halts = haltingOpcodes();
+
+	unsigned jobs = options.jobs ? options.jobs : std::max(1u, std::thread::hardware_concurrency());
+	jobs = static_cast<unsigned>(std::min<size_t>(jobs, files.size()));
+
+	// The biggest files first, so no thread is left with a long one at the end.
+	std::vector<std::pair<uintmax_t, size_t>> order;
+	for (size_t i = 0; i < files.size(); i++) {
+		std::error_code error;
+		const uintmax_t size = std::filesystem::file_size(files[i], error);
+		order.emplace_back(error ? 0 : size, i);
+	}
+	std::sort(order.begin(), order.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+
+	std::vector<Result> results(files.size());
+	std::atomic<size_t> next{ 0 };
+	auto worker = [&] {
+		for (size_t i = next++; i < order.size(); i = next++) {
+			const size_t index = order[i].second;
+			results[index] = runFile(options, halts, files[index]);
+		}
+	};
+	std::vector<std::thread> threads;
+	for (unsigned t = 1; t < jobs; t++) threads.emplace_back(worker);
+	worker();
+	for (std::thread& t : threads) t.join();
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+	std::sort(results.begin(), results.end(), [](const Result& a, const Result& b) {
+		return a.opcode != b.opcode ? a.opcode < b.opcode : a.path < b.path;
+	});
+	size_t cases = 0;
+	size_t passed = 0;
+	size_t skipped = 0;
+	for (const Result& result : results) {
+		printResult(result, options.stateOnly);
+		cases += result.cases;
+		passed += result.ok();
+		skipped += result.halts;
+	}
+	char summary[256];
+	std::snprintf(summary, sizeof(summary), "%zu of %zu opcodes passed, %zu skipped; %zu cases in %.2f s on %u threads.",
+		passed, results.size(), skipped, cases, seconds, jobs);
+	std::cout << "[SingleStep] " << summary << std::endl;
+	return passed + skipped == results.size() ? 0 : 1;
+}
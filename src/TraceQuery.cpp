@@ -0,0 +1,98 @@
+#include <cstdint>
+#include <cstdlib>
+#include <fcntl.h>
+#include <iostream>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "BinaryTrace.hpp"
+
+// Queries a binary trace written by `nesemu --trace-bin`.
+//
+//   nesemu-trace <file> info
+//   nesemu-trace <file> pc <addr> [limit]        all executions of an address
+//   nesemu-trace <file> cycles <from> <to>       states between two cycles
+//   nesemu-trace <file> write <addr>             first write to an address
+
+static void printEntry(const BinaryTraceReader::Entry& e) {
+	const TraceRecord& r = *e.record;
+	std::printf("#%-10llu CYC:%-12llu %04X  %02X  A:%02X X:%02X Y:%02X P:%02X SP:%02X",
+		static_cast<unsigned long long>(e.index), static_cast<unsigned long long>(e.cycle),
+		r.pc(), r.opcode, r.a, r.x, r.y, r.p, r.sp);
+	if (r.wrote()) {
+		std::printf("  [%04X]<-%02X", r.writeAddress(), r.writeValue);
+	}
+	std::printf("\n");
+}
+
+static uint64_t parseNumber(const std::string& text) {
+	if (!text.empty() && text[0] == '$') {
+		return std::strtoull(text.c_str() + 1, nullptr, 16);
+	}
+	return std::strtoull(text.c_str(), nullptr, 0);
+}
+
+int main(int argc, char** argv) {
+	if (argc < 3) {
+		std::cerr << "Usage: nesemu-trace <file> info|pc <addr> [limit]|cycles <from> <to>|write <addr>" << std::endl;
+		return 2;
+	}
+
+	int fd = open(argv[1], O_RDONLY);
+	if (fd < 0) {
+		std::cerr << "Failed to open " << argv[1] << std::endl;
+		return 1;
+	}
+	struct stat st {};
+	fstat(fd, &st);
+	auto size = static_cast<size_t>(st.st_size);
+	void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mapping == MAP_FAILED) {
+		std::cerr << "Failed to map " << argv[1] << std::endl;
+		return 1;
+	}
+
+	int status = 0;
+	try {
+		BinaryTraceReader trace(static_cast<const uint8_t*>(mapping), size);
+		std::string query = argv[2];
+
+		if (query == "info") {
+			std::cout << trace.instructionCount() << " instructions in " << trace.chunkCount() << " chunks" << std::endl;
+			if (trace.chunkCount() != 0) {
+				std::cout << "cycles " << trace.chunk(0).firstCycle << " to "
+					<< trace.chunk(trace.chunkCount() - 1).lastCycle << std::endl;
+			}
+		} else if (query == "pc" && argc >= 4) {
+			auto pc = static_cast<uint16_t>(parseNumber(argv[3]));
+			uint64_t limit = argc >= 5 ? parseNumber(argv[4]) : UINT64_MAX;
+			uint64_t found = 0;
+			trace.executionsOf(pc, [&](const BinaryTraceReader::Entry& e) {
+				if (found++ < limit) printEntry(e);
+			});
+			std::cout << found << " executions" << std::endl;
+		} else if (query == "cycles" && argc >= 5) {
+			trace.betweenCycles(parseNumber(argv[3]), parseNumber(argv[4]), printEntry);
+		} else if (query == "write" && argc >= 4) {
+			BinaryTraceReader::Entry e{};
+			if (trace.firstWriteTo(static_cast<uint16_t>(parseNumber(argv[3])), e)) {
+				printEntry(e);
+			} else {
+				std::cout << "No write found" << std::endl;
+				status = 1;
+			}
+		} else {
+			std::cerr << "Unknown query" << std::endl;
+			status = 2;
+		}
+	} catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		status = 1;
+	}
+
+	munmap(mapping, size);
+	return status;
+}